@@ -0,0 +1,158 @@
+/*
+ * Admission.cpp
+ *
+ * Decides whether an HTTP request is served, so a client hammering the web or API server
+ * can't take the time away from the inverter link.
+ *
+ * Every client (by IP address) has a token bucket which is refilled with http.rateLimit
+ * requests per second up to http.burst (see RateLimiter). A request without a token is
+ * rejected with 429. In addition the time spent in the request handling of both servers is
+ * summed up per second, once it exceeds http.budget (in ms) further requests are rejected with
+ * 503 until the next second starts. Requests for /maxCurrent (the set-point of the consumer)
+ * bypass both and don't take a token, they're cheap and delaying them defeats the purpose of
+ * protecting the control loop.
+ *
+ * Only the generated responses count against the budget. Static files and uploads are rate
+ * limited, but their duration depends on the size and the client's connection (e.g. seconds
+ * for the dashboard's scripts), so they would block all requests of the next windows. The time
+ * charged per request is capped at http.budget for the same reason.
+ *
+ * The counters per server and client are served at /debug/http.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Admission.h"
+
+/**
+ * Constructor
+ */
+Admission::Admission() {
+	memset(counters, 0, sizeof(counters));
+	windowStart = 0;
+	busyTime = 0;
+	lastBusyTime = 0;
+	maxBusyTime = 0;
+}
+
+/**
+ * Check if a request of the client may be served and count the decision. Priority requests
+ * are always admitted, transfers are not subject to the budget.
+ */
+Admission::Result Admission::admit(Server server, uint32_t address, Request request) {
+	uint32_t now = millis();
+	Counters &counter = counters[server];
+	updateWindow(now);
+
+	if (request == REQUEST_PRIORITY) {
+		counter.priority++;
+		counter.admitted++;
+		return ADMITTED;
+	}
+
+	if (request == REQUEST_DYNAMIC && config->httpBudget > 0 && busyTime > config->httpBudget * 1000UL) {
+		if (config->httpRateLimit > 0) {
+			rateLimiter.getClient(getSettings(), address, now).rejected++;
+		}
+		counter.overloaded++;
+		return OVERLOADED;
+	}
+
+	if (config->httpRateLimit > 0 && !rateLimiter.take(rateLimiter.getClient(getSettings(), address, now))) {
+		counter.rateLimited++;
+		return RATE_LIMITED;
+	}
+	counter.admitted++;
+	return ADMITTED;
+}
+
+/**
+ * Add the time spent in the request handling of generated responses (in us), at most
+ * http.budget per call, so a single slow request can't block the following windows.
+ */
+void Admission::addBusyTime(uint32_t duration) {
+	updateWindow(millis());
+	if (config->httpBudget > 0) {
+		duration = min(duration, config->httpBudget * 1000UL);
+	}
+	busyTime += duration;
+}
+
+/**
+ * Return the time after which the client should try again (in sec).
+ */
+uint32_t Admission::getRetryAfter(Result result, uint32_t address) {
+	if (result == RATE_LIMITED && config->httpRateLimit > 0) {
+		RateLimiter::Settings settings = getSettings();
+		return rateLimiter.getRetryAfter(settings, rateLimiter.getClient(settings, address, millis()));
+	}
+	return (ADMISSION_WINDOW + 999) / 1000;
+}
+
+/**
+ * The settings of the rate limiter from the current configuration.
+ */
+RateLimiter::Settings Admission::getSettings() {
+	RateLimiter::Settings settings;
+	settings.rate = config->httpRateLimit;
+	settings.burst = config->httpBurst;
+	return settings;
+}
+
+/**
+ * Start a new window once the current one elapsed.
+ */
+void Admission::updateWindow(uint32_t now) {
+	if (now - windowStart < ADMISSION_WINDOW) {
+		return;
+	}
+	lastBusyTime = (now - windowStart < 2 * ADMISSION_WINDOW ? busyTime : 0);
+	maxBusyTime = max(maxBusyTime, busyTime);
+	busyTime = 0;
+	windowStart = now;
+}
+
+/**
+ * The counters per server, the busy time (in us per window) and the known clients.
+ */
+String Admission::toJSON() {
+	JsonDocument doc;
+	uint32_t now = millis();
+	updateWindow(now);
+
+	doc[F("rateLimit")] = config->httpRateLimit;
+	doc[F("burst")] = config->httpBurst;
+	doc[F("budget")] = config->httpBudget * 1000UL;
+	doc[F("busy")] = lastBusyTime;
+	doc[F("maxBusy")] = max(maxBusyTime, busyTime);
+	doc[F("evictions")] = rateLimiter.getEvictions();
+
+	for (uint8_t i = 0; i < SERVER_COUNT; i++) {
+		JsonObject node = doc[i == SERVER_WEB ? F("web") : F("api")].to<JsonObject>();
+		node[F("admitted")] = counters[i].admitted;
+		node[F("priority")] = counters[i].priority;
+		node[F("rateLimited")] = counters[i].rateLimited;
+		node[F("overloaded")] = counters[i].overloaded;
+	}
+
+	JsonArray array = doc[F("clients")].to<JsonArray>();
+	for (uint8_t i = 0; i < RATE_LIMITER_CLIENTS; i++) {
+		const RateLimiter::Client &client = rateLimiter.getClient(i);
+		if (client.address == 0) {
+			continue;
+		}
+		JsonObject node = array.add<JsonObject>();
+		node[F("address")] = IPAddress(client.address).toString();
+		node[F("tokens")] = client.tokens / RATE_LIMITER_TOKEN;
+		node[F("admitted")] = client.admitted;
+		node[F("rejected")] = client.rejected;
+		node[F("idle")] = (now - client.lastRefill) / 1000;
+	}
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
+
+Admission admission;
@@ -0,0 +1,71 @@
+/*
+ * Admission.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef ADMISSION_H_
+#define ADMISSION_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Logger.h"
+#include "Config.h"
+#include "RateLimiter.h"
+
+#define ADMISSION_WINDOW 1000 // period in which the time spent on requests is compared against http.budget (in ms)
+
+class Admission
+{
+public:
+    enum Result
+    {
+        ADMITTED = 0,
+        RATE_LIMITED = 1, // the client exceeded its rate, answer with 429
+        OVERLOADED = 2 // the budget of the window is used up, answer with 503
+    };
+
+    enum Request
+    {
+        REQUEST_DYNAMIC = 0, // generated response, rate limited and counted against the budget
+        REQUEST_PRIORITY = 1, // the set-point of the consumer, always admitted
+        REQUEST_TRANSFER = 2 // static file or upload, only rate limited (its duration depends on the client)
+    };
+
+    enum Server
+    {
+        SERVER_WEB = 0,
+        SERVER_API = 1,
+        SERVER_COUNT
+    };
+
+    Admission();
+    Result admit(Server server, uint32_t address, Request request);
+    void addBusyTime(uint32_t duration);
+    uint32_t getRetryAfter(Result result, uint32_t address);
+    String toJSON();
+
+private:
+    struct Counters
+    {
+        uint32_t admitted;
+        uint32_t priority; // admitted without rate limit and in spite of an exhausted budget
+        uint32_t rateLimited;
+        uint32_t overloaded;
+    };
+
+    RateLimiter::Settings getSettings();
+    void updateWindow(uint32_t now);
+
+    RateLimiter rateLimiter;
+    Counters counters[SERVER_COUNT];
+    uint32_t windowStart; // in ms
+    uint32_t busyTime; // spent on requests in the current window (in us)
+    uint32_t lastBusyTime; // of the previous window (in us)
+    uint32_t maxBusyTime; // of all windows (in us)
+};
+
+extern Admission admission;
+
+#endif /* ADMISSION_H_ */
@@ -0,0 +1,281 @@
+/*
+ * ApiServer.cpp
+ *
+ * Serves the JSON endpoints /data and /maxCurrent to API clients (e.g. a PLC or a script
+ * polling every second) on persistent HTTP/1.1 connections. The web server on port 80 answers
+ * one client at a time and closes the connection after every request, so each poll costs a
+ * TCP handshake. Here up to api.maxConnections connections stay open until they are idle for
+ * api.idleTimeout seconds or the client sends "Connection: close". Requests are read without
+ * blocking, multiple (pipelined) requests per connection are answered in order.
+ *
+ * If all connections are in use, the one which is idle the longest is closed in favour of the
+ * new one. Only if every connection has an incomplete request pending is the new one refused.
+ *
+ * At most API_REQUESTS_PER_PASS requests are answered per pass, starting with a different
+ * connection each time, so a client sending a long pipeline can't block the others or the
+ * inverter. Every request passes the admission control (see Admission.cpp).
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "ApiServer.h"
+#include "Inverter.h"
+#include "WebServer.h"
+#include "BufferPool.h"
+#include "Admission.h"
+
+static const char JSON_CONTENT_TYPE[] PROGMEM = "application/json";
+
+/**
+ * Constructor
+ */
+ApiServer::ApiServer() : server(8080) {
+	started = false;
+	next = 0;
+	maxConnections = API_MAX_CONNECTIONS;
+	for (uint8_t i = 0; i < API_MAX_CONNECTIONS; i++) {
+		connections[i].length = 0;
+		connections[i].lastActivity = 0;
+	}
+}
+
+ApiServer::~ApiServer() {
+}
+
+/**
+ * Start the server if enabled.
+ */
+void ApiServer::init() {
+	if (config->apiPort == 0) {
+		return;
+	}
+	server.begin(config->apiPort);
+	server.setNoDelay(true);
+	started = true;
+	LOG_INFO("started API server on port %d", config->apiPort);
+}
+
+/**
+ * Accept new connections and answer the received requests.
+ */
+void ApiServer::loop() {
+	if (!started) {
+		return;
+	}
+
+	uint32_t start = micros();
+	uint32_t now = millis();
+	uint8_t requests = API_REQUESTS_PER_PASS;
+	applyLimit();
+	accept(now);
+	for (uint8_t i = 0; i < config->apiMaxConnections; i++) {
+		service(connections[(next + i) % config->apiMaxConnections], now, requests);
+	}
+	next = (next + 1) % config->apiMaxConnections;
+	if (requests < API_REQUESTS_PER_PASS) {
+		admission.addBusyTime(micros() - start);
+	}
+}
+
+/**
+ * Close the connections beyond api.maxConnections when the limit was lowered, they would not
+ * be serviced anymore.
+ */
+void ApiServer::applyLimit() {
+	if (config->apiMaxConnections == maxConnections) {
+		return;
+	}
+	for (uint8_t i = config->apiMaxConnections; i < maxConnections; i++) {
+		if (connections[i].client.connected()) {
+			LOG_INFO("closing API connection %d, api.maxConnections lowered to %d", i, config->apiMaxConnections);
+		}
+		close(connections[i]);
+	}
+	maxConnections = config->apiMaxConnections;
+	next = 0;
+}
+
+/**
+ * Take over a new connection. If no slot is free, the connection which is idle the longest
+ * is closed. The new one is refused if every connection has a request pending.
+ */
+void ApiServer::accept(uint32_t now) {
+	WiFiClient client = server.accept();
+	if (!client) {
+		return;
+	}
+
+	Connection *slot = NULL;
+	for (uint8_t i = 0; i < config->apiMaxConnections; i++) {
+		Connection &connection = connections[i];
+		if (!connection.client.connected()) {
+			slot = &connection;
+			break;
+		}
+		if (connection.length == 0 && (slot == NULL || (int32_t) (connection.lastActivity - slot->lastActivity) < 0)) {
+			slot = &connection;
+		}
+	}
+	if (slot == NULL) {
+		LOG_WARN("API connection from %s refused, too many clients", client.remoteIP().toString().c_str());
+		client.stop();
+		return;
+	}
+
+	close(*slot);
+	slot->client = client;
+	slot->client.setNoDelay(true);
+	slot->lastActivity = now;
+}
+
+/**
+ * Read the available data of a connection and answer the complete requests as long as the
+ * number of requests left in this pass allows.
+ */
+void ApiServer::service(Connection &connection, uint32_t now, uint8_t &requests) {
+	if (!connection.client.connected()) {
+		connection.length = 0;
+		return;
+	}
+	if (now - connection.lastActivity > config->apiIdleTimeout * 1000UL) {
+		close(connection);
+		return;
+	}
+
+	if (connection.client.available() > 0) {
+		int length = connection.client.read((uint8_t *) connection.buffer + connection.length,
+				API_REQUEST_SIZE - connection.length);
+		if (length <= 0) {
+			return;
+		}
+		connection.length += length;
+		connection.lastActivity = now;
+	}
+
+	while (connection.length > 0 && requests > 0) {
+		size_t requestLength = HttpParser::getRequestLength(connection.buffer, connection.length);
+		if (requestLength > API_REQUEST_SIZE || (requestLength == 0 && connection.length == API_REQUEST_SIZE)) {
+			send(connection, 431, false, NULL, NULL, 0);
+			close(connection);
+			return;
+		}
+		if (requestLength == 0 || requestLength > connection.length) {
+			return; // wait for more data
+		}
+
+		requests--;
+		HttpParser::Request request;
+		bool valid = HttpParser::parse(connection.buffer, requestLength, request);
+		if (!valid) {
+			send(connection, 400, false, NULL, NULL, 0);
+		}
+		if (!valid || !process(connection, request)) {
+			close(connection);
+			return;
+		}
+
+		connection.length -= requestLength;
+		memmove(connection.buffer, connection.buffer + requestLength, connection.length);
+	}
+}
+
+/**
+ * Answer a request, returns false if the connection should be closed afterwards.
+ */
+bool ApiServer::process(Connection &connection, const HttpParser::Request &request) {
+	char headers[32];
+	bool priority = HttpParser::equals(request.path, request.pathLength, "/maxCurrent");
+	uint32_t address = connection.client.remoteIP();
+	Admission::Result result = admission.admit(Admission::SERVER_API, address,
+			priority ? Admission::REQUEST_PRIORITY : Admission::REQUEST_DYNAMIC);
+
+	if (result != Admission::ADMITTED) {
+		snprintf_P(headers, sizeof(headers), PSTR("Retry-After: %lu\r\n"), admission.getRetryAfter(result, address));
+		send(connection, result == Admission::RATE_LIMITED ? 429 : 503, request.keepAlive, headers, NULL, 0);
+	} else if (!HttpParser::equals(request.method, request.methodLength, "GET")) {
+		send(connection, 405, request.keepAlive, NULL, NULL, 0);
+	} else if (HttpParser::equals(request.path, request.pathLength, "/data")) {
+		char etag[DATA_ETAG_SIZE];
+		StringView data = webServer.getData(etag);
+		snprintf_P(headers, sizeof(headers), PSTR("ETag: %s\r\n"), etag);
+		if (request.ifNoneMatch != NULL && HttpParser::equals(request.ifNoneMatch, request.ifNoneMatchLength, etag)) {
+			send(connection, 304, request.keepAlive, headers, NULL, 0);
+		} else {
+			send(connection, 200, request.keepAlive, headers, data.data(), data.size());
+		}
+	} else if (priority) {
+		char response[24];
+		uint16_t maxCurrent = inverter.isPowerOverride() ? 0xffff : inverter.getMaximumSolarCurrent();
+		size_t length = snprintf_P(response, sizeof(response), PSTR("{\"maxCurrent\": %u}"), maxCurrent);
+		send(connection, 200, request.keepAlive, NULL, response, length);
+	} else {
+		send(connection, 404, request.keepAlive, NULL, NULL, 0);
+	}
+	return request.keepAlive;
+}
+
+/**
+ * Send a response with optional additional header lines. Header and body are sent in one
+ * segment if a buffer of the pool is available, otherwise separately.
+ */
+void ApiServer::send(Connection &connection, int code, bool keepAlive, const char *headers, const char *body, size_t length) {
+	PooledBuffer pooled;
+	char header[API_HEADER_SIZE];
+	char *response = (pooled ? pooled.data() : header);
+	size_t size = (pooled ? pooled.size() : sizeof(header));
+
+	size_t headerLength = snprintf_P(response, size, PSTR("HTTP/1.1 %d %S\r\nContent-Type: %S\r\nContent-Length: %u\r\n"
+			"Cache-Control: no-cache\r\n"), code, getStatusText(code), JSON_CONTENT_TYPE, length);
+	if (headers != NULL) {
+		headerLength += snprintf_P(response + headerLength, size - headerLength, PSTR("%s"), headers);
+	}
+	if (keepAlive) {
+		headerLength += snprintf_P(response + headerLength, size - headerLength,
+				PSTR("Connection: keep-alive\r\nKeep-Alive: timeout=%u\r\n\r\n"), config->apiIdleTimeout);
+	} else {
+		headerLength += snprintf_P(response + headerLength, size - headerLength, PSTR("Connection: close\r\n\r\n"));
+	}
+
+	if (headerLength + length <= size) {
+		if (length > 0) {
+			memcpy(response + headerLength, body, length);
+		}
+		connection.client.write(response, headerLength + length);
+	} else {
+		connection.client.write(response, headerLength);
+		connection.client.write(body, length);
+	}
+}
+
+/**
+ * Close the connection and discard the pending data.
+ */
+void ApiServer::close(Connection &connection) {
+	connection.client.stop();
+	connection.length = 0;
+}
+
+const __FlashStringHelper *ApiServer::getStatusText(int code) {
+	switch (code) {
+	case 200:
+		return F("OK");
+	case 304:
+		return F("Not Modified");
+	case 400:
+		return F("Bad Request");
+	case 404:
+		return F("Not Found");
+	case 405:
+		return F("Method Not Allowed");
+	case 429:
+		return F("Too Many Requests");
+	case 431:
+		return F("Request Header Fields Too Large");
+	case 503:
+		return F("Service Unavailable");
+	}
+	return F("Error");
+}
+
+ApiServer apiServer;
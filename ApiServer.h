@@ -0,0 +1,56 @@
+/*
+ * ApiServer.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef APISERVER_H_
+#define APISERVER_H_
+
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include "Logger.h"
+#include "Config.h"
+#include "HttpParser.h"
+
+#define API_REQUEST_SIZE 512 // receive buffer per connection, the maximum size of a request header
+#define API_HEADER_SIZE 256 // size of a response header
+#define API_REQUESTS_PER_PASS 4 // maximum number of requests answered per loop(), the rest waits for the next one
+
+class ApiServer
+{
+public:
+    ApiServer();
+    virtual ~ApiServer();
+    void init();
+    void loop();
+
+private:
+    struct Connection
+    {
+        WiFiClient client;
+        char buffer[API_REQUEST_SIZE];
+        size_t length; // number of bytes in buffer
+        uint32_t lastActivity; // in ms
+    };
+
+    void applyLimit();
+    void accept(uint32_t now);
+    void service(Connection &connection, uint32_t now, uint8_t &requests);
+    bool process(Connection &connection, const HttpParser::Request &request);
+    void send(Connection &connection, int code, bool keepAlive, const char *headers, const char *body, size_t length);
+    void close(Connection &connection);
+    static const __FlashStringHelper *getStatusText(int code);
+
+    WiFiServer server;
+    bool started;
+    Connection connections[API_MAX_CONNECTIONS];
+    uint8_t next; // connection which is serviced first in the next pass
+    uint8_t maxConnections; // api.maxConnections the open connections were accepted with
+};
+
+extern ApiServer apiServer;
+
+#endif /* APISERVER_H_ */
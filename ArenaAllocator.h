@@ -0,0 +1,100 @@
+/*
+ * ArenaAllocator.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef ARENAALLOCATOR_H_
+#define ARENAALLOCATOR_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_HEADER ARENA_ALIGNMENT // the size of a block is stored in front of it
+
+/*
+ * Memory for a JsonDocument which is filled and cleared repeatedly (e.g. for every response),
+ * so it doesn't allocate from the heap: blocks are taken from a static area one after the
+ * other and the whole area is reused once all blocks are released (which JsonDocument::clear()
+ * does). Only if the area is too small, the heap is used as fallback.
+ */
+template<size_t SIZE>
+class ArenaAllocator : public ArduinoJson::Allocator
+{
+public:
+    ArenaAllocator() : used(0), blocks(0), fallbacks(0) {
+    }
+
+    void *allocate(size_t size) override {
+        size_t required = ARENA_HEADER + align(size);
+        if (required > SIZE - used) {
+            fallbacks++;
+            return malloc(size);
+        }
+        uint8_t *block = storage + used;
+        *(size_t *) block = size;
+        used += required;
+        blocks++;
+        return block + ARENA_HEADER;
+    }
+
+    void deallocate(void *pointer) override {
+        if (!contains(pointer)) {
+            free(pointer);
+        } else if (--blocks == 0) {
+            used = 0;
+        }
+    }
+
+    void *reallocate(void *pointer, size_t size) override {
+        if (pointer == NULL) {
+            return allocate(size);
+        }
+        if (!contains(pointer)) {
+            return realloc(pointer, size);
+        }
+
+        uint8_t *block = (uint8_t *) pointer - ARENA_HEADER;
+        size_t oldSize = *(size_t *) block;
+        size_t offset = block - storage;
+        if (offset + ARENA_HEADER + align(oldSize) == used && offset + ARENA_HEADER + align(size) <= SIZE) {
+            used = offset + ARENA_HEADER + align(size); // the last block grows or shrinks in place
+            *(size_t *) block = size;
+            return pointer;
+        }
+        if (size <= oldSize) {
+            return pointer;
+        }
+        void *moved = allocate(size);
+        if (moved != NULL) {
+            memcpy(moved, pointer, oldSize);
+            deallocate(pointer);
+        }
+        return moved;
+    }
+
+    /**
+     * Return how often the heap had to be used because the area was full.
+     */
+    uint32_t getFallbacks() {
+        return fallbacks;
+    }
+
+private:
+    static size_t align(size_t size) {
+        return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    }
+
+    bool contains(void *pointer) {
+        return (uint8_t *) pointer >= storage && (uint8_t *) pointer < storage + SIZE;
+    }
+
+    alignas(ARENA_ALIGNMENT) uint8_t storage[SIZE];
+    size_t used; // in bytes
+    uint16_t blocks; // number of allocated blocks
+    uint32_t fallbacks;
+};
+
+#endif /* ARENAALLOCATOR_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "Battery.h"
+#include "Profiler.h"
 
 /**
  * Constructor
@@ -14,7 +15,6 @@ Battery::Battery() {
 	timestamp = 0;
 	restTimestamp = 0;
 	soc = 0;
-	ampereMilliseconds = 0;
 	ampereHours = 0;
 	current = 0;
 	voltage = 0;
@@ -39,65 +39,56 @@ void Battery::init() {
  * the main loop
  */
 void Battery::loop() {
+	PROFILE(BATTERY_LOOP);
 	updateSoc();
 	checkBatteryResting();
 }
 
 /**
- * Calculate the state of charge based on current and elapsed time since last measurement.
- * The calculation is done in an Ampere-miliseconds buffer and moved over from there to the Ah counter
- * (which counts in 0.1Ah)
- *
- * 1Ah = 60Am = 3600As = 3600000Ams
+ * Calculate the state of charge based on current and elapsed time since last measurement
+ * fused with the battery voltage (see SocEstimator). Instead of hard resets, a detected
+ * full or empty battery is fed to the estimator as a measurement.
  */
 void Battery::updateSoc() {
-	ampereMilliseconds += current * (millis() - timestamp);
+	socEstimator.predict(current, millis() - timestamp);
 	timestamp = millis();
 
-	if (ampereMilliseconds > 360000) {
-		if (ampereHours < config.batteryCapacity * 10) {
-			ampereHours++;
-		}
-		ampereMilliseconds -= 360000;
-	} else if (ampereMilliseconds < -3600000) {
-		if (ampereHours > 0) {
-			ampereHours--;
+	if (voltage > 0) { // only with valid data from the inverter
+		if (isFullyCharged()) {
+			socEstimator.calibrate(1000);
+		} else if (isEmpty()) {
+			socEstimator.calibrate(0);
+		} else {
+			socEstimator.correct(voltage, current);
 		}
-		ampereMilliseconds += 360000;
 	}
 
-	if (isEmpty()) {
-		ampereHours = 0;
-	}
-	if (isFullyCharged()) {
-		ampereHours = config.batteryCapacity * 10;
-	}
-
-	if (config.batterySocCalculateInternally) {
-		soc = ampereHours * 100 / config.batteryCapacity;
+	if (config->batterySocCalculateInternally) {
+		soc = socEstimator.getSOC();
 	}
+	ampereHours = (uint32_t) soc * config->batteryCapacity / 100;
 }
 
 void Battery::checkBatteryResting() {
-	if (current <= config.batteryRestCurrent * -1) {
+	if (current <= config->batteryRestCurrent * -1) {
 		restTimestamp = millis(); // we're not resting, update the timestamp
 	}
 }
 
 bool Battery::isFullyCharged() {
-	return voltage >= config.batteryVoltageFullCharge && current < config.batteryRestCurrent;
+	return voltage >= config->batteryVoltageFullCharge && current < config->batteryRestCurrent;
 }
 
 bool Battery::isEmpty() {
-	return voltage <= config.batteryVoltageEmpty
-			&& (restTimestamp + config.batteryRestDuration * 1000) < millis();
+	return voltage <= config->batteryVoltageEmpty
+			&& (restTimestamp + config->batteryRestDuration * 1000) < millis();
 }
 
 /**
  * Set the current state of charge in 0.1% (if we don't calc it by ourselves)
  */
 void Battery::setSOC(uint16_t soc) {
-	if (!config.batterySocCalculateInternally) {
+	if (!config->batterySocCalculateInternally) {
 		this->soc = soc;
 	}
 }
@@ -116,6 +107,20 @@ uint16_t Battery::getAmpereHours() {
 	return ampereHours;
 }
 
+/**
+ * Return the standard deviation of the estimated state of charge (in 0.1%)
+ */
+uint16_t Battery::getSocUncertainty() {
+	return socEstimator.getUncertainty();
+}
+
+/**
+ * Return the estimated internal resistance of the battery (in mOhm)
+ */
+uint16_t Battery::getResistance() {
+	return socEstimator.getResistance();
+}
+
 void Battery::setCurrent(int16_t current) {
 	this->current = current;
 }
@@ -11,6 +11,7 @@
 #include <Arduino.h>
 #include "Logger.h"
 #include "Config.h"
+#include "SocEstimator.h"
 
 class Battery {
 public:
@@ -24,6 +25,8 @@ public:
 	void setSOC(uint16_t soc);
 	uint16_t getSOC();
 	uint16_t getAmpereHours();
+	uint16_t getSocUncertainty();
+	uint16_t getResistance();
 	void setCurrent(int16_t current);
 	int16_t getCurrent();
 	void setVoltage(float voltage);
@@ -32,14 +35,16 @@ public:
 	void setVoltageSCC(float voltageSCC);
 	float getVoltageSCC();
 private:
+	friend class Benchmark;
+
 	uint32_t timestamp;
 	uint32_t restTimestamp;
 	uint16_t soc; // in 0.1%
-	int32_t ampereMilliseconds;
 	uint16_t ampereHours; // in 0.1Ah
 	int16_t current; // in A
 	float voltage; // in V
 	float voltageSCC; // in V
+	SocEstimator socEstimator;
 
 	void checkBatteryResting();
 	void updateSoc();
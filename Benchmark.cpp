@@ -0,0 +1,188 @@
+/*
+ * Benchmark.cpp
+ *
+ * Micro-benchmarks of the code which runs for every sample (CRC check, parsing the responses,
+ * power controller, state of charge, JSON generation), fed with captured inverter responses
+ * (see CapturedFrames.h). They are only compiled if DEBUG_BENCH is defined (see Config.h)
+ * and run on a GET of /debug/bench.
+ *
+ * Each benchmark is repeated with doubling iterations until it runs for at least
+ * BENCH_MIN_TIME, then BENCH_REPETITIONS times with these iterations. The result is the
+ * fastest average time per iteration, it's the least disturbed by interrupts (e.g. WiFi). The output uses the field
+ * names of Google Benchmark (name, iterations, real_time, time_unit), so results of the
+ * device and of the host build (see tools/bench) can be stored and compared with
+ * tools/bench/benchcompare.py.
+ *
+ * If the allocations are counted (DEBUG_ALLOC, see HeapMonitor.cpp), the heap allocations of
+ * one call after the measurement are reported per benchmark, together with the number of
+ * times the JSON document of toJSON() didn't fit into its arena. Both must be 0, the sample
+ * and request paths must not use the heap (benchcompare.py fails otherwise).
+ *
+ * The benchmarks work on separate Inverter and Battery instances, so the controller and
+ * state of charge of the running system are not affected. Parsing a status response also
+ * sets the values of the global battery, they're restored afterwards. While the benchmarks
+ * run (about a second), the inverter isn't polled and one response might time out.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Benchmark.h"
+#include "Inverter.h"
+#include "Battery.h"
+#include "CRCUtil.h"
+#include "CapturedFrames.h"
+#include "BufferPool.h"
+#include "WebServer.h"
+#include "HeapMonitor.h"
+#include <new>
+
+#ifdef DEBUG_BENCH
+static Inverter *subject;
+static Battery *batterySubject;
+static char frame[INPUT_BUFFER_SIZE + 1];
+static char *output; // buffer for the JSON of toJSON(), from the pool
+static char etag[DATA_ETAG_SIZE];
+static volatile uint32_t sink; // keeps the compiler from removing the calls
+#endif
+
+/**
+ * Run all benchmarks and return the results as JSON.
+ */
+String Benchmark::run() {
+	JsonDocument doc;
+
+#ifdef DEBUG_BENCH
+	PooledBuffer buffer;
+	subject = new (std::nothrow) Inverter();
+	batterySubject = new (std::nothrow) Battery();
+	if (!buffer || subject == NULL || batterySubject == NULL) {
+		delete subject;
+		delete batterySubject;
+		return F("{\"error\":\"not enough memory\"}");
+	}
+	output = buffer.data();
+
+	float voltage = battery.getVoltage();
+	float voltageSCC = battery.getVoltageSCC();
+	int16_t current = battery.getCurrent();
+	uint16_t soc = battery.getSOC();
+
+	strcpy(frame, FRAME_MODE);
+	subject->parseModeResponse(frame);
+	strcpy(frame, FRAME_WARNING);
+	subject->parseWarningResponse(frame);
+	strcpy(frame, FRAME_STATUS);
+	subject->parseStatusResponse(frame);
+	batterySubject->init();
+	batterySubject->setVoltage(battery.getVoltage());
+	batterySubject->setCurrent(battery.getCurrent());
+
+	doc[F("enabled")] = true;
+	JsonObject context = doc[F("context")].to<JsonObject>();
+	context[F("target")] = F("esp8266");
+	context[F("cpuMHz")] = ESP.getCpuFreqMHz();
+	context[F("sdk")] = ESP.getSdkVersion();
+	countAllocations = heapMonitor.isCounting();
+	JsonArray results = doc[F("benchmarks")].to<JsonArray>();
+
+	measure(results, F("CRCUtil::calcCRC"), []() {
+		sink += CRCUtil::calcCRC(FRAME_STATUS, sizeof(FRAME_STATUS) - 3);
+	});
+	measure(results, F("CRCUtil::checkCRC"), []() {
+		sink += CRCUtil::checkCRC(FRAME_STATUS, sizeof(FRAME_STATUS) - 1);
+	});
+	measure(results, F("Inverter::parseStatusResponse"), []() {
+		memcpy(frame, FRAME_STATUS, sizeof(FRAME_STATUS)); // strtok modifies the input
+		subject->parseStatusResponse(frame);
+	});
+	measure(results, F("Inverter::parseWarningResponse"), []() {
+		memcpy(frame, FRAME_WARNING, sizeof(FRAME_WARNING));
+		subject->parseWarningResponse(frame);
+	});
+	measure(results, F("Inverter::evalWarning"), []() {
+		JsonArray array = subject->jsonDoc.to<JsonArray>();
+		subject->evalWarning(array);
+		subject->jsonDoc.clear();
+	});
+	measure(results, F("Inverter::toJSON"), []() {
+		sink += subject->toJSON(output, TEXT_BUFFER_SIZE);
+	});
+	measure(results, F("WebServer::getData"), []() {
+		sink += webServer.getData(etag).size();
+	});
+	measure(results, F("Inverter::calculateMaximumSolarPower"), []() {
+		subject->calculateMaximumSolarPower();
+	});
+	measure(results, F("Battery::updateSoc"), []() {
+		batterySubject->updateSoc();
+	});
+	if (countAllocations) {
+		context[F("jsonFallbacks")] = subject->getJsonFallbacks() + inverter.getJsonFallbacks();
+	}
+
+	delete subject;
+	delete batterySubject;
+	battery.setVoltage(voltage);
+	battery.setVoltageSCC(voltageSCC);
+	battery.setCurrent(current);
+	battery.setSOC(soc);
+#else
+	doc[F("enabled")] = false;
+#endif
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
+
+/**
+ * Call the function with doubling iterations until it takes at least BENCH_MIN_TIME, repeat
+ * it with these iterations and add the fastest average time per iteration (in ns) to the results.
+ */
+void Benchmark::measure(JsonArray &results, const __FlashStringHelper *name, Function function) {
+#ifdef DEBUG_BENCH
+	uint32_t minCycles = BENCH_MIN_TIME * 1000UL * ESP.getCpuFreqMHz();
+	uint32_t iterations = 1;
+	uint32_t cycles;
+
+	while ((cycles = repeat(function, iterations)) < minCycles && iterations < BENCH_MAX_ITERATIONS) {
+		iterations *= 2;
+	}
+	for (uint8_t i = 1; i < BENCH_REPETITIONS; i++) {
+		cycles = min(cycles, repeat(function, iterations));
+	}
+
+	uint32_t allocations = heapMonitor.getAllocations();
+	function();
+	allocations = heapMonitor.getAllocations() - allocations;
+
+	JsonObject node = results.add<JsonObject>();
+	node[F("name")] = name;
+	node[F("iterations")] = iterations;
+	node[F("real_time")] = (float) cycles * 1000 / ESP.getCpuFreqMHz() / iterations;
+	node[F("time_unit")] = F("ns");
+	if (countAllocations) {
+		node[F("allocations")] = allocations;
+	}
+#else
+	(void) results;
+	(void) name;
+	(void) function;
+#endif
+}
+
+/**
+ * Call the function the given number of times and return the duration in cpu cycles.
+ */
+uint32_t Benchmark::repeat(Function function, uint32_t iterations) {
+	uint32_t start = ESP.getCycleCount();
+	for (uint32_t i = 0; i < iterations; i++) {
+		function();
+	}
+	uint32_t cycles = ESP.getCycleCount() - start;
+	yield();
+	return cycles;
+}
+
+Benchmark benchmark;
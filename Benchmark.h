@@ -0,0 +1,35 @@
+/*
+ * Benchmark.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Config.h"
+
+#define BENCH_MIN_TIME 20 // minimum duration of the measured iterations of a benchmark (in ms)
+#define BENCH_MAX_ITERATIONS 65536 // stop doubling the iterations here, even if BENCH_MIN_TIME isn't reached
+#define BENCH_REPETITIONS 3 // number of measurements of which the fastest is reported
+
+class Benchmark
+{
+public:
+    String run();
+
+private:
+    typedef void (*Function)();
+
+    void measure(JsonArray &results, const __FlashStringHelper *name, Function function);
+    uint32_t repeat(Function function, uint32_t iterations);
+
+    bool countAllocations; // the allocations are counted (DEBUG_ALLOC)
+};
+
+extern Benchmark benchmark;
+
+#endif /* BENCHMARK_H_ */
@@ -0,0 +1,91 @@
+/*
+ * BufferPool.cpp
+ *
+ * A fixed number of preallocated text buffers for building responses and payloads. Long
+ * running code must not use String or other heap allocations in paths which run for every
+ * sample or request, as the heap fragments over time. The buffers are reserved at startup
+ * instead, if all are in use acquire() fails and the caller has to reject the request.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "BufferPool.h"
+
+/**
+ * Constructor
+ */
+BufferPool::BufferPool() {
+	used = 0;
+	exhausted = 0;
+}
+
+/**
+ * Get a free buffer of TEXT_BUFFER_SIZE bytes, NULL if all are in use.
+ */
+char *BufferPool::acquire() {
+	for (uint8_t i = 0; i < TEXT_BUFFER_COUNT; i++) {
+		if (!(used & (1 << i))) {
+			used |= (1 << i);
+			buffers[i][0] = 0;
+			return buffers[i];
+		}
+	}
+	exhausted++;
+	return NULL;
+}
+
+/**
+ * Return a buffer to the pool.
+ */
+void BufferPool::release(char *buffer) {
+	for (uint8_t i = 0; i < TEXT_BUFFER_COUNT; i++) {
+		if (buffer == buffers[i]) {
+			used &= ~(1 << i);
+		}
+	}
+}
+
+/**
+ * Return the number of free buffers.
+ */
+uint8_t BufferPool::getAvailable() {
+	uint8_t available = 0;
+	for (uint8_t i = 0; i < TEXT_BUFFER_COUNT; i++) {
+		if (!(used & (1 << i))) {
+			available++;
+		}
+	}
+	return available;
+}
+
+/**
+ * Return how often no buffer was available.
+ */
+uint32_t BufferPool::getExhausted() {
+	return exhausted;
+}
+
+PooledBuffer::PooledBuffer() {
+	buffer = bufferPool.acquire();
+}
+
+PooledBuffer::~PooledBuffer() {
+	if (buffer) {
+		bufferPool.release(buffer);
+	}
+}
+
+char *PooledBuffer::data() {
+	return buffer;
+}
+
+size_t PooledBuffer::size() {
+	return buffer ? TEXT_BUFFER_SIZE : 0;
+}
+
+PooledBuffer::operator bool() const {
+	return buffer != NULL;
+}
+
+BufferPool bufferPool;
@@ -0,0 +1,60 @@
+/*
+ * BufferPool.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef BUFFERPOOL_H_
+#define BUFFERPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TEXT_BUFFER_COUNT 2 // number of buffers, i.e. responses which can be built at the same time
+#define TEXT_BUFFER_SIZE 1536 // size of a buffer, large enough for the /data response
+
+/*
+ * Static text buffers for the responses, built on the host by tools/alloctest as well.
+ */
+class BufferPool
+{
+public:
+    BufferPool();
+    char *acquire();
+    void release(char *buffer);
+    uint8_t getAvailable();
+    uint32_t getExhausted();
+
+private:
+    char buffers[TEXT_BUFFER_COUNT][TEXT_BUFFER_SIZE];
+    uint8_t used; // bit mask of the buffers in use
+    uint32_t exhausted; // number of failed acquire() calls
+};
+
+/*
+ * A buffer of the pool which is released when it goes out of scope, e.g.
+ *
+ *   PooledBuffer buffer;
+ *   if (buffer) {
+ *       size_t length = snprintf(buffer.data(), buffer.size(), ...);
+ */
+class PooledBuffer
+{
+public:
+    PooledBuffer();
+    ~PooledBuffer();
+    char *data();
+    size_t size();
+    explicit operator bool() const;
+
+private:
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    char *buffer;
+};
+
+extern BufferPool bufferPool;
+
+#endif /* BUFFERPOOL_H_ */
@@ -1,13 +1,16 @@
 /*
  * CRCUtil.cpp
  *
+ * The CRC-16/XMODEM variant of the inverter protocol. It works on plain character buffers,
+ * so responses and commands are checked and built without String copies.
+ *
  *  Created on: 31 Jul 2019
  *      Author: Michael Neuweiler
  */
 
 #include "CRCUtil.h"
 
-char16_t CRCUtil::crc_tb[] = { 0, 4129, 8258, 12387, 16516, 20645, 24774, 28903, 33032, 37161, 41290, 45419, 49548, 53677, 57806, 61935, 4657, 528,
+const uint16_t CRCUtil::crc_tb[] = { 0, 4129, 8258, 12387, 16516, 20645, 24774, 28903, 33032, 37161, 41290, 45419, 49548, 53677, 57806, 61935, 4657, 528,
         12915, 8786, 21173, 17044, 29431, 25302, 37689, 33560, 45947, 41818, 54205, 50076, 62463, 58334, 9314, 13379, 1056, 5121, 25830, 29895, 17572,
         21637, 42346, 46411, 34088, 38153, 58862, 62927, 50604, 54669, 13907, 9842, 5649, 1584, 30423, 26358, 22165, 18100, 46939, 42874, 38681,
         34616, 63455, 59390, 55197, 51132, 18628, 22757, 26758, 30887, 2112, 6241, 10242, 14371, 51660, 55789, 59790, 63919, 35144, 39273, 43274,
@@ -20,84 +23,51 @@ char16_t CRCUtil::crc_tb[] = { 0, 4129, 8258, 12387, 16516, 20645, 24774, 28903,
         30726, 26663, 6336, 2273, 14466, 10403, 52093, 56156, 60223, 64286, 35833, 39896, 43963, 48026, 19061, 23124, 27191, 31254, 2801, 6864, 10931,
         14994, 64814, 60687, 56684, 52557, 48554, 44427, 40424, 36297, 31782, 27655, 23652, 19525, 15522, 11395, 7392, 3265, 61215, 65342, 53085,
         57212, 44955, 49082, 36825, 40952, 28183, 32310, 20053, 24180, 11923, 16050, 3793, 7920 };
-byte CRCUtil::byteBuf[] = { 0, 0, 0 };
-
-CRCUtil::CRCUtil()
-{
-
-}
 
-bool CRCUtil::checkCRC(String data)
+/**
+ * Check if the last two bytes of the data are the CRC of the preceding bytes.
+ */
+bool CRCUtil::checkCRC(const char *data, size_t length)
 {
-	if (data.length() < 3) {
+	if (length < 3) {
 		return false;
 	}
-    String firstValue = data.substring(0, data.length() - 2);
-    String lastValue = data.substring(data.length() - 2);
-
-    int crcCalculated = calcCRC(firstValue);
-    int crcReceived = strtol(toHexString(lastValue).c_str(), NULL, 16);
-
-    return (crcReceived == crcCalculated);
-}
-
-byte* CRCUtil::getCRCByte(String data)
-{
-    int crcint = calcCRC(data);
-    int crclow = crcint & 255;
-    int crchigh = crcint >> 8 & 255;
-    byteBuf[0] = crchigh;
-    byteBuf[1] = crclow;
-    return byteBuf;
+	uint16_t crc = calcCRC(data, length - 2);
+	return (uint8_t) data[length - 2] == (crc >> 8) && (uint8_t) data[length - 1] == (crc & 0xff);
 }
 
-String CRCUtil::getCRC(String data)
-{
-    byte *b = getCRCByte(data);
-    b[3] = 0;
-    return String(reinterpret_cast<const char*>(b));
-}
-
-String CRCUtil::toHexString(String data)
+/**
+ * Append the CRC of the data (two bytes, high byte first), the buffer must have room for it.
+ * Returns the new length.
+ */
+size_t CRCUtil::appendCRC(char *data, size_t length)
 {
-    String str = "";
-    for (unsigned int i = 0; i < data.length(); ++i) {
-        short ch = (short) data.charAt(i);
-        if (ch < 0) {
-            ch = (short) (ch + 256);
-        }
-        String s4 = String(ch, HEX);
-        if (s4.length() < 2) {
-            s4 = "0" + s4;
-        }
-        str += s4;
-    }
-    return str;
+	uint16_t crc = calcCRC(data, length);
+	data[length++] = crc >> 8;
+	data[length++] = crc & 0xff;
+	return length;
 }
 
-int CRCUtil::calcCRC(String data)
+/**
+ * Calculate the CRC, bytes which would be mistaken as frame delimiters ('(', CR, LF) are incremented.
+ */
+uint16_t CRCUtil::calcCRC(const char *data, size_t length)
 {
-    int len = data.length();
-    int i = 0;
-    int crc = 0;
-
-    while (len-- != 0) {
-        int da = 255 & (255 & crc >> 8) >> 4;
-        crc <<= 4;
-        da = 255 & (255 & (crc ^= crc_tb[255 & (da ^ data.charAt(i) >> 4)]) >> 8) >> 4;
-        crc <<= 4;
-        int temp = 255 & (da ^ (data.charAt(i) & 15));
-        crc ^= crc_tb[temp];
-        ++i;
-    }
+	uint16_t crc = 0;
 
-    int bCRCLow = 255 & crc;
-    int bCRCHign = 255 & crc >> 8;
-    if (bCRCLow == 40 || bCRCLow == 13 || bCRCLow == 10)
-        ++bCRCLow;
-    if (bCRCHign == 40 || bCRCHign == 13 || bCRCHign == 10)
-        ++bCRCHign;
-    crc = (255 & bCRCHign) << 8;
+	for (size_t i = 0; i < length; i++) {
+		uint8_t value = data[i];
+		crc = (crc << 4) ^ crc_tb[(crc >> 12) ^ (value >> 4)];
+		crc = (crc << 4) ^ crc_tb[(crc >> 12) ^ (value & 0x0f)];
+	}
 
-    return crc += bCRCLow;
+	uint8_t low = crc & 0xff;
+	uint8_t high = crc >> 8;
+	if (low == '(' || low == '\r' || low == '\n') {
+		low++;
+	}
+	if (high == '(' || high == '\r' || high == '\n') {
+		high++;
+	}
+	return (high << 8) | low;
 }
@@ -8,23 +8,21 @@
 #ifndef CRCUTIL_H_
 #define CRCUTIL_H_
 
-#include <Arduino.h>
-#include <string>
+#include <stdint.h>
+#include <stddef.h>
 
+/*
+ * CRC of the inverter frames, tools/alloctest and tools/bench compile it on the host.
+ */
 class CRCUtil
 {
 public:
-    CRCUtil();
-
-    static byte *getCRCByte(String command);
-    static String getCRC(String command);
-    static bool checkCRC(String resultValue);
-    static String toHexString(String s);
-    static int calcCRC(String pByte);
+    static bool checkCRC(const char *data, size_t length);
+    static size_t appendCRC(char *data, size_t length);
+    static uint16_t calcCRC(const char *data, size_t length);
 
 private:
-    static char16_t crc_tb[];
-    static byte byteBuf[];
+    static const uint16_t crc_tb[];
 };
 
 #endif /* CRCUTIL_H_ */
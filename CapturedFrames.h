@@ -0,0 +1,24 @@
+/*
+ * CapturedFrames.h
+ *
+ * Responses captured from an inverter, including their CRC but without the trailing CR.
+ * They are the input of the benchmarks on the device (see Benchmark) and on the host
+ * (see tools/bench), so the results of both are based on the same data.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef CAPTUREDFRAMES_H_
+#define CAPTUREDFRAMES_H_
+
+// QPIGS: grid 228.5V, out 1760W, bus 380V, battery 26.80V / 3A charging, PV 228.5V / 2050W
+#define FRAME_STATUS "(228.5 50.0 229.9 50.0 1760 1720 035 380 26.80 003 085 0039 07.8 228.5 26.90 00000 00010110 00 00 02050 010-F"
+
+// QPIWS: grid fail and power limit
+#define FRAME_WARNING "(0000010000000000000000000100000000Y\xE1"
+
+// QMOD: battery mode
+#define FRAME_MODE "(B\xE7\xC9"
+
+#endif /* CAPTUREDFRAMES_H_ */
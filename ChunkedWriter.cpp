@@ -0,0 +1,109 @@
+/*
+ * ChunkedWriter.cpp
+ *
+ * Sends a response of unknown length with chunked transfer encoding. The content is
+ * formatted into a buffer of the pool which is sent as a chunk whenever it's full, so the
+ * memory used is constant, regardless of how large the response gets.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "ChunkedWriter.h"
+
+/**
+ * Constructor
+ */
+ChunkedWriter::ChunkedWriter(ESP8266WebServer &server) : server(server) {
+	length = 0;
+	started = false;
+}
+
+ChunkedWriter::~ChunkedWriter() {
+	end();
+}
+
+/**
+ * Send the status and the headers (contentType has to be in PROGMEM). Returns false if no
+ * buffer is available, in that case nothing is sent and the caller has to reply otherwise.
+ */
+bool ChunkedWriter::begin(int code, const char *contentType) {
+	if (!buffer) {
+		return false;
+	}
+	server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	server.send(code, FPSTR(contentType), "");
+	started = true;
+	return true;
+}
+
+/**
+ * Append formatted text (the format has to be in PROGMEM, e.g. PSTR()).
+ */
+void ChunkedWriter::printf(const char *format, ...) {
+	if (!started) {
+		return;
+	}
+
+	va_list args;
+	for (uint8_t attempt = 0; attempt < 2; attempt++) {
+		va_start(args, format);
+		size_t written = vsnprintf_P(buffer.data() + length, buffer.size() - length, format, args);
+		va_end(args);
+		if (length + written < buffer.size()) {
+			length += written;
+			return;
+		}
+		flush(); // didn't fit, send what we have and try again with the empty buffer
+	}
+	length = buffer.size() - 1; // longer than the whole buffer, send it truncated
+}
+
+/**
+ * Append text from RAM with the characters escaped which have a meaning in HTML or a JSON string.
+ */
+void ChunkedWriter::print(const char *text, Escape escape) {
+	if (!started) {
+		return;
+	}
+
+	for (; *text; text++) {
+		char c = *text;
+		if (escape == ESCAPE_HTML && (c == '<' || c == '>' || c == '&' || c == '\'' || c == '"')) {
+			printf(PSTR("&#%d;"), c);
+		} else if (escape == ESCAPE_JSON && (c == '"' || c == '\\')) {
+			append('\\');
+			append(c);
+		} else if (escape == ESCAPE_JSON && (uint8_t) c < 0x20) {
+			printf(PSTR("\\u%04x"), c);
+		} else {
+			append(c);
+		}
+	}
+}
+
+/**
+ * Send the remaining content and terminate the response.
+ */
+void ChunkedWriter::end() {
+	if (!started) {
+		return;
+	}
+	flush();
+	server.sendContent("");
+	started = false;
+}
+
+void ChunkedWriter::append(char c) {
+	if (length + 1 >= buffer.size()) {
+		flush();
+	}
+	buffer.data()[length++] = c;
+}
+
+void ChunkedWriter::flush() {
+	if (length > 0) {
+		server.sendContent(buffer.data(), length);
+		length = 0;
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * ChunkedWriter.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef CHUNKEDWRITER_H_
+#define CHUNKEDWRITER_H_
+
+#include <ESP8266WebServer.h>
+#include "BufferPool.h"
+
+class ChunkedWriter
+{
+public:
+    enum Escape
+    {
+        ESCAPE_HTML,
+        ESCAPE_JSON
+    };
+
+    ChunkedWriter(ESP8266WebServer &server);
+    ~ChunkedWriter();
+    bool begin(int code, const char *contentType);
+    void printf(const char *format, ...);
+    void print(const char *text, Escape escape);
+    void end();
+
+private:
+    void append(char c);
+    void flush();
+
+    ESP8266WebServer &server;
+    PooledBuffer buffer;
+    size_t length; // number of bytes in the buffer
+    bool started;
+};
+
+#endif /* CHUNKEDWRITER_H_ */
@@ -1,72 +1,561 @@
 /*
  * Config.cpp
  *
+ * The configuration is parsed from config.json into a fixed size snapshot (Config::Data). A new
+ * configuration is parsed and validated in the second snapshot and activated by switching the
+ * pointer, so readers never see a partially updated or invalid configuration. The JsonDocument
+ * is only needed while parsing.
+ *
+ * Partial updates (e.g. PATCH /config) are applied the same way on top of a copy of the current
+ * configuration. They're written to the file after a delay, so a series of changes causes
+ * only one write to flash.
+ *
  *  Created on: 3 Sep 2019
  *      Author: Michael Neuweiler
  */
 
+#include <IPAddress.h>
 #include "Config.h"
 
+#define CONFIG_SAVE_DELAY 10000 // time after the last change until the configuration is written to flash (in ms)
+
 const char *Config::CONFIG_FILE = "/config.json";
+const char *Config::CONFIG_FILE_TEMP = "/config.json.tmp";
 
 void Config::init()
 {
+	setDefaults(snapshots[0]);
+	current = &snapshots[0];
+	error[0] = 0;
+	changeTime = 0;
+	modified = false;
+	prepared = false;
+
 	LittleFS.begin();
-    load();
+	load();
+}
+
+/**
+ * Load the configuration file. If it can't be read or contains invalid values,
+ * the current configuration is kept.
+ */
+bool Config::load(const char *fileName) {
+	if (!prepare(fileName)) {
+		return false;
+	}
+	activate();
+	return true;
 }
 
-void Config::load() {
-    File file = LittleFS.open(CONFIG_FILE, "r");
-    if (!file) {
-        logger.error(F("Failed to open %s"), CONFIG_FILE);
-    }
+/**
+ * Parse and validate a configuration file into the next snapshot without applying it,
+ * activate() switches to it. Used to check an uploaded file before it replaces config.json.
+ */
+bool Config::prepare(const char *fileName) {
+	prepared = false;
+	File file = LittleFS.open(fileName, "r");
+	if (!file) {
+		LOG_ERROR("Failed to open %s", fileName);
+		return false;
+	}
 
-    doc.clear();
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
+	JsonDocument doc;
+	DeserializationError error = deserializeJson(doc, file);
+	file.close();
 
 	if (error) {
-		logger.error(F("could not parse config: %s"), error.f_str());
+		LOG_ERROR("could not parse config: %S", error.f_str());
+		return false;
+	}
+
+	Data *next = getNext();
+	setDefaults(*next);
+	if (!parse(doc.as<JsonVariantConst>(), *next) || !validate(*next)) {
+		LOG_ERROR("invalid config in %s, keeping the current one", fileName);
+		return false;
+	}
+	prepared = true;
+	return true;
+}
+
+/**
+ * Switch to the configuration read by prepare().
+ */
+void Config::activate() {
+	if (!prepared) {
 		return;
 	}
+	current = getNext();
+	modified = false;
+	prepared = false;
+}
+
+/**
+ * Write pending changes to the file once no further changes arrived for CONFIG_SAVE_DELAY.
+ */
+void Config::loop() {
+	if (modified && millis() - changeTime > CONFIG_SAVE_DELAY) {
+		modified = false;
+		save();
+	}
+}
+
+/**
+ * Apply the values present in the json document to the current configuration.
+ * If a key is unknown or a value is invalid, nothing is changed and getError() describes
+ * the problem.
+ */
+bool Config::update(JsonVariantConst values) {
+	if (!values.is<JsonObjectConst>()) {
+		snprintf_P(error, sizeof(error), PSTR("json object expected"));
+		return false;
+	}
+
+	Data *next = getNext();
+	prepared = false;
+	*next = *current;
+	bool fits = parse(values, *next);
+
+	// all keys with the parsed values, to detect typos and values parse() dropped (wrong type or out of range)
+	JsonDocument parsed;
+	write(parsed.to<JsonObject>(), *next, true);
+	char path[CONFIG_ERROR_SIZE] = "";
+	if (!checkKeys(values.as<JsonObjectConst>(), parsed.as<JsonObjectConst>(), path, 0)) {
+		return false;
+	}
+	if (!fits) {
+		snprintf_P(error, sizeof(error), PSTR("string too long"));
+		return false;
+	}
+	if (!validate(*next)) {
+		return false;
+	}
+	current = next;
+	modified = true;
+	changeTime = millis();
+	return true;
+}
+
+/**
+ * Return a description of the last validation error.
+ */
+const char *Config::getError() {
+	return error;
+}
+
+/**
+ * Write the current configuration (without passwords) as json.
+ */
+String Config::toJSON() {
+	JsonDocument doc;
+	String output;
+
+	JsonObject root = doc.to<JsonObject>();
+	write(root, *current, false);
+	serializeJson(doc, output);
+	return output;
+}
+
+/**
+ * Write the current configuration to the file. It's written to a temporary file first,
+ * so a power loss can't leave a truncated config behind.
+ */
+bool Config::save() {
+	JsonDocument doc;
+	JsonObject root = doc.to<JsonObject>();
+	write(root, *current, true);
+
+	File file = LittleFS.open(CONFIG_FILE_TEMP, "w");
+	if (!file) {
+		LOG_ERROR("Failed to open %s", CONFIG_FILE_TEMP);
+		return false;
+	}
+	size_t size = serializeJsonPretty(doc, file);
+	file.close();
+
+	if (size == 0 || !LittleFS.rename(CONFIG_FILE_TEMP, CONFIG_FILE)) {
+		LOG_ERROR("could not save config");
+		return false;
+	}
+	LOG_INFO("saved config (%u bytes)", size);
+	return true;
+}
+
+/**
+ * Return the snapshot which is not in use.
+ */
+Config::Data *Config::getNext() {
+	return (current == &snapshots[0] ? &snapshots[1] : &snapshots[0]);
+}
+
+void Config::setDefaults(Data &data) {
+	data.inverterInterval = 300;
+	data.initialSolarPower = 1000;
+	data.pvOutPowerTolerance = 100;
+	data.minSolarPower = 400;
+	data.maxSolarPower = 3000;
+	data.powerAdjustment = 25;
+	data.minPvVoltage = 320.0f;
+	data.maxPvVoltage = 325.0f;
+	data.maxBatteryDischargeCurrent = -4;
+	data.minBusVoltage = 390;
+	data.cutoffRetryTime = 300;
+	data.cutoffRetryMinBatterySoc = 50;
+	data.inputOverrideActivateSOC = 20;
+	data.inputOverrideDeactivateSOC = 50;
+	data.powerControllerMode = 0;
+	data.powerControllerKp = 40.0f;
+	data.powerControllerKi = 75.0f;
+	data.powerControllerBatteryWeight = 2.0f;
+	data.powerControllerRateLimit = 100;
+
+	data.batteryCapacity = 100;
+	data.batteryType = LiIon;
+	data.batteryVoltageFullCharge = 28.4f;
+	data.batteryVoltageNominal = 25.6f;
+	data.batteryVoltageEmpty = 21.6f;
+	data.batteryVoltageFloat = 24.5f;
+	data.batteryOverDischargeProtection = false;
+	data.batterySocCalculateInternally = true;
+	data.batteryRestDuration = 5;
+	data.batteryRestCurrent = 10;
+	data.batterySocTriggerFloatOverride = 0;
+
+	strcpy(data.wifiHostname, "solar");
+	data.wifiStationSsid[0] = 0;
+	data.wifiStationPassword[0] = 0;
+	data.wifiStationReconnectInterval = 15000;
+	strcpy(data.wifiApSsid, "solar");
+	strcpy(data.wifiApPassword, "inverter");
+	data.wifiApChannel = 13;
+	strcpy(data.wifiApAddress, "192.168.4.1");
+	strcpy(data.wifiApGateway, "192.168.4.1");
+	strcpy(data.wifiApNetmask, "255.255.255.0");
+	data.wifiApNAT = false;
+
+	data.consumerPushMode = 0;
+	data.consumerHost[0] = 0;
+	data.consumerPort = 80;
+	strcpy(data.consumerPath, "/maxCurrent");
+	data.consumerPushThreshold = 50;
+	data.consumerHeartbeatInterval = 10000;
+
+	data.telemetryMode = 0;
+	strcpy(data.telemetryAddress, "239.0.0.57");
+	data.telemetryPort = 5757;
+
+	data.mqttHost[0] = 0;
+	data.mqttPort = 1883;
+	data.mqttUser[0] = 0;
+	data.mqttPassword[0] = 0;
+	strcpy(data.mqttTopic, "solar");
+	data.mqttBatch = false;
+	data.mqttCommands = false;
+	data.mqttKeepAlive = 30;
+
+	data.modbusEnabled = false;
+	data.modbusPort = 502;
+	data.modbusWrite = false;
 
-    inverterInterval = doc[F("inverter")][F("interval")] | 300;
-    initialSolarPower = doc[F("inverter")][F("pv")][F("power")][F("initial")] | 1000;
-    pvOutPowerTolerance = doc[F("inverter")][F("pv")][F("power")][F("tolerance")] | 100;
-    minSolarPower = doc[F("inverter")][F("pv")][F("power")][F("min")] | 400;
-    maxSolarPower = doc[F("inverter")][F("pv")][F("power")][F("max")] | 3000;
-    powerAdjustment = doc[F("inverter")][F("pv")][F("power")][F("adjustmentStep")] | 25;
-    minPvVoltage = doc[F("inverter")][F("pv")][F("voltage")][F("min")] | 320.0f;
-    maxPvVoltage = doc[F("inverter")][F("pv")][F("voltage")][F("max")] | 325.0f;
-    maxBatteryDischargeCurrent = (doc[F("inverter")][F("battery")][F("dischargeCurrent")][F("max")] | 4) * -1;
-    minBusVoltage = doc[F("inverter")][F("bus")][F("voltage")][F("min")] | 390;
-    cutoffRetryTime = doc[F("inverter")][F("cutoffRetry")][F("time")] | 300;
-    inputOverrideActivateSOC = doc[F("inverter")][F("inputOverride")][F("activateSoc")] | 20;
-    inputOverrideDeactivateSOC = doc[F("inverter")][F("inputOverride")][F("deactivateSoc")] | 50;
-
-    batteryCapacity = doc[F("battery")][F("capacity")] | 100;
-    batteryType = doc[F("battery")][F("type")] | BatteryType::LiIon;
-    batteryVoltageFullCharge = doc[F("battery")][F("voltage")][F("full")] | 28.4f;
-    batteryVoltageNominal = doc[F("battery")][F("voltage")][F("nominal")] | 25.6f;
-    batteryVoltageEmpty = doc[F("battery")][F("voltage")][F("empty")] | 21.6f;
-    batteryVoltageFloat = doc[F("battery")][F("voltage")][F("float")] | 24.5f;
-    batteryOverDischargeProtection = doc[F("battery")][F("overDischargeProtection")] | false;
-    batterySocCalculateInternally = doc[F("battery")][F("soc")][F("calculateInternally")] | true;
-    batteryRestDuration = doc[F("battery")][F("soc")][F("restDuration")] | 5;
-    batteryRestCurrent = doc[F("battery")][F("soc")][F("restCurrent")] | 10;
-    batterySocTriggerFloatOverride = doc[F("battery")][F("soc")][F("triggerFloatOverride")] | 0;
-
-    wifiHostname = doc[F("wifi")][F("hostname")] | "solar";
-    wifiStationSsid = doc[F("wifi")][F("station")][F("ssid")] | "";
-    wifiStationPassword = doc[F("wifi")][F("station")][F("password")] | "";
-    wifiStationReconnectInterval = doc[F("wifi")][F("station")][F("reconnectInterval")] | 15000;
-    wifiApSsid = doc[F("wifi")][F("ap")][F("ssid")] | "solar";
-    wifiApPassword = doc[F("wifi")][F("ap")][F("password")] | "inverter";
-    wifiApChannel = doc[F("wifi")][F("ap")][F("channel")] | 13;
-    wifiApAddress = doc[F("wifi")][F("ap")][F("address")] | "192.168.4.1";
-    wifiApGateway = doc[F("wifi")][F("ap")][F("gateway")] | "192.168.4.1";
-    wifiApNetmask = doc[F("wifi")][F("ap")][F("netmask")] | "255.255.255.0";
-    wifiApNAT= doc[F("wifi")][F("ap")][F("NAT")] | false;
+	data.apiPort = 8080;
+	data.apiMaxConnections = 3;
+	data.apiIdleTimeout = 10;
+
+	data.httpRateLimit = 10;
+	data.httpBurst = 20;
+	data.httpBudget = 250;
+}
+
+/**
+ * Read the values present in the json document into data, missing values are left unchanged.
+ * Returns false if a string is too long.
+ */
+bool Config::parse(JsonVariantConst root, Data &data) {
+	bool valid = true;
+
+	data.inverterInterval = root[F("inverter")][F("interval")] | data.inverterInterval;
+	data.initialSolarPower = root[F("inverter")][F("pv")][F("power")][F("initial")] | data.initialSolarPower;
+	data.pvOutPowerTolerance = root[F("inverter")][F("pv")][F("power")][F("tolerance")] | data.pvOutPowerTolerance;
+	data.minSolarPower = root[F("inverter")][F("pv")][F("power")][F("min")] | data.minSolarPower;
+	data.maxSolarPower = root[F("inverter")][F("pv")][F("power")][F("max")] | data.maxSolarPower;
+	data.powerAdjustment = root[F("inverter")][F("pv")][F("power")][F("adjustmentStep")] | data.powerAdjustment;
+	data.minPvVoltage = root[F("inverter")][F("pv")][F("voltage")][F("min")] | data.minPvVoltage;
+	data.maxPvVoltage = root[F("inverter")][F("pv")][F("voltage")][F("max")] | data.maxPvVoltage;
+	data.maxBatteryDischargeCurrent = -(root[F("inverter")][F("battery")][F("dischargeCurrent")][F("max")] | -data.maxBatteryDischargeCurrent);
+	data.minBusVoltage = root[F("inverter")][F("bus")][F("voltage")][F("min")] | data.minBusVoltage;
+	data.cutoffRetryTime = root[F("inverter")][F("cutoffRetry")][F("time")] | data.cutoffRetryTime;
+	data.cutoffRetryMinBatterySoc = root[F("inverter")][F("cutoffRetry")][F("minBatterySoc")] | data.cutoffRetryMinBatterySoc;
+	data.inputOverrideActivateSOC = root[F("inverter")][F("inputOverride")][F("activateSoc")] | data.inputOverrideActivateSOC;
+	data.inputOverrideDeactivateSOC = root[F("inverter")][F("inputOverride")][F("deactivateSoc")] | data.inputOverrideDeactivateSOC;
+	data.powerControllerMode = root[F("inverter")][F("controller")][F("mode")] | data.powerControllerMode;
+	data.powerControllerKp = root[F("inverter")][F("controller")][F("kp")] | data.powerControllerKp;
+	data.powerControllerKi = root[F("inverter")][F("controller")][F("ki")] | data.powerControllerKi;
+	data.powerControllerBatteryWeight = root[F("inverter")][F("controller")][F("batteryWeight")] | data.powerControllerBatteryWeight;
+	data.powerControllerRateLimit = root[F("inverter")][F("controller")][F("rateLimit")] | data.powerControllerRateLimit;
+
+	data.batteryCapacity = root[F("battery")][F("capacity")] | data.batteryCapacity;
+	data.batteryType = (BatteryType) (root[F("battery")][F("type")] | (int) data.batteryType);
+	data.batteryVoltageFullCharge = root[F("battery")][F("voltage")][F("full")] | data.batteryVoltageFullCharge;
+	data.batteryVoltageNominal = root[F("battery")][F("voltage")][F("nominal")] | data.batteryVoltageNominal;
+	data.batteryVoltageEmpty = root[F("battery")][F("voltage")][F("empty")] | data.batteryVoltageEmpty;
+	data.batteryVoltageFloat = root[F("battery")][F("voltage")][F("float")] | data.batteryVoltageFloat;
+	data.batteryOverDischargeProtection = root[F("battery")][F("overDischargeProtection")] | data.batteryOverDischargeProtection;
+	data.batterySocCalculateInternally = root[F("battery")][F("soc")][F("calculateInternally")] | data.batterySocCalculateInternally;
+	data.batteryRestDuration = root[F("battery")][F("soc")][F("restDuration")] | data.batteryRestDuration;
+	data.batteryRestCurrent = root[F("battery")][F("soc")][F("restCurrent")] | data.batteryRestCurrent;
+	data.batterySocTriggerFloatOverride = root[F("battery")][F("soc")][F("triggerFloatOverride")] | data.batterySocTriggerFloatOverride;
+
+	valid &= copyString(root[F("wifi")][F("hostname")], data.wifiHostname, sizeof(data.wifiHostname));
+	valid &= copyString(root[F("wifi")][F("station")][F("ssid")], data.wifiStationSsid, sizeof(data.wifiStationSsid));
+	valid &= copyString(root[F("wifi")][F("station")][F("password")], data.wifiStationPassword, sizeof(data.wifiStationPassword));
+	data.wifiStationReconnectInterval = root[F("wifi")][F("station")][F("reconnectInterval")] | data.wifiStationReconnectInterval;
+	valid &= copyString(root[F("wifi")][F("ap")][F("ssid")], data.wifiApSsid, sizeof(data.wifiApSsid));
+	valid &= copyString(root[F("wifi")][F("ap")][F("password")], data.wifiApPassword, sizeof(data.wifiApPassword));
+	data.wifiApChannel = root[F("wifi")][F("ap")][F("channel")] | data.wifiApChannel;
+	valid &= copyString(root[F("wifi")][F("ap")][F("address")], data.wifiApAddress, sizeof(data.wifiApAddress));
+	valid &= copyString(root[F("wifi")][F("ap")][F("gateway")], data.wifiApGateway, sizeof(data.wifiApGateway));
+	valid &= copyString(root[F("wifi")][F("ap")][F("netmask")], data.wifiApNetmask, sizeof(data.wifiApNetmask));
+	data.wifiApNAT = root[F("wifi")][F("ap")][F("NAT")] | data.wifiApNAT;
+
+	data.consumerPushMode = root[F("consumer")][F("push")][F("mode")] | data.consumerPushMode;
+	valid &= copyString(root[F("consumer")][F("push")][F("host")], data.consumerHost, sizeof(data.consumerHost));
+	data.consumerPort = root[F("consumer")][F("push")][F("port")] | data.consumerPort;
+	valid &= copyString(root[F("consumer")][F("push")][F("path")], data.consumerPath, sizeof(data.consumerPath));
+	data.consumerPushThreshold = root[F("consumer")][F("push")][F("threshold")] | data.consumerPushThreshold;
+	data.consumerHeartbeatInterval = root[F("consumer")][F("push")][F("heartbeat")] | data.consumerHeartbeatInterval;
+
+	data.telemetryMode = root[F("telemetry")][F("mode")] | data.telemetryMode;
+	valid &= copyString(root[F("telemetry")][F("address")], data.telemetryAddress, sizeof(data.telemetryAddress));
+	data.telemetryPort = root[F("telemetry")][F("port")] | data.telemetryPort;
+
+	valid &= copyString(root[F("mqtt")][F("host")], data.mqttHost, sizeof(data.mqttHost));
+	data.mqttPort = root[F("mqtt")][F("port")] | data.mqttPort;
+	valid &= copyString(root[F("mqtt")][F("user")], data.mqttUser, sizeof(data.mqttUser));
+	valid &= copyString(root[F("mqtt")][F("password")], data.mqttPassword, sizeof(data.mqttPassword));
+	valid &= copyString(root[F("mqtt")][F("topic")], data.mqttTopic, sizeof(data.mqttTopic));
+	data.mqttBatch = root[F("mqtt")][F("batch")] | data.mqttBatch;
+	data.mqttCommands = root[F("mqtt")][F("commands")] | data.mqttCommands;
+	data.mqttKeepAlive = root[F("mqtt")][F("keepAlive")] | data.mqttKeepAlive;
+
+	data.modbusEnabled = root[F("modbus")][F("enabled")] | data.modbusEnabled;
+	data.modbusPort = root[F("modbus")][F("port")] | data.modbusPort;
+	data.modbusWrite = root[F("modbus")][F("write")] | data.modbusWrite;
+
+	data.apiPort = root[F("api")][F("port")] | data.apiPort;
+	data.apiMaxConnections = root[F("api")][F("maxConnections")] | data.apiMaxConnections;
+	data.apiIdleTimeout = root[F("api")][F("idleTimeout")] | data.apiIdleTimeout;
+
+	data.httpRateLimit = root[F("http")][F("rateLimit")] | data.httpRateLimit;
+	data.httpBurst = root[F("http")][F("burst")] | data.httpBurst;
+	data.httpBudget = root[F("http")][F("budget")] | data.httpBudget;
+
+	return valid;
+}
+
+/**
+ * Write the values to a json object, the same structure as read by parse().
+ */
+void Config::write(JsonObject root, const Data &data, bool secrets) {
+	root[F("inverter")][F("interval")] = data.inverterInterval;
+	root[F("inverter")][F("pv")][F("power")][F("initial")] = data.initialSolarPower;
+	root[F("inverter")][F("pv")][F("power")][F("tolerance")] = data.pvOutPowerTolerance;
+	root[F("inverter")][F("pv")][F("power")][F("min")] = data.minSolarPower;
+	root[F("inverter")][F("pv")][F("power")][F("max")] = data.maxSolarPower;
+	root[F("inverter")][F("pv")][F("power")][F("adjustmentStep")] = data.powerAdjustment;
+	root[F("inverter")][F("pv")][F("voltage")][F("min")] = data.minPvVoltage;
+	root[F("inverter")][F("pv")][F("voltage")][F("max")] = data.maxPvVoltage;
+	root[F("inverter")][F("battery")][F("dischargeCurrent")][F("max")] = -data.maxBatteryDischargeCurrent;
+	root[F("inverter")][F("bus")][F("voltage")][F("min")] = data.minBusVoltage;
+	root[F("inverter")][F("cutoffRetry")][F("time")] = data.cutoffRetryTime;
+	root[F("inverter")][F("cutoffRetry")][F("minBatterySoc")] = data.cutoffRetryMinBatterySoc;
+	root[F("inverter")][F("inputOverride")][F("activateSoc")] = data.inputOverrideActivateSOC;
+	root[F("inverter")][F("inputOverride")][F("deactivateSoc")] = data.inputOverrideDeactivateSOC;
+	root[F("inverter")][F("controller")][F("mode")] = data.powerControllerMode;
+	root[F("inverter")][F("controller")][F("kp")] = data.powerControllerKp;
+	root[F("inverter")][F("controller")][F("ki")] = data.powerControllerKi;
+	root[F("inverter")][F("controller")][F("batteryWeight")] = data.powerControllerBatteryWeight;
+	root[F("inverter")][F("controller")][F("rateLimit")] = data.powerControllerRateLimit;
+
+	root[F("battery")][F("capacity")] = data.batteryCapacity;
+	root[F("battery")][F("type")] = (int) data.batteryType;
+	root[F("battery")][F("voltage")][F("full")] = data.batteryVoltageFullCharge;
+	root[F("battery")][F("voltage")][F("nominal")] = data.batteryVoltageNominal;
+	root[F("battery")][F("voltage")][F("empty")] = data.batteryVoltageEmpty;
+	root[F("battery")][F("voltage")][F("float")] = data.batteryVoltageFloat;
+	root[F("battery")][F("overDischargeProtection")] = data.batteryOverDischargeProtection;
+	root[F("battery")][F("soc")][F("calculateInternally")] = data.batterySocCalculateInternally;
+	root[F("battery")][F("soc")][F("restDuration")] = data.batteryRestDuration;
+	root[F("battery")][F("soc")][F("restCurrent")] = data.batteryRestCurrent;
+	root[F("battery")][F("soc")][F("triggerFloatOverride")] = data.batterySocTriggerFloatOverride;
+
+	root[F("wifi")][F("hostname")] = data.wifiHostname;
+	root[F("wifi")][F("station")][F("ssid")] = data.wifiStationSsid;
+	if (secrets) {
+		root[F("wifi")][F("station")][F("password")] = data.wifiStationPassword;
+	}
+	root[F("wifi")][F("station")][F("reconnectInterval")] = data.wifiStationReconnectInterval;
+	root[F("wifi")][F("ap")][F("ssid")] = data.wifiApSsid;
+	if (secrets) {
+		root[F("wifi")][F("ap")][F("password")] = data.wifiApPassword;
+	}
+	root[F("wifi")][F("ap")][F("channel")] = data.wifiApChannel;
+	root[F("wifi")][F("ap")][F("address")] = data.wifiApAddress;
+	root[F("wifi")][F("ap")][F("gateway")] = data.wifiApGateway;
+	root[F("wifi")][F("ap")][F("netmask")] = data.wifiApNetmask;
+	root[F("wifi")][F("ap")][F("NAT")] = data.wifiApNAT;
+
+	root[F("consumer")][F("push")][F("mode")] = data.consumerPushMode;
+	root[F("consumer")][F("push")][F("host")] = data.consumerHost;
+	root[F("consumer")][F("push")][F("port")] = data.consumerPort;
+	root[F("consumer")][F("push")][F("path")] = data.consumerPath;
+	root[F("consumer")][F("push")][F("threshold")] = data.consumerPushThreshold;
+	root[F("consumer")][F("push")][F("heartbeat")] = data.consumerHeartbeatInterval;
+
+	root[F("telemetry")][F("mode")] = data.telemetryMode;
+	root[F("telemetry")][F("address")] = data.telemetryAddress;
+	root[F("telemetry")][F("port")] = data.telemetryPort;
+
+	root[F("mqtt")][F("host")] = data.mqttHost;
+	root[F("mqtt")][F("port")] = data.mqttPort;
+	root[F("mqtt")][F("user")] = data.mqttUser;
+	if (secrets) {
+		root[F("mqtt")][F("password")] = data.mqttPassword;
+	}
+	root[F("mqtt")][F("topic")] = data.mqttTopic;
+	root[F("mqtt")][F("batch")] = data.mqttBatch;
+	root[F("mqtt")][F("commands")] = data.mqttCommands;
+	root[F("mqtt")][F("keepAlive")] = data.mqttKeepAlive;
+
+	root[F("modbus")][F("enabled")] = data.modbusEnabled;
+	root[F("modbus")][F("port")] = data.modbusPort;
+	root[F("modbus")][F("write")] = data.modbusWrite;
+
+	root[F("api")][F("port")] = data.apiPort;
+	root[F("api")][F("maxConnections")] = data.apiMaxConnections;
+	root[F("api")][F("idleTimeout")] = data.apiIdleTimeout;
+
+	root[F("http")][F("rateLimit")] = data.httpRateLimit;
+	root[F("http")][F("burst")] = data.httpBurst;
+	root[F("http")][F("budget")] = data.httpBudget;
+}
+
+/**
+ * Check the values for plausibility.
+ */
+bool Config::validate(const Data &data) {
+	IPAddress address;
+
+	return check(data.inverterInterval >= 100, F("inverter.interval"))
+			&& check(data.minSolarPower <= data.maxSolarPower, F("inverter.pv.power.min/max"))
+			&& check(data.powerAdjustment > 0, F("inverter.pv.power.adjustmentStep"))
+			&& check(data.minPvVoltage < data.maxPvVoltage, F("inverter.pv.voltage.min/max"))
+			&& check(data.maxBatteryDischargeCurrent <= 0, F("inverter.battery.dischargeCurrent.max"))
+			&& check(data.cutoffRetryMinBatterySoc <= 100, F("inverter.cutoffRetry.minBatterySoc"))
+			&& check(data.inputOverrideActivateSOC == 0 || data.inputOverrideActivateSOC < data.inputOverrideDeactivateSOC,
+					F("inverter.inputOverride"))
+			&& check(data.powerControllerMode <= 1, F("inverter.controller.mode"))
+			&& check(data.powerControllerKp >= 0 && data.powerControllerKi >= 0, F("inverter.controller.kp/ki"))
+			&& check(data.powerControllerRateLimit > 0, F("inverter.controller.rateLimit"))
+			&& check(data.batteryCapacity > 0, F("battery.capacity"))
+			&& check(data.batteryVoltageEmpty < data.batteryVoltageNominal
+					&& data.batteryVoltageNominal <= data.batteryVoltageFullCharge, F("battery.voltage"))
+			&& check(data.wifiApChannel >= 1 && data.wifiApChannel <= 13, F("wifi.ap.channel"))
+			&& check(address.fromString(data.wifiApAddress), F("wifi.ap.address"))
+			&& check(address.fromString(data.wifiApGateway), F("wifi.ap.gateway"))
+			&& check(address.fromString(data.wifiApNetmask), F("wifi.ap.netmask"))
+			&& check(data.consumerPushMode <= 2, F("consumer.push.mode"))
+			&& check(data.telemetryMode <= 2, F("telemetry.mode"))
+			&& check(data.telemetryMode != 1 || (address.fromString(data.telemetryAddress) && address[0] >= 224 && address[0] <= 239),
+					F("telemetry.address"))
+			&& check(data.mqttTopic[0] != 0 && strpbrk(data.mqttTopic, "+#") == NULL, F("mqtt.topic"))
+			&& check(data.mqttKeepAlive >= 5, F("mqtt.keepAlive"))
+			&& check(data.modbusPort > 0, F("modbus.port"))
+			&& check(data.apiPort != 80, F("api.port"))
+			&& check(data.apiMaxConnections >= 1 && data.apiMaxConnections <= API_MAX_CONNECTIONS, F("api.maxConnections"))
+			&& check(data.apiIdleTimeout >= 1, F("api.idleTimeout"))
+			&& check(data.httpBurst >= 1, F("http.burst"))
+			&& check(data.httpBudget <= 1000, F("http.budget"));
+}
+
+bool Config::check(bool condition, const __FlashStringHelper *name) {
+	if (!condition) {
+		LOG_ERROR("invalid config value: %S", name);
+		snprintf_P(error, sizeof(error), PSTR("invalid value: %S"), name);
+	}
+	return condition;
+}
+
+/**
+ * Check that every key of the values exists in the parsed configuration at the same level and
+ * that its value has the same type (an integer is accepted where a float is expected). An
+ * integer which doesn't match the parsed value didn't fit into its field. The path of the
+ * current level (e.g. "inverter.pv") is in path, the first offending key is named in error.
+ */
+bool Config::checkKeys(JsonObjectConst values, JsonObjectConst parsed, char *path, size_t length) {
+	for (JsonPairConst pair : values) {
+		JsonVariantConst reference = parsed[pair.key()];
+		size_t end = length + snprintf_P(path + length, CONFIG_ERROR_SIZE - length, PSTR("%s%s"),
+				length > 0 ? "." : "", pair.key().c_str());
+		end = min(end, (size_t) CONFIG_ERROR_SIZE - 1);
+
+		if (reference.isNull()) {
+			snprintf_P(error, sizeof(error), PSTR("unknown key: %s"), path);
+			return false;
+		}
+		ValueType type = getValueType(pair.value());
+		ValueType expected = getValueType(reference);
+		if (type != expected && !(type == VALUE_INTEGER && expected == VALUE_FLOAT)) {
+			snprintf_P(error, sizeof(error), PSTR("invalid type: %s"), path);
+			return false;
+		}
+		if (expected == VALUE_INTEGER && pair.value() != reference) {
+			snprintf_P(error, sizeof(error), PSTR("out of range: %s"), path);
+			return false;
+		}
+		if (expected == VALUE_OBJECT
+				&& !checkKeys(pair.value().as<JsonObjectConst>(), reference.as<JsonObjectConst>(), path, end)) {
+			return false;
+		}
+		path[length] = 0;
+	}
+	return true;
+}
+
+/**
+ * Classify a json value for the type check in checkKeys().
+ */
+Config::ValueType Config::getValueType(JsonVariantConst value) {
+	if (value.is<JsonObjectConst>()) {
+		return VALUE_OBJECT;
+	}
+	if (value.is<bool>()) {
+		return VALUE_BOOL;
+	}
+	if (value.is<JsonInteger>() || value.is<JsonUInt>()) {
+		return VALUE_INTEGER;
+	}
+	if (value.is<JsonFloat>()) {
+		return VALUE_FLOAT;
+	}
+	if (value.is<const char *>()) {
+		return VALUE_STRING;
+	}
+	return VALUE_OTHER;
+}
+
+/**
+ * Copy a string value to its fixed size field, returns false if it doesn't fit.
+ */
+bool Config::copyString(JsonVariantConst value, char *target, size_t size) {
+	if (value.isNull()) {
+		return true;
+	}
+	const char *text = value.as<const char *>();
+	if (text == NULL || strlen(text) >= size) {
+		return false;
+	}
+	strcpy(target, text);
+	return true;
 }
 
 Config config;
@@ -20,9 +20,25 @@
 #include <ArduinoJson.h>
 #include "Logger.h"
 
-// uncomment to enable memory stats being sent every 0.5sec
+// uncomment to log the heap statistics every second (see HeapMonitor)
 //#define DEBUG_MEM
 
+// uncomment to count heap allocations (see HeapMonitor), requires additional linker options
+//#define DEBUG_ALLOC
+
+// uncomment to measure the run time of hot code sections, served at /debug/perf (see Profiler)
+//#define DEBUG_PERF
+
+// uncomment to include the micro-benchmarks of the sample processing, run at /debug/bench (see Benchmark)
+//#define DEBUG_BENCH
+
+#define CONFIG_NAME_SIZE 33 // maximum length of names (ssid, host name, path) + 1
+#define CONFIG_PASSWORD_SIZE 65 // maximum length of a wifi password + 1
+#define CONFIG_ADDRESS_SIZE 16 // maximum length of an ip address + 1
+#define CONFIG_URL_SIZE 65 // maximum length of a host name or path of the consumer + 1
+#define API_MAX_CONNECTIONS 4 // upper limit of api.maxConnections
+#define CONFIG_ERROR_SIZE 80 // maximum length of the description of a validation error + 1
+
 // uncomment to redirect all log output to Serial (USB) and set speed to 115200 - only works with no inverter connected, use only during dev
 //#define DEBUG_LOG
 
@@ -37,55 +53,145 @@ public:
         Other = 99
    };
 
+    /*
+     * The configuration values, a snapshot which is never modified while it's in use.
+     */
+    struct Data
+    {
+        // Inverter
+        uint16_t initialSolarPower; // initial Power to start consumer with (in W)
+        uint16_t inverterInterval; // at which interval the next data is requested from inverter (in ms)
+        uint16_t pvOutPowerTolerance; // tolerance of higher out power against PV input (in W)
+        int16_t maxBatteryDischargeCurrent; // allowed discharge current before throttling down consumer power (in A)
+        int16_t minBusVoltage; // minimum bus voltage allowed before throttling down consumer power (in V)
+        float minPvVoltage; // minimum PV voltage allowed before throttling down consumer power (in V)
+        float maxPvVoltage; // PV voltage at which the consumer power can be increased (in V)
+        uint16_t powerAdjustment; // amount of power increased/decreased when adjusting consumer power (in W)
+        uint16_t minSolarPower; // minimum solar power to provide to the consumer (in W)
+        uint16_t maxSolarPower; // maximum solar power to provide to the consumer (in W)
+        uint32_t cutoffRetryTime; // time until a retry is started after a power cutoff due to minSolarPower (in sec)
+        uint8_t cutoffRetryMinBatterySoc; // minimum battery soc to try a restart after power cutoff (in %)
+        uint8_t inputOverrideActivateSOC; // SOC at which input prio will switch to SUB (in 1%, 0 = disabled)
+        uint8_t inputOverrideDeactivateSOC; // SOC at which input prio will switch back to SBU (in 1%)
+        uint8_t powerControllerMode; // algorithm to calculate the consumer power (0 = step, 1 = PI controller)
+        float powerControllerKp; // proportional gain of the PI controller (in W per V of PV voltage outside minPvVoltage..maxPvVoltage)
+        float powerControllerKi; // integral gain of the PI controller (in W per V and second)
+        float powerControllerBatteryWeight; // weight of battery current above maxBatteryDischargeCurrent compared to PV voltage error (in V/A)
+        uint16_t powerControllerRateLimit; // maximum change of consumer power by the PI controller (in W/s)
+
+        // Battery
+        uint16_t batteryCapacity; // the capacity of the battery (in Ah)
+        BatteryType batteryType; // the type of battery used, selects the open circuit voltage curve for the SOC estimation
+        float batteryVoltageFullCharge; // the voltage at which the battery pack is fully charged and charge should stop (in V)
+        float batteryVoltageNominal; // the nominal (resting) voltage of the fully charged battery pack (in V)
+        float batteryVoltageEmpty; // the battery voltage at which a resting battery is to be considered fully discharged (in V)
+        float batteryVoltageFloat; // the default float voltage to set to avoid trickle charging Li-Ion batteries (in V)
+        bool batteryOverDischargeProtection; // even when switched to utility in SBU mode, the inverter still may drain the battery, if true this switches to SUB mode and enables grid charge until battery voltage is at nominal voltage
+        bool batterySocCalculateInternally; // if true we'll display the SOC / Ah by estimating it ourselfes (coulomb counting and voltage), if fals we'll use the inverter's SOC (true/false)
+        uint8_t batterySocTriggerFloatOverride; // state of charge at which a float voltage charge will be triggered (in %, 0 to disable)
+        uint8_t batteryRestDuration; // if voltage < batteryVoltageEmpty this is the duration where load has to be below restCurrent before we declare the battery empty (in sec)
+        uint8_t batteryRestCurrent; // max current where we still consider the battery to be at rest with no signifikant load (in A)
+
+        // Wifi
+        char wifiHostname[CONFIG_NAME_SIZE]; // the host name
+        char wifiStationSsid[CONFIG_NAME_SIZE]; // the ssid of the network we want to connect to, if empty no connection is attempted
+        char wifiStationPassword[CONFIG_PASSWORD_SIZE]; // the password of the network we want to connect to
+        uint16_t wifiStationReconnectInterval; // time until the next connection attempt to the network is made, doubled after every failed attempt (in ms)
+        char wifiApSsid[CONFIG_NAME_SIZE]; // the ssid of the network we provide
+        char wifiApPassword[CONFIG_PASSWORD_SIZE]; // the password of the network we provide
+        uint8_t wifiApChannel; // the channel of the network we provide
+        char wifiApAddress[CONFIG_ADDRESS_SIZE]; // the ip address of the network we provide
+        char wifiApGateway[CONFIG_ADDRESS_SIZE]; // the gateway address of the network we provide
+        char wifiApNetmask[CONFIG_ADDRESS_SIZE]; // the netmask of the network we provide
+        bool wifiApNAT; // if NAT should be enabled in AP/Station mode to forward traffic to foreign AP
+
+        // Consumer
+        uint8_t consumerPushMode; // how the maximum solar current is pushed to the consumer (0 = disabled / consumer polls /maxCurrent, 1 = HTTP POST, 2 = UDP datagram)
+        char consumerHost[CONFIG_URL_SIZE]; // the ip address or host name of the consumer
+        uint16_t consumerPort; // the port of the consumer
+        char consumerPath[CONFIG_URL_SIZE]; // the path to send the HTTP POST request to
+        uint16_t consumerPushThreshold; // change of the maximum solar power which triggers a push (in W)
+        uint16_t consumerHeartbeatInterval; // interval at which the value is pushed even if unchanged (in ms, 0 = disabled)
+
+        // Telemetry
+        uint8_t telemetryMode; // how every sample is sent to local consumers (0 = disabled, 1 = UDP multicast, 2 = UDP broadcast)
+        char telemetryAddress[CONFIG_ADDRESS_SIZE]; // the multicast group to send to
+        uint16_t telemetryPort; // the UDP port to send to
+
+        // MQTT
+        char mqttHost[CONFIG_URL_SIZE]; // the ip address or host name of the broker, if empty no connection is made
+        uint16_t mqttPort; // the port of the broker
+        char mqttUser[CONFIG_NAME_SIZE]; // the user name, if empty no credentials are sent
+        char mqttPassword[CONFIG_PASSWORD_SIZE]; // the password
+        char mqttTopic[CONFIG_NAME_SIZE]; // the base topic, the values are published to <topic>/<name>
+        bool mqttBatch; // if true all values are published as one JSON payload to <topic>/state, otherwise changed values per topic
+        bool mqttCommands; // if true commands are accepted on <topic>/command
+        uint16_t mqttKeepAlive; // keep-alive interval of the connection (in sec)
+
+        // Modbus
+        bool modbusEnabled; // if true a Modbus TCP server is started (requires a restart)
+        uint16_t modbusPort; // the port of the Modbus TCP server
+        bool modbusWrite; // if true the holding registers (remote override) may be written
+
+        // API server
+        uint16_t apiPort; // the port of the API server with persistent connections, 0 = disabled (requires a restart)
+        uint8_t apiMaxConnections; // number of connections which are kept open at the same time
+        uint16_t apiIdleTimeout; // time after which an idle connection is closed (in sec)
+
+        // Admission control of the web and API server
+        uint16_t httpRateLimit; // requests per second per client, excess requests get a 429 (0 = unlimited)
+        uint16_t httpBurst; // number of requests a client may send at once after a pause
+        uint16_t httpBudget; // time spent on requests per second, when exceeded requests get a 503 (in ms, 0 = unlimited)
+    };
+
     void init();
-    void load();
+    void loop();
+    bool load(const char *fileName = CONFIG_FILE);
+    bool prepare(const char *fileName);
+    void activate();
+    bool update(JsonVariantConst values);
+    const char *getError();
+    String toJSON();
 
-    static const char *CONFIG_FILE;
+    /*
+     * Access the current configuration values, e.g. config->maxPvVoltage
+     */
+    const Data *operator->() const {
+        return current;
+    }
 
-    // Inverter
-    uint16_t initialSolarPower; // initial Power to start consumer with (in W)
-    uint16_t inverterInterval; // at which interval the next data is requested from inverter (in ms)
-    uint16_t pvOutPowerTolerance; // tolerance of higher out power against PV input (in W)
-    int16_t maxBatteryDischargeCurrent; // allowed discharge current before throttling down consumer power (in A)
-    int16_t minBusVoltage; // minimum bus voltage allowed before throttling down consumer power (in V)
-    float minPvVoltage; // minimum PV voltage allowed before throttling down consumer power (in V)
-    float maxPvVoltage; // PV voltage at which the consumer power can be increased (in V)
-    uint16_t powerAdjustment; // amount of power increased/decreased when adjusting consumer power (in W)
-    uint16_t minSolarPower; // minimum solar power to provide to the consumer (in W)
-    uint16_t maxSolarPower; // maximum solar power to provide to the consumer (in W)
-    uint32_t cutoffRetryTime; // time until a retry is started after a power cutoff due to minSolarPower (in sec)
-    uint8_t cutoffRetryMinBatterySoc; // minimum battery soc to try a restart after power cutoff (in %)
-    uint8_t inputOverrideActivateSOC; // SOC at which input prio will switch to SUB (in 1%, 0 = disabled)
-    uint8_t inputOverrideDeactivateSOC; // SOC at which input prio will switch back to SBU (in 1%)
-
-    // Battery
-    uint16_t batteryCapacity; // the capacity of the battery (in Ah)
-    BatteryType batteryType; // the type of battery used
-    float batteryVoltageFullCharge; // the voltage at which the battery pack is fully charged and charge should stop (in V)
-    float batteryVoltageNominal; // the nominal (resting) voltage of the fully charged battery pack (in V)
-    float batteryVoltageEmpty; // the battery voltage at which a resting battery is to be considered fully discharged (in V)
-    float batteryVoltageFloat; // the default float voltage to set to avoid trickle charging Li-Ion batteries (in V)
-    bool batteryOverDischargeProtection; // even when switched to utility in SBU mode, the inverter still may drain the battery, if true this switches to SUB mode and enables grid charge until battery voltage is at nominal voltage
-    bool batterySocCalculateInternally; // if true we'll display the SOC / Ah by counting ourselfes, if fals we'll use the inverter's SOC (true/false)
-    uint8_t batterySocTriggerFloatOverride; // state of charge at which a float voltage charge will be triggered (in %, 0 to disable)
-    uint8_t batteryRestDuration; // if voltage < batteryVoltageEmpty this is the duration where load has to be below restCurrent before we declare the battery empty (in sec)
-    uint8_t batteryRestCurrent; // max current where we still consider the battery to be at rest with no signifikant load (in A)
-
-    // Wifi
-    const char *wifiHostname; // the host name
-    const char *wifiStationSsid; // the ssid of the network we want to connect to, if empty no connection is attempted
-    const char *wifiStationPassword; // the password of the network we want to connect to
-    uint16_t wifiStationReconnectInterval; // at which interval the next connection attempt to the network is made (in ms)
-    const char *wifiApSsid; // the ssid of the network we provide
-    const char *wifiApPassword; // the password of the network we provide
-    uint8_t wifiApChannel; // the channel of the network we provide
-    const char *wifiApAddress; // the ip address of the network we provide
-    const char *wifiApGateway; // the gateway address of the network we provide
-    const char *wifiApNetmask; // the netmask of the network we provide
-    bool wifiApNAT; // if NAT should be enabled in AP/Station mode to forward traffic to foreign AP
+    static const char *CONFIG_FILE;
+    static const char *CONFIG_FILE_TEMP;
 
 private:
-    JsonDocument doc;
+    enum ValueType
+    {
+        VALUE_OTHER,
+        VALUE_OBJECT,
+        VALUE_BOOL,
+        VALUE_INTEGER,
+        VALUE_FLOAT,
+        VALUE_STRING
+    };
+
+    Data snapshots[2]; // the current and the next configuration
+    const Data *current;
+    char error[CONFIG_ERROR_SIZE]; // description of the last validation error
+    uint32_t changeTime; // time of the last change which is not saved yet
+    bool modified; // true if the configuration was changed but not yet saved
+    bool prepared; // true if the next snapshot holds a validated configuration from prepare()
+
+    bool save();
+    void write(JsonObject root, const Data &data, bool secrets);
+
+    void setDefaults(Data &data);
+    bool parse(JsonVariantConst root, Data &data);
+    bool checkKeys(JsonObjectConst values, JsonObjectConst parsed, char *path, size_t length);
+    ValueType getValueType(JsonVariantConst value);
+    bool validate(const Data &data);
+    bool check(bool condition, const __FlashStringHelper *name);
+    Data *getNext();
+    bool copyString(JsonVariantConst value, char *target, size_t size);
 };
 
 extern Config config;
@@ -0,0 +1,277 @@
+/*
+ * HeapMonitor.cpp
+ *
+ * Samples the heap statistics (free heap, largest free block, fragmentation) every
+ * HEAP_SAMPLE_INTERVAL. The worst values are kept as low-water marks since boot and per
+ * HEAP_HISTORY_INTERVAL samples in a ring buffer, so a slowly fragmenting heap becomes visible
+ * long before the unit reboots. Reading the statistics walks the heap, so consumers like
+ * /data use the last sample instead of reading them again.
+ *
+ * Counts heap allocations if DEBUG_ALLOC is defined (see Config.h). malloc(), calloc(), realloc()
+ * and free() are intercepted with the linker's --wrap option, so every allocation is counted,
+ * including the ones of the core libraries, String and operator new. The wrapper functions are
+ * only compiled with DEBUG_ALLOC, so the linker options must be added together with the define:
+ *
+ *   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+ *
+ * (in Sloeber: Project Properties > Arduino > Compile Options > "append to link")
+ *
+ * With DEBUG_ALLOC the allocations are also counted per call site (the return address of the
+ * wrapper, i.e. the code calling malloc()). Only this one frame is known: the ESP8266 uses the
+ * call0 ABI, where __builtin_return_address() works only for level 0 and there's no frame
+ * pointer to walk the stack. So allocations by String and operator new all show up at the
+ * library code (e.g. String::changeBuffer(), operator new()), not at the code using it. To find
+ * those, compare getAllocations() before and after the suspected code (as checkLogger() does).
+ * The addresses are resolved with the elf file of the build:
+ *
+ *   xtensa-lx106-elf-addr2line -pfiaC -e SolarInverterToWeb.elf 0x40201234
+ *
+ * Everything is served at /debug/heap.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "HeapMonitor.h"
+
+static volatile uint32_t allocations = 0;
+static volatile uint32_t frees = 0;
+
+#ifdef DEBUG_ALLOC
+struct AllocationSite
+{
+	void *address; // return address of the wrapper
+	uint32_t count;
+	uint32_t bytes;
+};
+
+static AllocationSite sites[HEAP_SITES];
+static uint32_t otherSites = 0; // allocations of sites which didn't fit into the table
+
+/**
+ * Count an allocation for the call site, must not allocate itself.
+ */
+static void countAllocation(void *address, size_t size) {
+	allocations++;
+	for (uint8_t i = 0; i < HEAP_SITES; i++) {
+		if (sites[i].address == address || sites[i].address == NULL) {
+			sites[i].address = address;
+			sites[i].count++;
+			sites[i].bytes += size;
+			return;
+		}
+	}
+	otherSites++;
+}
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+	countAllocation(__builtin_return_address(0), size);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+	countAllocation(__builtin_return_address(0), count * size);
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	countAllocation(__builtin_return_address(0), size);
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr) {
+		frees++;
+	}
+	__real_free(ptr);
+}
+}
+#endif
+
+/**
+ * Constructor
+ */
+HeapMonitor::HeapMonitor() {
+	freeHeap = 0;
+	maxFreeBlock = 0;
+	fragmentation = 0;
+	historyNext = 0;
+	historyCount = 0;
+	samples = 0;
+	resetStatistics(lowWater);
+	resetStatistics(current);
+	memset(history, 0, sizeof(history));
+}
+
+void HeapMonitor::init() {
+	sample();
+#ifdef DEBUG_ALLOC
+	checkLogger();
+#endif
+}
+
+/**
+ * Read the heap statistics and update the low-water marks, called every HEAP_SAMPLE_INTERVAL.
+ */
+void HeapMonitor::sample() {
+	ESP.getHeapStats(&freeHeap, &maxFreeBlock, &fragmentation);
+
+	Statistics *statistics[] = { &lowWater, &current };
+	for (Statistics *stats : statistics) {
+		stats->time = millis() / 1000;
+		stats->minFree = min(stats->minFree, (uint16_t) min(freeHeap, (uint32_t) 0xffff));
+		stats->minMaxFreeBlock = min(stats->minMaxFreeBlock, (uint16_t) min(maxFreeBlock, (uint32_t) 0xffff));
+		stats->maxFragmentation = max(stats->maxFragmentation, fragmentation);
+	}
+
+	if (++samples >= HEAP_HISTORY_INTERVAL) {
+		history[historyNext] = current;
+		historyNext = (historyNext + 1) % HEAP_HISTORY_SIZE;
+		if (historyCount < HEAP_HISTORY_SIZE) {
+			historyCount++;
+		}
+		resetStatistics(current);
+		samples = 0;
+	}
+
+#ifdef DEBUG_MEM
+	LOG_DEBUG("free: %u, frag: %u, maxfree: %u", freeHeap, fragmentation, maxFreeBlock);
+#endif
+}
+
+/**
+ * Return the free heap of the last sample (in bytes).
+ */
+uint32_t HeapMonitor::getFree() {
+	return freeHeap;
+}
+
+/**
+ * Return the largest free block of the last sample (in bytes).
+ */
+uint32_t HeapMonitor::getMaxFreeBlock() {
+	return maxFreeBlock;
+}
+
+/**
+ * Return the heap fragmentation of the last sample (in %).
+ */
+uint8_t HeapMonitor::getFragmentation() {
+	return fragmentation;
+}
+
+/**
+ * Return the total amount of malloc(), calloc() and realloc() calls since startup.
+ */
+uint32_t HeapMonitor::getAllocations() {
+	return allocations;
+}
+
+/**
+ * Return the total amount of free() calls since startup.
+ */
+uint32_t HeapMonitor::getFrees() {
+	return frees;
+}
+
+/**
+ * Returns if allocations are counted (DEBUG_ALLOC is defined and the wrapper is linked in).
+ */
+boolean HeapMonitor::isCounting() {
+	uint32_t before = allocations;
+	void *volatile test = malloc(1); // volatile prevents the compiler from removing the pair
+	free(test);
+	return allocations != before;
+}
+
+/**
+ * Verify that log calls don't touch the heap - neither suppressed ones nor written ones.
+ */
+void HeapMonitor::checkLogger() {
+	if (!isCounting()) {
+		LOG_WARN("allocation counting not active, check linker options");
+		return;
+	}
+
+	Logger::LogLevel level = logger.getLogLevel();
+	logger.setLoglevel(Logger::Off);
+	uint32_t before = allocations;
+	for (int i = 0; i < 100; i++) {
+		LOG_DEBUG("suppressed message %d at %lu", i, millis());
+		LOG_INFO("suppressed message %d: %s", i, "test");
+	}
+	uint32_t suppressed = allocations - before;
+
+	logger.setLoglevel(level);
+	before = allocations;
+	LOG_INFO("written message %d: %s", 1, "test");
+	uint32_t written = allocations - before;
+
+	LOG_INFO("heap allocations of 200 suppressed log calls: %u, of a written log call: %u", suppressed, written);
+}
+
+/**
+ * The last sample, the low-water marks, the history (oldest first) and the allocation
+ * statistics as JSON.
+ */
+String HeapMonitor::toJSON() {
+	JsonDocument doc;
+
+	doc[F("free")] = freeHeap;
+	doc[F("maxFreeBlock")] = maxFreeBlock;
+	doc[F("fragmentation")] = fragmentation;
+	doc[F("minFree")] = lowWater.minFree;
+	doc[F("minMaxFreeBlock")] = lowWater.minMaxFreeBlock;
+	doc[F("maxFragmentation")] = lowWater.maxFragmentation;
+
+	doc[F("historyInterval")] = HEAP_HISTORY_INTERVAL * HEAP_SAMPLE_INTERVAL / 1000;
+	JsonArray historyNode = doc[F("history")].to<JsonArray>(); // [time, minFree, minMaxFreeBlock, maxFragmentation]
+	uint8_t first = (historyNext + HEAP_HISTORY_SIZE - historyCount) % HEAP_HISTORY_SIZE;
+	for (uint8_t i = 0; i < historyCount; i++) {
+		const Statistics &entry = history[(first + i) % HEAP_HISTORY_SIZE];
+		JsonArray node = historyNode.add<JsonArray>();
+		node.add(entry.time);
+		node.add(entry.minFree);
+		node.add(entry.minMaxFreeBlock);
+		node.add(entry.maxFragmentation);
+	}
+
+#ifdef DEBUG_ALLOC
+	AllocationSite copy[HEAP_SITES];
+	noInterrupts();
+	memcpy(copy, sites, sizeof(copy));
+	interrupts();
+
+	doc[F("allocations")] = allocations;
+	doc[F("frees")] = frees;
+	doc[F("otherSites")] = otherSites;
+	JsonArray sitesNode = doc[F("sites")].to<JsonArray>();
+	for (uint8_t i = 0; i < HEAP_SITES && copy[i].address != NULL; i++) {
+		char address[12];
+		snprintf_P(address, sizeof(address), PSTR("0x%08lx"), (unsigned long) copy[i].address);
+		JsonObject node = sitesNode.add<JsonObject>();
+		node[F("address")] = address;
+		node[F("count")] = copy[i].count;
+		node[F("bytes")] = copy[i].bytes;
+	}
+#endif
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
+
+void HeapMonitor::resetStatistics(Statistics &statistics) {
+	statistics.time = 0;
+	statistics.minFree = 0xffff;
+	statistics.minMaxFreeBlock = 0xffff;
+	statistics.maxFragmentation = 0;
+}
+
+HeapMonitor heapMonitor;
@@ -0,0 +1,62 @@
+/*
+ * HeapMonitor.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef HEAPMONITOR_H_
+#define HEAPMONITOR_H_
+
+#include <Arduino.h>
+#include "Logger.h"
+#include "Config.h"
+
+#define HEAP_SAMPLE_INTERVAL 1000 // interval at which the heap statistics are read (in ms)
+#define HEAP_HISTORY_INTERVAL 60 // samples aggregated into one history entry
+#define HEAP_HISTORY_SIZE 60 // number of history entries (one hour)
+#define HEAP_SITES 16 // number of allocation call sites tracked with DEBUG_ALLOC
+
+class HeapMonitor
+{
+public:
+    HeapMonitor();
+    void init();
+    void sample();
+    uint32_t getFree();
+    uint32_t getMaxFreeBlock();
+    uint8_t getFragmentation();
+    uint32_t getAllocations();
+    uint32_t getFrees();
+    boolean isCounting();
+    String toJSON();
+
+private:
+    /*
+     * The worst values within a period.
+     */
+    struct Statistics
+    {
+        uint32_t time; // end of the period (in sec since boot)
+        uint16_t minFree; // in bytes
+        uint16_t minMaxFreeBlock; // in bytes
+        uint8_t maxFragmentation; // in %
+    };
+
+    void checkLogger();
+    void resetStatistics(Statistics &statistics);
+
+    uint32_t freeHeap; // of the last sample (in bytes)
+    uint32_t maxFreeBlock; // of the last sample (in bytes)
+    uint8_t fragmentation; // of the last sample (in %)
+    Statistics lowWater; // since boot
+    Statistics current; // of the running history period
+    Statistics history[HEAP_HISTORY_SIZE];
+    uint8_t historyNext; // index of the next history entry to write
+    uint8_t historyCount; // number of valid history entries (up to HEAP_HISTORY_SIZE)
+    uint8_t samples; // in the running history period
+};
+
+extern HeapMonitor heapMonitor;
+
+#endif /* HEAPMONITOR_H_ */
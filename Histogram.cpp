@@ -0,0 +1,111 @@
+/*
+ * Histogram.cpp
+ *
+ * A histogram with a fixed amount of logarithmic buckets to record e.g. latencies
+ * without allocating memory. Percentiles are approximated by the upper bound of the
+ * bucket they fall into (max. error 25%).
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Histogram.h"
+
+/**
+ * Constructor
+ */
+Histogram::Histogram() {
+	reset();
+}
+
+/**
+ * Record a value.
+ */
+void Histogram::add(uint32_t value) {
+	buckets[getBucket(value)]++;
+	count++;
+	sum += value;
+	if (value > max) {
+		max = value;
+	}
+}
+
+/**
+ * Clear all recorded values.
+ */
+void Histogram::reset() {
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+	max = 0;
+	sum = 0;
+}
+
+uint32_t Histogram::getCount() {
+	return count;
+}
+
+uint32_t Histogram::getMax() {
+	return max;
+}
+
+uint32_t Histogram::getAverage() {
+	return count > 0 ? sum / count : 0;
+}
+
+/**
+ * Return the value below which the given percentage of recorded values fall.
+ */
+uint32_t Histogram::getPercentile(uint8_t percent) {
+	if (count == 0) {
+		return 0;
+	}
+
+	uint32_t threshold = ((uint64_t) count * percent + 99) / 100;
+	uint32_t cumulated = 0;
+	for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		cumulated += buckets[i];
+		if (cumulated >= threshold) {
+			return min(getUpperBound(i), max);
+		}
+	}
+	return max;
+}
+
+/**
+ * Add the statistics to a JSON node.
+ */
+void Histogram::toJSON(JsonObject &node) {
+	node[F("count")] = count;
+	node[F("avg")] = getAverage();
+	node[F("p50")] = getPercentile(50);
+	node[F("p99")] = getPercentile(99);
+	node[F("max")] = max;
+}
+
+/**
+ * Map a value to its bucket: HISTOGRAM_LINEAR buckets for small values, above
+ * HISTOGRAM_SUB_BUCKETS buckets per power of two.
+ */
+uint8_t Histogram::getBucket(uint32_t value) {
+	if (value < HISTOGRAM_LINEAR) {
+		return value;
+	}
+	uint8_t msb = 31 - __builtin_clz(value);
+	if (msb >= HISTOGRAM_MAX_BITS) {
+		return HISTOGRAM_BUCKETS - 1;
+	}
+	return HISTOGRAM_LINEAR + (msb - 3) * HISTOGRAM_SUB_BUCKETS + ((value >> (msb - 2)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Return the largest value which maps to the bucket.
+ */
+uint32_t Histogram::getUpperBound(uint8_t bucket) {
+	if (bucket < HISTOGRAM_LINEAR) {
+		return bucket;
+	}
+	uint8_t msb = 3 + (bucket - HISTOGRAM_LINEAR) / HISTOGRAM_SUB_BUCKETS;
+	uint8_t sub = (bucket - HISTOGRAM_LINEAR) % HISTOGRAM_SUB_BUCKETS;
+	uint32_t lower = (uint32_t) (HISTOGRAM_SUB_BUCKETS + sub) << (msb - 2);
+	return lower + (1UL << (msb - 2)) - 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * Histogram.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define HISTOGRAM_LINEAR 8 // values below this are counted exactly
+#define HISTOGRAM_SUB_BUCKETS 4 // buckets per power of two above HISTOGRAM_LINEAR (max. error 25%)
+#define HISTOGRAM_MAX_BITS 24 // values up to 2^24 (e.g. 16.7sec in us) are resolved, above go to the last bucket
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + (HISTOGRAM_MAX_BITS - 3) * HISTOGRAM_SUB_BUCKETS)
+
+class Histogram {
+public:
+	Histogram();
+	void add(uint32_t value);
+	void reset();
+	uint32_t getCount();
+	uint32_t getMax();
+	uint32_t getAverage();
+	uint32_t getPercentile(uint8_t percent);
+	void toJSON(JsonObject &node);
+private:
+	static uint8_t getBucket(uint32_t value);
+	static uint32_t getUpperBound(uint8_t bucket);
+
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint32_t max;
+	uint64_t sum;
+};
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,141 @@
+/*
+ * HttpParser.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "HttpParser.h"
+
+/**
+ * Return the length of the first request in the data (header and body), 0 if it's not
+ * complete yet. The result may be larger than the data if the body is still missing.
+ */
+size_t HttpParser::getRequestLength(const char *data, size_t length) {
+	const char *headerEnd = findHeaderEnd(data, length);
+	if (headerEnd == NULL) {
+		return 0;
+	}
+
+	size_t contentLength = 0;
+	const char *line = data;
+	while (line < headerEnd) {
+		const char *end = (const char *) memchr(line, '\n', headerEnd - line);
+		end = (end == NULL ? headerEnd : end);
+		const char *value;
+		if (isHeader(line, end, "Content-Length", &value)) {
+			contentLength = strtoul(value, NULL, 10);
+		}
+		line = end + 1;
+	}
+	return headerEnd - data + contentLength;
+}
+
+/**
+ * Parse the request line and the relevant headers of a complete request. Returns false if
+ * it's not a valid HTTP/1.x request.
+ */
+bool HttpParser::parse(const char *data, size_t length, Request &request) {
+	const char *headerEnd = findHeaderEnd(data, length);
+	const char *lineEnd = (const char *) memchr(data, '\n', length);
+	if (headerEnd == NULL || lineEnd == NULL) {
+		return false;
+	}
+	memset(&request, 0, sizeof(Request));
+
+	// request line: <method> <target> HTTP/1.<minor>
+	const char *methodEnd = (const char *) memchr(data, ' ', lineEnd - data);
+	const char *targetEnd = (methodEnd != NULL ? (const char *) memchr(methodEnd + 1, ' ', lineEnd - methodEnd - 1) : NULL);
+	if (methodEnd == NULL || targetEnd == NULL || lineEnd - targetEnd < 9 || strncmp(targetEnd + 1, "HTTP/1.", 7) != 0) {
+		return false;
+	}
+	request.method = data;
+	request.methodLength = methodEnd - data;
+	request.path = methodEnd + 1;
+	const char *query = (const char *) memchr(request.path, '?', targetEnd - request.path);
+	request.pathLength = (query != NULL ? query : targetEnd) - request.path;
+	request.keepAlive = (targetEnd[8] != '0'); // persistent by default since HTTP/1.1
+
+	const char *line = lineEnd + 1;
+	while (line < headerEnd) {
+		const char *end = (const char *) memchr(line, '\n', headerEnd - line);
+		end = (end == NULL ? headerEnd : end);
+		const char *value;
+		if (isHeader(line, end, "Connection", &value)) {
+			if (containsToken(value, end, "close")) {
+				request.keepAlive = false;
+			} else if (containsToken(value, end, "keep-alive")) {
+				request.keepAlive = true;
+			}
+		} else if (isHeader(line, end, "If-None-Match", &value)) {
+			request.ifNoneMatch = value;
+			request.ifNoneMatchLength = end - value;
+			while (request.ifNoneMatchLength > 0 && (value[request.ifNoneMatchLength - 1] == '\r'
+					|| value[request.ifNoneMatchLength - 1] == ' ')) {
+				request.ifNoneMatchLength--;
+			}
+		}
+		line = end + 1;
+	}
+	return true;
+}
+
+/**
+ * Compare a not null terminated text with a string.
+ */
+bool HttpParser::equals(const char *text, size_t length, const char *other) {
+	return strlen(other) == length && memcmp(text, other, length) == 0;
+}
+
+/**
+ * Find the end of the header (the position after the empty line), NULL if not received yet.
+ * Lines may be terminated by CRLF or only LF.
+ */
+const char *HttpParser::findHeaderEnd(const char *data, size_t length) {
+	for (size_t i = 1; i < length; i++) {
+		if (data[i] == '\n' && (data[i - 1] == '\n' || (i > 1 && data[i - 1] == '\r' && data[i - 2] == '\n'))) {
+			return data + i + 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Check if the line is the header with the given name (case insensitive) and return the
+ * position of its value.
+ */
+bool HttpParser::isHeader(const char *line, const char *end, const char *name, const char **value) {
+	size_t nameLength = strlen(name);
+	if ((size_t) (end - line) <= nameLength || line[nameLength] != ':' || strncasecmp(line, name, nameLength) != 0) {
+		return false;
+	}
+	*value = line + nameLength + 1;
+	while (*value < end && **value == ' ') {
+		(*value)++;
+	}
+	return true;
+}
+
+/**
+ * Check if a comma separated header value contains the token (case insensitive).
+ */
+bool HttpParser::containsToken(const char *value, const char *end, const char *token) {
+	size_t tokenLength = strlen(token);
+	while (value < end) {
+		while (value < end && (*value == ' ' || *value == ',')) {
+			value++;
+		}
+		const char *tokenEnd = value;
+		while (tokenEnd < end && *tokenEnd != ',' && *tokenEnd != '\r' && *tokenEnd != ' ') {
+			tokenEnd++;
+		}
+		if ((size_t) (tokenEnd - value) == tokenLength && strncasecmp(value, token, tokenLength) == 0) {
+			return true;
+		}
+		value = (tokenEnd < end && *tokenEnd != '\r' ? tokenEnd + 1 : end);
+	}
+	return false;
+}
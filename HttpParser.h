@@ -0,0 +1,44 @@
+/*
+ * HttpParser.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef HTTPPARSER_H_
+#define HTTPPARSER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Splits a stream of HTTP/1.x requests (e.g. pipelined on a persistent connection) into single
+ * requests and extracts the parts needed to answer simple GET requests. Nothing is copied,
+ * the fields point into the received data.
+ * tools/httpbench builds it into an API server on the host.
+ */
+class HttpParser
+{
+public:
+    struct Request
+    {
+        const char *method;
+        size_t methodLength;
+        const char *path; // without the query
+        size_t pathLength;
+        const char *ifNoneMatch; // value of the If-None-Match header, NULL if not present
+        size_t ifNoneMatchLength;
+        bool keepAlive; // true if the client wants to keep the connection open
+    };
+
+    static size_t getRequestLength(const char *data, size_t length);
+    static bool parse(const char *data, size_t length, Request &request);
+    static bool equals(const char *text, size_t length, const char *other);
+
+private:
+    static const char *findHeaderEnd(const char *data, size_t length);
+    static bool isHeader(const char *line, const char *end, const char *name, const char **value);
+    static bool containsToken(const char *value, const char *end, const char *token);
+};
+
+#endif /* HTTPPARSER_H_ */
@@ -8,6 +8,12 @@
  */
 
 #include "Inverter.h"
+#include "WLAN.h"
+#include "Telemetry.h"
+#include "Mqtt.h"
+#include "Modbus.h"
+#include "Profiler.h"
+#include "HeapMonitor.h"
 
 const char *Inverter::modeString[] = { "ON", "STAND_BY", "LINE", "BATTERY", "BYPASS", "ECO", "FAULT", "POWER_SAVE",
 		"UNKNOWN" };
@@ -15,7 +21,7 @@ const char *Inverter::modeString[] = { "ON", "STAND_BY", "LINE", "BATTERY", "BYP
 /**
  * Constructor
  */
-Inverter::Inverter() {
+Inverter::Inverter() : jsonDoc(&jsonArena) {
 	mode = UNKNOWN;
 	status = 0;
 	warning = 0;
@@ -37,12 +43,20 @@ Inverter::Inverter() {
 
 	queryMode = STATUS;
 	timestamp = 0;
-	cutoffTime = 0;
-	maxSolarPower = 1000;
+	inputLength = 0;
+	responsePending = false;
+	memset(stageTime, 0, sizeof(stageTime));
+	memset(maxStageLatency, 0, sizeof(maxStageLatency));
+	firstSampleTime = 0;
+	sequence = 0;
+	jsonFallbacks = 0;
 
 	floatOverrideActive = false;
 	overDischargeProtectionActive = false;
 	inputOverrideActive = false;
+	gridRequested = false;
+	gridSwitchActive = false;
+	remotePowerOverride = false;
 	floatVoltage = 0;
 }
 
@@ -57,66 +71,156 @@ void Inverter::init() {
 	Serial.begin(2400);
 #endif
 
-	// get rid of boot-loader rubbish
+	// get rid of boot-loader rubbish, the answers are discarded before the first query is sent
 	Serial.write(13);
-	delay(200);
 	Serial.write(13);
 
-	timestamp = millis();
+	timestamp = millis() - config->inverterInterval + STARTUP_DELAY;
 
-	maxSolarPower = config.initialSolarPower;
+	PowerController::Settings settings;
+	getControllerSettings(settings);
+	powerController.init(settings, timestamp);
 }
 
 /**
  * The main processing logic, called by the program's loop().
+ *
+ * Incoming data is collected as it arrives. As soon as a complete response is received,
+ * it's processed immediately (see processSample()). New queries are sent at the configured
+ * interval when no response is pending.
  */
 void Inverter::loop() {
-	if (timestamp + config.inverterInterval > millis())
-		return;
-
-	if (readResponse()) {
-		processResponse();
-
-		switch (queryMode) {
-		case MODE:
-		case IGNORE:
+	if (responsePending && readResponse()) {
+		processSample();
+	} else if (responsePending && millis() - timestamp > RESPONSE_TIMEOUT) {
+		LOG_WARN("no response from inverter");
+		responsePending = false;
+		inputLength = 0;
+		if (queryMode == IGNORE) {
 			queryMode = STATUS;
-			break;
-		case STATUS:
-			battery.loop();
-			calculateMaximumSolarPower();
-			queryMode = WARNING;
-			break;
-		case WARNING:
-			queryMode = MODE;
-			break;
 		}
 	}
 
-	if (!adjustFloatVoltage() && !overDischargeProtection() && !adjustOutputPrio()) {
+	if (!responsePending && millis() - timestamp >= config->inverterInterval) {
 		sendQuery();
 	}
+}
 
-	timestamp = millis();
+/**
+ * The processing pipeline for a new response: parse it, then (for status data) update the
+ * battery state, run the controller and publish the result. Each stage is timestamped to
+ * measure the latency from the reception of the last byte until the set-point is published.
+ * Finally the housekeeping may send a command to the inverter as the line is idle now.
+ */
+void Inverter::processSample() {
+	processResponse();
+	sequence++;
+	stageTime[PARSED] = micros();
+
+	switch (queryMode) {
+	case MODE:
+	case IGNORE:
+		queryMode = STATUS;
+		break;
+	case STATUS:
+		battery.loop();
+		stageTime[BATTERY_UPDATED] = micros();
+		calculateMaximumSolarPower();
+		stageTime[CONTROLLED] = micros();
+		wlan.pushMaxCurrent();
+		telemetry.publish();
+		mqtt.publish();
+		modbus.update();
+		stageTime[PUBLISHED] = micros();
+		recordLatency();
+		queryMode = WARNING;
+		break;
+	case WARNING:
+		queryMode = MODE;
+		break;
+	}
+
+	if (adjustFloatVoltage() || overDischargeProtection() || adjustOutputPrio()) {
+		responsePending = true;
+		timestamp = millis();
+	}
+}
+
+/**
+ * Update the statistics of the pipeline latency (in us).
+ */
+void Inverter::recordLatency() {
+	for (uint8_t i = PARSED; i <= PUBLISHED; i++) {
+		uint32_t duration = stageTime[i] - stageTime[i - 1];
+		if (duration > maxStageLatency[i]) {
+			maxStageLatency[i] = duration;
+		}
+	}
+	latency.add(stageTime[PUBLISHED] - stageTime[RECEIVED]);
+
+	if (firstSampleTime == 0) {
+		firstSampleTime = millis();
+		LOG_INFO("first sample processed %lums after boot", firstSampleTime);
+	}
+}
+
+/**
+ * Convert the latency statistics of the processing pipeline into a JSON string (all values in us,
+ * except firstSample which is the time from boot until the first status sample was processed in ms).
+ */
+String Inverter::latencyToJSON() {
+	JsonDocument doc;
+	const char *stageNames[] = { "received", "parsed", "batteryUpdated", "controlled", "published" };
+
+	doc[F("firstSample")] = firstSampleTime;
+	JsonObject total = doc[F("total")].to<JsonObject>();
+	latency.toJSON(total);
+
+	JsonObject last = doc[F("lastSample")].to<JsonObject>();
+	JsonObject worst = doc[F("stageMax")].to<JsonObject>();
+	for (uint8_t i = RECEIVED; i <= PUBLISHED; i++) {
+		last[stageNames[i]] = stageTime[i] - stageTime[RECEIVED];
+		if (i > RECEIVED) {
+			worst[stageNames[i]] = maxStageLatency[i];
+		}
+	}
+
+	String str;
+	serializeJson(doc, str);
+	return str;
 }
 
 /**
  * Send a command to the inverter with a checksum.
  */
-void Inverter::sendCommand(String command) {
-	String crc = CRCUtil::getCRC(command);
+void Inverter::sendCommand(const char *command) {
+	char frame[COMMAND_SIZE + 3];
+	size_t length = strnlen(command, COMMAND_SIZE);
 
-	logger.info(F("sending command: %s"), command.c_str());
+	LOG_INFO("sending command: %s", command);
 
-	Serial.print(command);
-	Serial.print(crc);
-	Serial.write(13);
+	memcpy(frame, command, length);
+	length = CRCUtil::appendCRC(frame, length);
+	frame[length++] = 13;
+	Serial.write((const uint8_t *) frame, length);
+}
+
+void Inverter::sendCommand(const __FlashStringHelper *command) {
+	char text[COMMAND_SIZE + 1];
+	strncpy_P(text, (PGM_P) command, COMMAND_SIZE);
+	text[COMMAND_SIZE] = 0;
+	sendCommand(text);
 }
 
 /**
  * Query the actual data and status from the inverter.
  */
 void Inverter::sendQuery() {
+	while (Serial.available()) { // discard anything received while no response was expected
+		Serial.read();
+	}
+	inputLength = 0;
+
 	switch (queryMode) {
 	case MODE:
 		sendCommand(F("QMOD"));
@@ -130,16 +234,30 @@ void Inverter::sendQuery() {
 	case IGNORE:
 		break;
 	}
+	responsePending = true;
+	timestamp = millis();
 }
 
 /**
- * Check if a response is available on the serial port and read it to a buffer.
+ * Collect the available bytes from the serial port without waiting. Returns true if a
+ * complete response (terminated by CR) with valid CRC was received.
  */
 bool Inverter::readResponse() {
-	if (Serial.available()) {
-		byte size = Serial.readBytes(input, INPUT_BUFFER_SIZE);
-		input[size > 0 ? size - 1 : 0] = 0; // drop the last char, it's a CR and not useful for CRC calculation
-		return CRCUtil::checkCRC(String(input));
+	PROFILE(INVERTER_READ_RESPONSE);
+	while (Serial.available()) {
+		char c = Serial.read();
+		if (c == 13) { // the CR is not part of the CRC calculation
+			PROFILE(CHECK_CRC);
+			input[inputLength] = 0;
+			uint16_t length = inputLength;
+			inputLength = 0;
+			responsePending = false;
+			stageTime[RECEIVED] = micros();
+			return CRCUtil::checkCRC(input, length);
+		}
+		if (inputLength < INPUT_BUFFER_SIZE) {
+			input[inputLength++] = c;
+		}
 	}
 	return false;
 }
@@ -163,11 +281,11 @@ void Inverter::processResponse() {
 bool Inverter::adjustFloatVoltage() {
 	if (floatOverrideActive && battery.isFullyCharged() && battery.getCurrent() < 5) {
 		floatOverrideActive = false;
-		setFloatVoltage(config.batteryVoltageFloat);
-	} else if (!floatOverrideActive && config.batterySocTriggerFloatOverride > 0
-			&& battery.getSOC() < config.batterySocTriggerFloatOverride * 10) {
+		setFloatVoltage(config->batteryVoltageFloat);
+	} else if (!floatOverrideActive && config->batterySocTriggerFloatOverride > 0
+			&& battery.getSOC() < config->batterySocTriggerFloatOverride * 10) {
 		floatOverrideActive = true;
-		setFloatVoltage(config.batteryVoltageFullCharge);
+		setFloatVoltage(config->batteryVoltageFullCharge);
 	} else {
 		return false;
 	}
@@ -175,24 +293,29 @@ bool Inverter::adjustFloatVoltage() {
 }
 
 void Inverter::setFloatVoltage(float voltage) {
-	logger.info(F("setting float voltage to %2.1fV"), voltage);
+	LOG_INFO("setting float voltage to %2.1fV", voltage);
 	floatVoltage = voltage;
-	sprintf(buffer, "PBFT%2.1f", voltage);
+	snprintf_P(buffer, sizeof(buffer), PSTR("PBFT%2.1f"), voltage);
 	sendCommand(buffer);
 	queryMode = IGNORE;
 }
 
+/**
+ * Switch the output to the grid (output priority SUB) until the battery is fully charged,
+ * e.g. to spare the battery for the night. The command is sent by adjustOutputPrio() when
+ * the serial line is idle.
+ */
 void Inverter::switchToGrid() {
-	//TODO implement
+	gridRequested = true;
 }
 
 bool Inverter::overDischargeProtection() {
-	if (!overDischargeProtectionActive && config.batteryOverDischargeProtection && battery.isEmpty()) {
-		logger.info(F("activating over-discharge protection"));
+	if (!overDischargeProtectionActive && config->batteryOverDischargeProtection && battery.isEmpty()) {
+		LOG_INFO("activating over-discharge protection");
 		overDischargeProtectionActive = true;
 		sendCommand(F("PCP02")); // set charger prio to solar and utility
-	} else if (overDischargeProtectionActive && battery.getVoltage() >= config.batteryVoltageNominal) {
-		logger.info(F("deactivating over-discharge protection"));
+	} else if (overDischargeProtectionActive && battery.getVoltage() >= config->batteryVoltageNominal) {
+		LOG_INFO("deactivating over-discharge protection");
 		overDischargeProtectionActive = false;
 		sendCommand(F("PCP03")); // set charger prio to solar only
 	} else {
@@ -203,13 +326,30 @@ bool Inverter::overDischargeProtection() {
 }
 
 bool Inverter::adjustOutputPrio() {
-	if (!inputOverrideActive && config.inputOverrideActivateSOC > 0 &&
-			battery.getSOC() < config.inputOverrideActivateSOC * 10) {
-		logger.info(F("changing input prio to SUB due to SOC of %d"), battery.getSOC() / 10);
+	if (gridRequested) {
+		gridRequested = false;
+		gridSwitchActive = true;
+		if (inputOverrideActive) {
+			return false; // already on SUB
+		}
+		LOG_INFO("changing input prio to SUB on request");
 		inputOverrideActive = true;
 		sendCommand(F("POP01")); // set output prio to SUB (Solar, Utility, Battery)
-	} else if (inputOverrideActive && battery.getSOC() > config.inputOverrideDeactivateSOC * 10) {
-		logger.info(F("changing input prio to SBU due to SOC of %d"), battery.getSOC() / 10);
+	} else if (gridSwitchActive) {
+		if (!battery.isFullyCharged()) {
+			return false;
+		}
+		LOG_INFO("changing input prio to SBU as the battery is fully charged");
+		gridSwitchActive = false;
+		inputOverrideActive = false;
+		sendCommand(F("POP02")); // set output prio to SBU (Solar, Battery, Utility)
+	} else if (!inputOverrideActive && config->inputOverrideActivateSOC > 0 &&
+			battery.getSOC() < config->inputOverrideActivateSOC * 10) {
+		LOG_INFO("changing input prio to SUB due to SOC of %d", battery.getSOC() / 10);
+		inputOverrideActive = true;
+		sendCommand(F("POP01")); // set output prio to SUB (Solar, Utility, Battery)
+	} else if (inputOverrideActive && battery.getSOC() > config->inputOverrideDeactivateSOC * 10) {
+		LOG_INFO("changing input prio to SBU due to SOC of %d", battery.getSOC() / 10);
 		inputOverrideActive = false;
 		sendCommand(F("POP02")); // set output prio to SBU (Solar, Battery, Utility)
 	} else {
@@ -226,7 +366,7 @@ bool Inverter::adjustOutputPrio() {
  */
 void Inverter::parseModeResponse(char *input) {
 	if (input[0] != '(' || strlen(input) < 2 || strstr(input, "(NAK") != NULL) {
-		logger.warn(F("unable to parse '%s"), input);
+		LOG_WARN("unable to parse '%s'", input);
 		return;
 	}
 	input++; // skip the (
@@ -268,8 +408,9 @@ void Inverter::parseModeResponse(char *input) {
  * Example: (235.3 49.9 229.9 49.9 1800 1810 050 348 25.10 000 085 0040 00.0 117.4 00.00 00000 00010110 00 00 00000 110<CRC>
  */
 void Inverter::parseStatusResponse(char *input) {
+	PROFILE(PARSE_STATUS_RESPONSE);
 	if (input[0] != '(' || strlen(input) < 10 || strchr(input, ' ') == NULL) {
-		logger.warn(F("unable to parse '%s"), input);
+		LOG_WARN("unable to parse '%s'", input);
 		return;
 	}
 	input++; // skip the (
@@ -312,7 +453,7 @@ void Inverter::parseStatusResponse(char *input) {
  */
 void Inverter::parseWarningResponse(char *input) {
 	if (input[0] != '(' || strlen(input) < 30 || strstr(input, "(NAK") != NULL) {
-		logger.warn(F("unable to parse '%s"), input);
+		LOG_WARN("unable to parse '%s'", input);
 		return;
 	}
 	input++; // skip the (
@@ -440,9 +581,12 @@ uint8_t Inverter::parseStatus2() {
 }
 
 /**
- * Convert the actual values into a JSON string.
+ * Write the actual values as JSON string to the buffer, returns the length. The document
+ * uses the static jsonArena, so no heap is used. If JSON_ARENA_SIZE is too small for the
+ * document, the heap is used anyway and a warning is logged.
  */
-String Inverter::toJSON() {
+size_t Inverter::toJSON(char *buffer, size_t size) {
+	PROFILE(INVERTER_TO_JSON);
 	jsonDoc.clear();
 
 	JsonObject gridNode = jsonDoc[F("grid")].to<JsonObject>();
@@ -464,6 +608,8 @@ String Inverter::toJSON() {
 	batteryNode[F("power")] = battery.getPower();
 	batteryNode[F("soc")] = round1((float) battery.getSOC() / 10.0f);
 	batteryNode[F("ampereHours")] = round1((float) battery.getAmpereHours() / 10.0f);
+	batteryNode[F("socUncertainty")] = round1((float) battery.getSocUncertainty() / 10.0f);
+	batteryNode[F("resistance")] = battery.getResistance();
 	batteryNode[F("source")] = evalChargeSource();
 	batteryNode[F("floatCharge")] = (status & CHARGING_FLOATING ? F("on") : F("off"));
 	batteryNode[F("floatVoltage")] = round1(floatVoltage);
@@ -476,6 +622,7 @@ String Inverter::toJSON() {
 	pvNode[F("power")] = pvChargingPower;
 	pvNode[F("maxPower")] = getMaximumSolarPower();
 	pvNode[F("maxCurrent")] = getMaximumSolarCurrent();
+	pvNode[F("controllerError")] = round1(powerController.getError());
 
 	JsonObject systemNode = jsonDoc[F("system")].to<JsonObject>();
 	systemNode[F("version")] = eepromVersion;
@@ -489,13 +636,17 @@ String Inverter::toJSON() {
 	evalWarning(warn);
 	systemNode[F("time")] = getTimeStamp(millis());
 	JsonObject memory = systemNode[F("memory")].to<JsonObject>();
-	memory[F("freeHeap")] = ESP.getFreeHeap();
-	memory[F("fragmentation")] = ESP.getHeapFragmentation();
-	memory[F("freeBlockMax")] = ESP.getMaxFreeBlockSize();
-
-	String str;
-	serializeJson(jsonDoc, str);
-	return str;
+	memory[F("freeHeap")] = heapMonitor.getFree();
+	memory[F("fragmentation")] = heapMonitor.getFragmentation();
+	memory[F("freeBlockMax")] = heapMonitor.getMaxFreeBlock();
+
+	size_t length = serializeJson(jsonDoc, buffer, size);
+	jsonDoc.clear(); // releases the arena for the next call
+	if (jsonArena.getFallbacks() != jsonFallbacks) {
+		jsonFallbacks = jsonArena.getFallbacks();
+		LOG_WARN("JSON arena too small, %lu heap allocations so far", jsonFallbacks);
+	}
+	return length;
 }
 
 char *Inverter::getTimeStamp(uint32_t s) {
@@ -508,7 +659,7 @@ double Inverter::round1(double value) {
 	return (int)(value * 10 + 0.5) / 10.0;
 }
 
-String Inverter::evalChargeSource() {
+const __FlashStringHelper *Inverter::evalChargeSource() {
 	if (status & CHARGING) {
 		if ((status & CHARGING_SOLAR) && (status & CHARGING_GRID)) {
 			return F("Solar and Grid");
@@ -518,10 +669,10 @@ String Inverter::evalChargeSource() {
 			return F("Grid");
 		}
 	}
-	return "-";
+	return F("-");
 }
 
-String Inverter::evalLoadSource() {
+const __FlashStringHelper *Inverter::evalLoadSource() {
 	if (status & LOAD) {
 		switch (mode) {
 		case LINE:
@@ -534,7 +685,7 @@ String Inverter::evalLoadSource() {
 			break;
 		}
 	}
-	return "-";
+	return F("-");
 }
 
 void Inverter::evalWarning(JsonArray &array) {
@@ -607,42 +758,129 @@ void Inverter::evalWarning(JsonArray &array) {
  * The goal is to use only PV input, no battery and no grid power.
  */
 void Inverter::calculateMaximumSolarPower() {
-	if (outPowerActive > pvChargingPower + config.pvOutPowerTolerance
-			|| battery.getCurrent() < config.maxBatteryDischargeCurrent || busVoltage < config.minBusVoltage
-			|| pvVoltage < config.minPvVoltage) {
-		if (maxSolarPower >= config.powerAdjustment && maxSolarPower > config.minSolarPower) {
-			maxSolarPower -= config.powerAdjustment;
-		} else {
-			cutoffTime = (cutoffTime > 0 ? cutoffTime : millis());
-			maxSolarPower = 0;
-		}
-	} else if (maxSolarPower == 0 && cutoffTime > 0) {
-		if ((cutoffTime + config.cutoffRetryTime * 1000) < millis() && busVoltage > config.minBusVoltage
-				&& battery.getSOC() > config.cutoffRetryMinBatterySoc * 10) {
-			cutoffTime = 0;
-			maxSolarPower = config.initialSolarPower;
-		}
-	} else if (pvVoltage > config.maxPvVoltage) {
-		if (maxSolarPower < config.maxSolarPower - config.powerAdjustment) {
-			maxSolarPower += config.powerAdjustment;
-		} else {
-			maxSolarPower = config.maxSolarPower;
-		}
-	}
+	PowerController::Settings settings;
+	getControllerSettings(settings);
+
+	PowerController::Sample sample;
+	sample.pvVoltage = pvVoltage;
+	sample.pvPower = pvChargingPower;
+	sample.outPower = outPowerActive;
+	sample.batteryCurrent = battery.getCurrent();
+	sample.busVoltage = busVoltage;
+	sample.batterySoc = battery.getSOC();
+
+	powerController.update(settings, sample, millis());
+}
+
+/**
+ * Copy the controller relevant parameters from the config.
+ */
+void Inverter::getControllerSettings(PowerController::Settings &settings) {
+	settings.mode = (config->powerControllerMode == PowerController::PI ? PowerController::PI : PowerController::Step);
+	settings.initialPower = config->initialSolarPower;
+	settings.minPower = config->minSolarPower;
+	settings.maxPower = config->maxSolarPower;
+	settings.outPowerTolerance = config->pvOutPowerTolerance;
+	settings.adjustment = config->powerAdjustment;
+	settings.maxBatteryDischargeCurrent = config->maxBatteryDischargeCurrent;
+	settings.minBusVoltage = config->minBusVoltage;
+	settings.minPvVoltage = config->minPvVoltage;
+	settings.maxPvVoltage = config->maxPvVoltage;
+	settings.cutoffRetryTime = config->cutoffRetryTime;
+	settings.cutoffRetryMinSoc = config->cutoffRetryMinBatterySoc;
+	settings.kp = config->powerControllerKp;
+	settings.ki = config->powerControllerKi;
+	settings.batteryCurrentWeight = config->powerControllerBatteryWeight;
+	settings.rateLimit = config->powerControllerRateLimit;
 }
 
 /**
  * Return the calculated maximum power to restrict power input to PV (in Watt)
  */
 uint16_t Inverter::getMaximumSolarPower() {
-	return maxSolarPower;
+	return powerController.getPower();
 }
 
 /**
  * Get the maximum applicable solar current in 0.1A
  */
 uint16_t Inverter::getMaximumSolarCurrent() {
-	return maxSolarPower * 10 / (outVoltage > 0 ? outVoltage : 230);
+	return getMaximumSolarPower() * 10 / (outVoltage > 0 ? outVoltage : 230);
+}
+
+/**
+ * Check if the consumer should ignore the maximum solar power (override switch or remote override)
+ */
+bool Inverter::isPowerOverride() {
+	return remotePowerOverride || digitalRead(PIN_POWER_OVERRIDE) == HIGH;
+}
+
+/**
+ * Activate the override like the switch does, e.g. by an energy management system (not persistent).
+ */
+void Inverter::setRemotePowerOverride(bool active) {
+	remotePowerOverride = active;
+}
+
+Inverter::Mode Inverter::getMode() {
+	return mode;
+}
+
+/**
+ * Get the active warnings (see enum Warning)
+ */
+uint32_t Inverter::getWarning() {
+	return warning;
+}
+
+/**
+ * Get the PV input voltage in V
+ */
+float Inverter::getPvVoltage() {
+	return pvVoltage;
+}
+
+/**
+ * Get the PV charging power in W
+ */
+uint16_t Inverter::getPvPower() {
+	return pvChargingPower;
+}
+
+/**
+ * Get the active output power in W
+ */
+uint16_t Inverter::getOutPower() {
+	return outPowerActive;
+}
+
+/**
+ * Get the bus voltage in V
+ */
+uint16_t Inverter::getBusVoltage() {
+	return busVoltage;
+}
+
+/**
+ * Get the error of the PI controller in V (positive = head-room to increase power)
+ */
+float Inverter::getControllerError() {
+	return powerController.getError();
+}
+
+/**
+ * Get the number of processed responses, e.g. to detect if the data changed
+ */
+uint32_t Inverter::getSequence() {
+	return sequence;
+}
+
+/**
+ * Get the number of times the JSON document of toJSON() didn't fit into the arena and
+ * the heap was used.
+ */
+uint32_t Inverter::getJsonFallbacks() {
+	return jsonArena.getFallbacks();
 }
 
 Inverter inverter;
@@ -14,8 +14,15 @@
 #include "CRCUtil.h"
 #include "Config.h"
 #include "Battery.h"
+#include "PowerController.h"
+#include "Histogram.h"
+#include "ArenaAllocator.h"
 
 #define INPUT_BUFFER_SIZE 512
+#define RESPONSE_TIMEOUT 2000 // time to wait for a response before sending the next query (in ms)
+#define STARTUP_DELAY 100 // time after init() until the first query is sent (in ms)
+#define COMMAND_SIZE 20 // maximum length of a command (without CRC and CR)
+#define JSON_ARENA_SIZE 3072 // memory for the JSON document of toJSON() (in bytes)
 
 class Inverter
 {
@@ -83,13 +90,27 @@ public:
     virtual ~Inverter();
     void init();
     void loop();
-    String toJSON();
+    size_t toJSON(char *buffer, size_t size);
+    String latencyToJSON();
     void calculateMaximumSolarPower();
     uint16_t getMaximumSolarPower();
     uint16_t getMaximumSolarCurrent();
+    bool isPowerOverride();
+    void setRemotePowerOverride(bool active);
+    Mode getMode();
+    uint32_t getWarning();
+    float getPvVoltage();
+    uint16_t getPvPower();
+    uint16_t getOutPower();
+    uint16_t getBusVoltage();
+    float getControllerError();
     void switchToGrid();
+    uint32_t getSequence();
+    uint32_t getJsonFallbacks();
 
 private:
+    friend class Benchmark;
+
     enum QueryMode
     {
         STATUS,
@@ -98,8 +119,19 @@ private:
 		IGNORE
     };
 
+    enum Stage
+    {
+        RECEIVED,
+        PARSED,
+        BATTERY_UPDATED,
+        CONTROLLED,
+        PUBLISHED
+    };
+
     void setFloatVoltage(float voltage);
-    void sendCommand(String command);bool readResponse();
+    void sendCommand(const char *command);
+    void sendCommand(const __FlashStringHelper *command);
+    bool readResponse();
     void sendQuery();
     void parseStatusResponse(char *input);
     void parseModeResponse(char *input);
@@ -109,21 +141,25 @@ private:
     uint8_t parseShort();
     uint8_t parseStatus1();
     uint8_t parseStatus2();
-    String evalChargeSource();
-    String evalLoadSource();
+    const __FlashStringHelper *evalChargeSource();
+    const __FlashStringHelper *evalLoadSource();
     void evalWarning(JsonArray &array);
 	void processResponse();
+	void processSample();
+	void recordLatency();
 	bool adjustFloatVoltage();
 	bool overDischargeProtection();
 	bool adjustOutputPrio();
+	void getControllerSettings(PowerController::Settings &settings);
 	double round1(double value);
 	char *getTimeStamp(uint32_t ms);
 
     char input[INPUT_BUFFER_SIZE + 1];
-    char buffer[20];
+    uint16_t inputLength;
+    bool responsePending;
+    char buffer[COMMAND_SIZE];
     uint32_t timestamp;
-    uint32_t cutoffTime;
-    uint16_t maxSolarPower;
+    PowerController powerController;
 
     QueryMode queryMode;
     Mode mode;
@@ -147,9 +183,19 @@ private:
     bool floatOverrideActive;
     bool overDischargeProtectionActive;
     bool inputOverrideActive;
+    bool gridRequested; // switchToGrid() was called, the command is sent with the next housekeeping
+    bool gridSwitchActive; // the output uses the grid until the battery is fully charged
+    bool remotePowerOverride; // set via Modbus, acts like the override switch
     float floatVoltage; // in V
 	char timeStampBuf[30];
+	ArenaAllocator<JSON_ARENA_SIZE> jsonArena; // must be declared before jsonDoc
 	JsonDocument jsonDoc;
+	uint32_t stageTime[PUBLISHED + 1]; // time when a pipeline stage was completed for the last sample (in us)
+	uint32_t maxStageLatency[PUBLISHED + 1]; // worst case duration of each pipeline stage (in us)
+	Histogram latency; // time from last byte received to set-point published (in us)
+	uint32_t firstSampleTime; // time from boot until the first status sample was processed (in ms)
+	uint32_t sequence; // number of processed responses, changes whenever the data of toJSON() changes
+	uint32_t jsonFallbacks; // heap fallbacks of jsonArena already reported
 };
 
 extern Inverter inverter;
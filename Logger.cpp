@@ -13,6 +13,14 @@
  *
  * You can also use pins D7 and D8 (= GPIO 13 / RXD2 or GPIO 15 / TXD2) instead. All you have to do is insert the
  * instruction Serial.swap() after Serial.begin() in the setup.
+ *
+ * Log messages are not written to the serial port directly. They are appended to a ring buffer
+ * in RAM and loop() passes them on to Serial1 only as much as fits into its TX FIFO, so logging
+ * never stalls the program. The ring can also be read remotely (see WebServer, /log).
+ *
+ * With LOG_BINARY, messages are written as binary records holding only a message id, a timestamp
+ * and the raw arguments. This takes a fraction of the CPU time and ring space of text output. The
+ * serial output or /log has to be decoded with tools/logdecode.
  */
 
 void Logger::init() {
@@ -20,14 +28,42 @@ void Logger::init() {
 	logLevel = Debug;
 	debugging = true;
 	msgBuffer = new char[LOG_BUFFER_SIZE];
+	ring = new char[LOG_RING_SIZE];
+	ringHead = 0;
+	ringDrained = 0;
+	dropped = 0;
+}
+
+/**
+ * Send buffered log output to the serial port as far as it can be written without blocking.
+ */
+void Logger::loop() {
+	if (ringHead - ringDrained > LOG_RING_SIZE) { // the oldest data was overwritten already
+		dropped += ringHead - ringDrained - LOG_RING_SIZE;
+		ringDrained = ringHead - LOG_RING_SIZE;
+	}
+
+	while (ringDrained != ringHead) {
+		size_t space = Serial1.availableForWrite();
+		if (space == 0) {
+			break;
+		}
+		uint16_t offset = ringDrained % LOG_RING_SIZE;
+		size_t length = min((size_t) (ringHead - ringDrained), min(space, (size_t) (LOG_RING_SIZE - offset)));
+		Serial1.write((const uint8_t *) ring + offset, length);
+		ringDrained += length;
+	}
 }
 
 /*
  * Output a debug message with a variable amount of parameters.
  * printf() style, see Logger::log()
  *
+ * The format must be located in flash (F() or PSTR()), it is read directly from there without
+ * creating a copy on the heap. Prefer the LOG_DEBUG() macro which skips the call (including the
+ * evaluation of its arguments) if the level is disabled.
  */
-void Logger::debug(String message, ...) {
+void Logger::debug(const __FlashStringHelper *message, ...) {
 	if (logLevel > Debug) {
 		return;
 	}
@@ -42,7 +78,7 @@ void Logger::debug(String message, ...) {
  * Output a info message with a variable amount of parameters
  * printf() style, see Logger::log()
  */
-void Logger::info(String message, ...) {
+void Logger::info(const __FlashStringHelper *message, ...) {
 	if (logLevel > Info) {
 		return;
 	}
@@ -57,7 +93,7 @@ void Logger::info(String message, ...) {
  * Output a warning message with a variable amount of parameters
  * printf() style, see Logger::log()
  */
-void Logger::warn(String message, ...) {
+void Logger::warn(const __FlashStringHelper *message, ...) {
 	if (logLevel > Warn) {
 		return;
 	}
@@ -72,7 +108,7 @@ void Logger::warn(String message, ...) {
  * Output a error message with a variable amount of parameters
  * printf() style, see Logger::log()
  */
-void Logger::error(String message, ...) {
+void Logger::error(const __FlashStringHelper *message, ...) {
 	if (logLevel > Error) {
 		return;
 	}
@@ -87,11 +123,16 @@ void Logger::error(String message, ...) {
  * Output a comnsole message with a variable amount of parameters
  * printf() style, see Logger::logMessage()
  */
-void Logger::console(String message, ...) {
+void Logger::console(const __FlashStringHelper *message, ...) {
 	va_list args;
 	va_start(args, message);
-	vsnprintf(msgBuffer, LOG_BUFFER_SIZE, message.c_str(), args);
-	Serial1.println(msgBuffer);
+	vsnprintf_P(msgBuffer, LOG_BUFFER_SIZE, (PGM_P) message, args);
+#ifdef LOG_BINARY
+	record(Off, 0, msgBuffer);
+#else
+	append(msgBuffer, strlen(msgBuffer));
+	append("\r\n", 2);
+#endif
 	va_end(args);
 }
 
@@ -114,21 +155,124 @@ Logger::LogLevel Logger::getLogLevel() {
  * be logged in the end).
  *
  * Example:
- * if (Logger::isDebug()) {
- *    Logger::debug("current time: %d", millis());
+ * if (logger.isDebug()) {
+ *    logger.debug(F("current time: %d"), millis());
  * }
+ *
+ * The LOG_DEBUG() macro does this automatically.
  */
 boolean Logger::isDebug() {
 	return debugging;
 }
 
+/*
+ * Returns if messages of the given log level are currently written.
+ */
+boolean Logger::isEnabled(LogLevel level) {
+	return level >= logLevel;
+}
+
+/*
+ * Return the current write position in the log (total amount of bytes written so far).
+ */
+uint32_t Logger::getPosition() {
+	return ringHead;
+}
+
+/*
+ * Return the amount of bytes which were overwritten before they could be sent to the serial port.
+ */
+uint32_t Logger::getDropped() {
+	return dropped;
+}
+
+/*
+ * Copy log data from the position (see getPosition()) up to the end position into
+ * the buffer. If the data at the position was overwritten already, it continues with
+ * the oldest available data. The position is advanced by the amount of bytes copied.
+ */
+size_t Logger::read(uint32_t &position, uint32_t end, char *buffer, size_t size) {
+	if (end - position > LOG_RING_SIZE) { // too old or unknown position (e.g. after a reboot)
+		position = (end > LOG_RING_SIZE ? end - LOG_RING_SIZE : 0);
+	}
+	if (ringHead - position > LOG_RING_SIZE) { // overwritten while reading
+		position = ringHead - LOG_RING_SIZE;
+	}
+
+	uint16_t offset = position % LOG_RING_SIZE;
+	size_t length = min((size_t) (end - position), min(size, (size_t) (LOG_RING_SIZE - offset)));
+	memcpy(buffer, ring + offset, length);
+	position += length;
+	return length;
+}
+
+/*
+ * Add data to the ring buffer, overwriting the oldest data if necessary.
+ */
+void Logger::append(const char *data, size_t length) {
+	while (length > 0) {
+		uint16_t offset = ringHead % LOG_RING_SIZE;
+		size_t chunk = min(length, (size_t) (LOG_RING_SIZE - offset));
+		memcpy(ring + offset, data, chunk);
+		ringHead += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+}
+
+/*
+ * Write the header of a binary log record and append it to the ring buffer.
+ *
+ * Layout (little endian): sync/level (1 byte), length of the arguments (1 byte),
+ * message id (4 bytes), timestamp in ms (4 bytes), arguments
+ */
+void Logger::writeRecord(LogLevel level, uint32_t id, uint8_t *data, size_t length) {
+	uint32_t timestamp = millis();
+	data[0] = LOG_RECORD_SYNC | level;
+	data[1] = length - LOG_RECORD_HEADER;
+	memcpy(data + 2, &id, 4);
+	memcpy(data + 6, &timestamp, 4);
+	append((const char *) data, length);
+}
+
+/*
+ * Add a string to a binary log record, it's truncated if it doesn't fit.
+ */
+void Logger::encodeValue(uint8_t *data, size_t &length, const char *value) {
+	if (length >= LOG_RECORD_SIZE) {
+		return;
+	}
+	size_t size = strnlen(value, LOG_RECORD_SIZE - length - 1);
+	memcpy(data + length, value, size);
+	data[length + size] = 0;
+	length += size + 1;
+}
+
+/*
+ * Add a string located in flash to a binary log record, it's truncated if it doesn't fit.
+ */
+void Logger::encodeValue(uint8_t *data, size_t &length, const __FlashStringHelper *value) {
+	if (length >= LOG_RECORD_SIZE) {
+		return;
+	}
+	size_t size = strnlen_P((PGM_P) value, LOG_RECORD_SIZE - length - 1);
+	memcpy_P(data + length, value, size);
+	data[length + size] = 0;
+	length += size + 1;
+}
+
 /*
  * Output a log message (called by debug(), info(), warn(), error(), console())
  *
- * Supports printf() syntax
+ * Supports printf() syntax. With LOG_BINARY the formatted text is written as a
+ * binary record with message id 0.
  */
-void Logger::log(LogLevel level, String format, va_list args) {
-	String logLevel;
+void Logger::log(LogLevel level, const __FlashStringHelper *format, va_list args) {
+#ifdef LOG_BINARY
+	vsnprintf_P(msgBuffer, LOG_BUFFER_SIZE, (PGM_P) format, args);
+	record(level, 0, msgBuffer);
+#else
+	const __FlashStringHelper *logLevel;
 
 	switch (level) {
 	case Info:
@@ -144,14 +288,15 @@ void Logger::log(LogLevel level, String format, va_list args) {
 		logLevel = F("DEBUG");
 		break;
 	}
-	vsnprintf(msgBuffer, LOG_BUFFER_SIZE, format.c_str(), args);
-
-	// print to serial
-	Serial1.print(millis());
-	Serial1.print(F(" - "));
-	Serial1.print(logLevel);
-	Serial1.print(F(": "));
-	Serial1.println(msgBuffer);
+
+	int length = snprintf_P(msgBuffer, LOG_BUFFER_SIZE, PSTR("%lu - %S: "), millis(), logLevel);
+	append(msgBuffer, length);
+	length = vsnprintf_P(msgBuffer, LOG_BUFFER_SIZE, (PGM_P) format, args);
+	if (length > 0) {
+		append(msgBuffer, min(length, LOG_BUFFER_SIZE - 1));
+	}
+	append("\r\n", 2);
+#endif
 }
 
 Logger logger;
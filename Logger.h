@@ -10,9 +10,25 @@
 #define LOGGER_H_
 
 #include <Arduino.h>
+#include <type_traits>
 #include "Config.h"
 
 #define LOG_BUFFER_SIZE 160
+#define LOG_RING_SIZE 4096 // RAM buffer holding the most recent log output
+
+// minimum log level compiled into the firmware (0 = debug, 1 = info, 2 = warn, 3 = error, 4 = off),
+// can be overridden with a compiler flag e.g. -DLOG_LEVEL_MIN=1 for release builds
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN 0
+#endif
+
+// uncomment (or use the compiler flag -DLOG_BINARY) to write compact binary log records instead of text,
+// they have to be decoded with tools/logdecode
+//#define LOG_BINARY
+
+#define LOG_RECORD_SIZE 64 // maximum size of a binary log record (incl. header)
+#define LOG_RECORD_HEADER 10 // sync/level, length of arguments, message id, timestamp
+#define LOG_RECORD_SYNC 0xF0 // upper nibble of the first byte of a record, the lower nibble holds the level
 
 // route logging output to Serial/USB/UART0 if debug is enabled - will not work with attached inverter
 #ifdef DEBUG_LOG
@@ -31,22 +47,133 @@ public:
         Off = 4
     };
     void init();
-    void debug(String, ...);
-    void info(String, ...);
-    void warn(String, ...);
-    void error(String, ...);
-    void console(String, ...);
+    void loop();
+    void debug(const __FlashStringHelper *, ...);
+    void info(const __FlashStringHelper *, ...);
+    void warn(const __FlashStringHelper *, ...);
+    void error(const __FlashStringHelper *, ...);
+    void console(const __FlashStringHelper *, ...);
     void setLoglevel(LogLevel);
     LogLevel getLogLevel();
     boolean isDebug();
+    boolean isEnabled(LogLevel);
+    uint32_t getPosition();
+    uint32_t getDropped();
+    size_t read(uint32_t &position, uint32_t end, char *buffer, size_t size);
+
+    /*
+     * Write a binary log record: the id of the message (see logMessageId()) and the raw arguments.
+     * Integers are stored as 4 bytes, floating point values as float and strings null terminated.
+     */
+    template<typename ... Args>
+    void record(LogLevel level, uint32_t id, Args ... args) {
+        uint8_t data[LOG_RECORD_SIZE];
+        size_t length = LOG_RECORD_HEADER;
+        encode(data, length, args...);
+        writeRecord(level, id, data, length);
+    }
 private:
     LogLevel logLevel;
     bool debugging;
     char *msgBuffer;
+    char *ring;
+    uint32_t ringHead; // total amount of bytes written to the ring
+    uint32_t ringDrained; // total amount of bytes sent to the serial port
+    uint32_t dropped; // amount of bytes overwritten before they could be sent
+
+    void log(LogLevel, const __FlashStringHelper *format, va_list);
+    void append(const char *data, size_t length);
+    void writeRecord(LogLevel level, uint32_t id, uint8_t *data, size_t length);
+    void encodeValue(uint8_t *data, size_t &length, const char *value);
+    void encodeValue(uint8_t *data, size_t &length, const __FlashStringHelper *value);
+
+    void encode(uint8_t *, size_t &) {
+    }
+
+    template<typename T, typename ... Args>
+    void encode(uint8_t *data, size_t &length, T value, Args ... args) {
+        encodeValue(data, length, value);
+        encode(data, length, args...);
+    }
 
-    void log(LogLevel, String format, va_list);
+    void encodeValue(uint8_t *data, size_t &length, char *value) {
+        encodeValue(data, length, (const char *) value);
+    }
+
+    void encodeValue(uint8_t *data, size_t &length, float value) {
+        if (length + 4 > LOG_RECORD_SIZE) {
+            return;
+        }
+        memcpy(data + length, &value, 4);
+        length += 4;
+    }
+
+    void encodeValue(uint8_t *data, size_t &length, double value) {
+        encodeValue(data, length, (float) value);
+    }
+
+    template<typename T>
+    void encodeValue(uint8_t *data, size_t &length, T value) {
+        if (length + 4 > LOG_RECORD_SIZE) {
+            return;
+        }
+        uint32_t number = (uint32_t) value;
+        memcpy(data + length, &number, 4);
+        length += 4;
+    }
 };
 
+/*
+ * FNV-1a hash of a log format, identifies the message in binary log records.
+ * Must match the calculation in tools/logdecode.
+ */
+constexpr uint32_t logMessageId(const char *format, uint32_t hash = 2166136261UL) {
+    return *format ? logMessageId(format + 1, (uint32_t) ((hash ^ (uint8_t) *format) * 16777619UL)) : hash;
+}
+
 extern Logger logger;
 
+/*
+ * Logging macros, use them instead of calling the Logger directly. The format has to be a
+ * string literal, it's placed in flash automatically.
+ *
+ * Calls below LOG_LEVEL_MIN are removed by the compiler, the remaining ones check the log
+ * level before the arguments are evaluated. So a suppressed call costs no heap and hardly
+ * any CPU - but don't pass arguments with side effects.
+ *
+ * Example: LOG_INFO("battery soc: %d%%", soc);
+ *
+ * With LOG_BINARY only the hash of the format is compiled into the firmware, the
+ * formatting is done by tools/logdecode.
+ */
+#ifdef LOG_BINARY
+#define LOG_WRITE(method, level, format, ...) logger.record(level, std::integral_constant<uint32_t, logMessageId(format)>::value, ##__VA_ARGS__)
+#else
+#define LOG_WRITE(method, level, format, ...) logger.method(F(format), ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL_MIN <= 0
+#define LOG_DEBUG(format, ...) do { if (logger.isDebug()) LOG_WRITE(debug, Logger::Debug, format, ##__VA_ARGS__); } while (0)
+#else
+#define LOG_DEBUG(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL_MIN <= 1
+#define LOG_INFO(format, ...) do { if (logger.isEnabled(Logger::Info)) LOG_WRITE(info, Logger::Info, format, ##__VA_ARGS__); } while (0)
+#else
+#define LOG_INFO(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL_MIN <= 2
+#define LOG_WARN(format, ...) do { if (logger.isEnabled(Logger::Warn)) LOG_WRITE(warn, Logger::Warn, format, ##__VA_ARGS__); } while (0)
+#else
+#define LOG_WARN(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL_MIN <= 3
+#define LOG_ERROR(format, ...) do { if (logger.isEnabled(Logger::Error)) LOG_WRITE(error, Logger::Error, format, ##__VA_ARGS__); } while (0)
+#else
+#define LOG_ERROR(format, ...) do { } while (0)
+#endif
+
 #endif /* LOGGER_H_ */
@@ -0,0 +1,175 @@
+/*
+ * Modbus.cpp
+ *
+ * A Modbus TCP server for PLCs and energy management systems (see the register map in
+ * Modbus.h). The registers are a snapshot which is updated once per status sample, requests
+ * are answered from it without touching the inverter or battery objects.
+ *
+ * Requests are read without blocking, multiple (pipelined) requests per connection are
+ * answered in order. Up to MODBUS_MAX_CLIENTS connections are served, further connections
+ * are refused.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Modbus.h"
+#include "Inverter.h"
+#include "Battery.h"
+
+/**
+ * Constructor
+ */
+Modbus::Modbus() :
+		server(502),
+		handler(inputRegisters, INPUT_REGISTER_COUNT, holdingRegisters, HOLDING_REGISTER_COUNT, writeRegister) {
+	started = false;
+	sequence = 0;
+	memset(inputRegisters, 0, sizeof(inputRegisters));
+	memset(holdingRegisters, 0, sizeof(holdingRegisters));
+	for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+		connections[i].length = 0;
+		connections[i].lastActivity = 0;
+	}
+}
+
+Modbus::~Modbus() {
+}
+
+/**
+ * Start the server if enabled.
+ */
+void Modbus::init() {
+	if (!config->modbusEnabled) {
+		return;
+	}
+	server.begin(config->modbusPort);
+	server.setNoDelay(true);
+	started = true;
+	LOG_INFO("started modbus server on port %d", config->modbusPort);
+}
+
+/**
+ * Accept new connections and answer the received requests.
+ */
+void Modbus::loop() {
+	if (!started) {
+		return;
+	}
+
+	uint32_t now = millis();
+	accept();
+	for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+		service(connections[i], now);
+	}
+}
+
+/**
+ * Copy the values of the current sample to the input registers, called for every status sample.
+ */
+void Modbus::update() {
+	bool override = inverter.isPowerOverride();
+	uint32_t warning = inverter.getWarning();
+
+	sequence++;
+	inputRegisters[MAX_CURRENT] = override ? 0xffff : inverter.getMaximumSolarCurrent();
+	inputRegisters[MAX_POWER] = inverter.getMaximumSolarPower();
+	inputRegisters[OVERRIDE] = override;
+	inputRegisters[MODE] = inverter.getMode();
+	inputRegisters[WARNING_HIGH] = warning >> 16;
+	inputRegisters[WARNING_LOW] = warning & 0xffff;
+	inputRegisters[PV_VOLTAGE] = inverter.getPvVoltage() * 10 + 0.5f;
+	inputRegisters[PV_POWER] = inverter.getPvPower();
+	inputRegisters[OUT_POWER] = inverter.getOutPower();
+	inputRegisters[BUS_VOLTAGE] = inverter.getBusVoltage();
+	inputRegisters[BATTERY_VOLTAGE] = battery.getVoltage() * 100 + 0.5f;
+	inputRegisters[BATTERY_CURRENT] = (uint16_t) battery.getCurrent();
+	inputRegisters[SOC] = battery.getSOC();
+	inputRegisters[CONTROLLER_ERROR] = (uint16_t) (int16_t) constrain(inverter.getControllerError() * 100, -32768, 32767);
+	inputRegisters[SEQUENCE_HIGH] = sequence >> 16;
+	inputRegisters[SEQUENCE_LOW] = sequence & 0xffff;
+}
+
+/**
+ * Take over a new connection if a slot is free, otherwise refuse it.
+ */
+void Modbus::accept() {
+	WiFiClient client = server.accept();
+	if (!client) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+		if (!connections[i].client.connected()) {
+			connections[i].client = client;
+			connections[i].length = 0;
+			connections[i].lastActivity = millis();
+			return;
+		}
+	}
+	LOG_WARN("modbus connection from %s refused, too many clients", client.remoteIP().toString().c_str());
+	client.stop();
+}
+
+/**
+ * Read the available data of a connection and answer all complete requests.
+ */
+void Modbus::service(Connection &connection, uint32_t now) {
+	if (!connection.client.connected()) {
+		return;
+	}
+	if (now - connection.lastActivity > MODBUS_IDLE_TIMEOUT) {
+		connection.client.stop();
+		return;
+	}
+
+	if (connection.client.available() > 0) {
+		int length = connection.client.read(connection.buffer + connection.length, MODBUS_FRAME_SIZE - connection.length);
+		if (length <= 0) {
+			return;
+		}
+		connection.length += length;
+		connection.lastActivity = now;
+	}
+
+	while (true) {
+		size_t frameLength = ModbusHandler::getFrameLength(connection.buffer, connection.length);
+		if (frameLength == 0 || (frameLength <= MODBUS_FRAME_SIZE && frameLength > connection.length)) {
+			return; // wait for more data
+		}
+
+		size_t responseLength = handler.process(connection.buffer, frameLength, response);
+		if (responseLength == 0) {
+			LOG_WARN("invalid modbus request, closing connection");
+			connection.client.stop();
+			connection.length = 0;
+			return;
+		}
+		connection.client.write(response, responseLength);
+
+		connection.length -= frameLength;
+		memmove(connection.buffer, connection.buffer + frameLength, connection.length);
+	}
+}
+
+/**
+ * Called by the handler for every written holding register, returns false to reject the value.
+ */
+bool Modbus::writeRegister(uint16_t address, uint16_t value) {
+	if (!config->modbusWrite) {
+		return false;
+	}
+
+	switch (address) {
+	case REMOTE_OVERRIDE:
+		if (value > 1) {
+			return false;
+		}
+		LOG_INFO("modbus: remote override %d", value);
+		inverter.setRemotePowerOverride(value == 1);
+		return true;
+	}
+	return false;
+}
+
+Modbus modbus;
@@ -0,0 +1,88 @@
+/*
+ * Modbus.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef MODBUS_H_
+#define MODBUS_H_
+
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include "Logger.h"
+#include "Config.h"
+#include "ModbusHandler.h"
+
+#define MODBUS_MAX_CLIENTS 2 // maximum number of simultaneous connections
+#define MODBUS_IDLE_TIMEOUT 60000 // time after which an idle connection is closed (in ms)
+
+class Modbus
+{
+public:
+    /*
+     * The input registers (function 4), updated with every status sample.
+     */
+    enum InputRegister
+    {
+        MAX_CURRENT = 0, // maximum solar current (in 0.1A, 65535 if the override is active)
+        MAX_POWER = 1, // maximum solar power (in W)
+        OVERRIDE = 2, // 1 if the override switch or the remote override is active
+        MODE = 3, // the mode of the inverter (see Inverter::Mode)
+        WARNING_HIGH = 4, // the active warnings, upper 16 bits (see Inverter::Warning)
+        WARNING_LOW = 5, // the active warnings, lower 16 bits
+        PV_VOLTAGE = 6, // in 0.1V
+        PV_POWER = 7, // in W
+        OUT_POWER = 8, // in W
+        BUS_VOLTAGE = 9, // in V
+        BATTERY_VOLTAGE = 10, // in 0.01V
+        BATTERY_CURRENT = 11, // in A, signed, negative = discharge
+        SOC = 12, // in 0.1%
+        CONTROLLER_ERROR = 13, // error of the PI controller (in 0.01V, signed)
+        SEQUENCE_HIGH = 14, // number of the sample, upper 16 bits
+        SEQUENCE_LOW = 15, // number of the sample, lower 16 bits
+        INPUT_REGISTER_COUNT
+    };
+
+    /*
+     * The holding registers (function 3, 6 and 16), writable if modbus.write is enabled.
+     */
+    enum HoldingRegister
+    {
+        REMOTE_OVERRIDE = 0, // 1 = the consumer may ignore the maximum solar current, like the override switch
+        HOLDING_REGISTER_COUNT
+    };
+
+    Modbus();
+    virtual ~Modbus();
+    void init();
+    void loop();
+    void update();
+
+private:
+    struct Connection
+    {
+        WiFiClient client;
+        uint8_t buffer[MODBUS_FRAME_SIZE];
+        size_t length; // number of bytes in buffer
+        uint32_t lastActivity; // in ms
+    };
+
+    void accept();
+    void service(Connection &connection, uint32_t now);
+    static bool writeRegister(uint16_t address, uint16_t value);
+
+    WiFiServer server;
+    bool started;
+    uint16_t inputRegisters[INPUT_REGISTER_COUNT];
+    uint16_t holdingRegisters[HOLDING_REGISTER_COUNT];
+    ModbusHandler handler;
+    Connection connections[MODBUS_MAX_CLIENTS];
+    uint8_t response[MODBUS_FRAME_SIZE];
+    uint32_t sequence;
+};
+
+extern Modbus modbus;
+
+#endif /* MODBUS_H_ */
@@ -0,0 +1,157 @@
+/*
+ * ModbusHandler.cpp
+ *
+ * Processes Modbus TCP requests against a register image. Supported are the functions
+ * read holding registers (3), read input registers (4), write single register (6) and
+ * write multiple registers (16). The registers are plain arrays owned by the caller, so
+ * a read is a copy of the requested range and takes no time regardless of what the
+ * registers represent.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <string.h>
+#include "ModbusHandler.h"
+
+#define MAX_READ_COUNT 125 // maximum number of registers per read request
+#define MAX_WRITE_COUNT 123 // maximum number of registers per write request
+
+/**
+ * Constructor, the callback is invoked for every written holding register and may
+ * reject the value by returning false (optional).
+ */
+ModbusHandler::ModbusHandler(const uint16_t *inputRegisters, uint16_t inputCount, uint16_t *holdingRegisters,
+		uint16_t holdingCount, WriteCallback callback) {
+	this->inputRegisters = inputRegisters;
+	this->inputCount = inputCount;
+	this->holdingRegisters = holdingRegisters;
+	this->holdingCount = holdingCount;
+	this->callback = callback;
+}
+
+ModbusHandler::~ModbusHandler() {
+}
+
+/**
+ * Returns the size of the frame at the start of data, 0 if the header is incomplete.
+ * The frame is complete if the returned size is <= length.
+ */
+size_t ModbusHandler::getFrameLength(const uint8_t *data, size_t length) {
+	if (length < MODBUS_HEADER_SIZE) {
+		return 0;
+	}
+	return 6 + ((data[4] << 8) | data[5]);
+}
+
+/**
+ * Process a complete request frame and write the response frame (max MODBUS_FRAME_SIZE).
+ * Returns the size of the response or 0 if the request is not a Modbus frame and the
+ * connection should be closed.
+ */
+size_t ModbusHandler::process(const uint8_t *request, size_t length, uint8_t *response) {
+	if (length < MODBUS_HEADER_SIZE + 1 || length > MODBUS_FRAME_SIZE || request[2] != 0 || request[3] != 0
+			|| getFrameLength(request, length) != length) {
+		return 0;
+	}
+
+	const uint8_t *pdu = request + MODBUS_HEADER_SIZE;
+	size_t pduLength = length - MODBUS_HEADER_SIZE;
+	uint8_t *responsePdu = response + MODBUS_HEADER_SIZE;
+	uint16_t address = (pduLength >= 5 ? (pdu[1] << 8) | pdu[2] : 0);
+	uint16_t count = (pduLength >= 5 ? (pdu[3] << 8) | pdu[4] : 0);
+	size_t responseLength;
+
+	responsePdu[0] = pdu[0];
+	switch (pdu[0]) {
+	case READ_HOLDING_REGISTERS:
+		responseLength = readRegisters(holdingRegisters, holdingCount, pdu, pduLength, responsePdu);
+		break;
+	case READ_INPUT_REGISTERS:
+		responseLength = readRegisters(inputRegisters, inputCount, pdu, pduLength, responsePdu);
+		break;
+	case WRITE_SINGLE_REGISTER:
+		if (pduLength != 5) {
+			responseLength = exception(ILLEGAL_DATA_VALUE, responsePdu);
+			break;
+		}
+		responseLength = writeRegisters(address, 1, pdu + 3, responsePdu);
+		if (responseLength == 5) {
+			memcpy(responsePdu, pdu, 5);
+			responseLength = 5;
+		}
+		break;
+	case WRITE_MULTIPLE_REGISTERS:
+		if (pduLength < 6 || count == 0 || count > MAX_WRITE_COUNT || pdu[5] != count * 2
+				|| pduLength != 6 + count * 2U) {
+			responseLength = exception(ILLEGAL_DATA_VALUE, responsePdu);
+			break;
+		}
+		responseLength = writeRegisters(address, count, pdu + 6, responsePdu);
+		break;
+	default:
+		responseLength = exception(ILLEGAL_FUNCTION, responsePdu);
+		break;
+	}
+
+	memcpy(response, request, 4); // transaction and protocol id
+	response[4] = (responseLength + 1) >> 8;
+	response[5] = (responseLength + 1) & 0xff;
+	response[6] = request[6]; // unit id
+	return MODBUS_HEADER_SIZE + responseLength;
+}
+
+/**
+ * Copy the requested range of registers to the response.
+ */
+size_t ModbusHandler::readRegisters(const uint16_t *registers, uint16_t registerCount, const uint8_t *pdu,
+		size_t length, uint8_t *response) {
+	if (length != 5) {
+		return exception(ILLEGAL_DATA_VALUE, response);
+	}
+	uint16_t address = (pdu[1] << 8) | pdu[2];
+	uint16_t count = (pdu[3] << 8) | pdu[4];
+	if (count == 0 || count > MAX_READ_COUNT) {
+		return exception(ILLEGAL_DATA_VALUE, response);
+	}
+	if ((uint32_t) address + count > registerCount) {
+		return exception(ILLEGAL_DATA_ADDRESS, response);
+	}
+
+	response[1] = count * 2;
+	for (uint16_t i = 0; i < count; i++) {
+		response[2 + i * 2] = registers[address + i] >> 8;
+		response[3 + i * 2] = registers[address + i] & 0xff;
+	}
+	return 2 + count * 2;
+}
+
+/**
+ * Write the values (big endian) to the holding registers, stops at the first value
+ * rejected by the callback.
+ */
+size_t ModbusHandler::writeRegisters(uint16_t address, uint16_t count, const uint8_t *values, uint8_t *response) {
+	if ((uint32_t) address + count > holdingCount) {
+		return exception(ILLEGAL_DATA_ADDRESS, response);
+	}
+
+	for (uint16_t i = 0; i < count; i++) {
+		uint16_t value = (values[i * 2] << 8) | values[i * 2 + 1];
+		if (callback != NULL && !callback(address + i, value)) {
+			return exception(ILLEGAL_DATA_VALUE, response);
+		}
+		holdingRegisters[address + i] = value;
+	}
+
+	response[1] = address >> 8;
+	response[2] = address & 0xff;
+	response[3] = count >> 8;
+	response[4] = count & 0xff;
+	return 5;
+}
+
+size_t ModbusHandler::exception(uint8_t exceptionCode, uint8_t *response) {
+	response[0] |= 0x80;
+	response[1] = exceptionCode;
+	return 2;
+}
@@ -0,0 +1,59 @@
+/*
+ * ModbusHandler.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef MODBUSHANDLER_H_
+#define MODBUSHANDLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MODBUS_FRAME_SIZE 260 // maximum size of a Modbus TCP frame (MBAP header + PDU)
+#define MODBUS_HEADER_SIZE 7 // size of the MBAP header
+
+/*
+ * Processes Modbus TCP requests, tools/modbustest runs it as a server on the host.
+ */
+class ModbusHandler
+{
+public:
+    typedef bool (*WriteCallback)(uint16_t address, uint16_t value);
+
+    enum Exception
+    {
+        ILLEGAL_FUNCTION = 1,
+        ILLEGAL_DATA_ADDRESS = 2,
+        ILLEGAL_DATA_VALUE = 3
+    };
+
+    ModbusHandler(const uint16_t *inputRegisters, uint16_t inputCount, uint16_t *holdingRegisters,
+            uint16_t holdingCount, WriteCallback callback);
+    virtual ~ModbusHandler();
+    static size_t getFrameLength(const uint8_t *data, size_t length);
+    size_t process(const uint8_t *request, size_t length, uint8_t *response);
+
+private:
+    enum Function
+    {
+        READ_HOLDING_REGISTERS = 3,
+        READ_INPUT_REGISTERS = 4,
+        WRITE_SINGLE_REGISTER = 6,
+        WRITE_MULTIPLE_REGISTERS = 16
+    };
+
+    size_t readRegisters(const uint16_t *registers, uint16_t registerCount, const uint8_t *pdu, size_t length,
+            uint8_t *response);
+    size_t writeRegisters(uint16_t address, uint16_t count, const uint8_t *values, uint8_t *response);
+    size_t exception(uint8_t exceptionCode, uint8_t *response);
+
+    const uint16_t *inputRegisters;
+    uint16_t inputCount;
+    uint16_t *holdingRegisters;
+    uint16_t holdingCount;
+    WriteCallback callback;
+};
+
+#endif /* MODBUSHANDLER_H_ */
@@ -0,0 +1,251 @@
+/*
+ * Mqtt.cpp
+ *
+ * Publishes the values of every status sample to an MQTT broker, so home automation systems
+ * don't have to poll /data.
+ *
+ * Per default every value has its own topic below the configured base topic (e.g. solar/pvPower)
+ * and is only published if it changed. With mqtt.batch all values are published together as
+ * one JSON payload (the same as the telemetry datagram) to <topic>/state on every sample.
+ * <topic>/maxCurrent (in 0.1A, 65535 if the override switch is active) is always published
+ * retained, so a consumer gets the current set-point immediately after subscribing.
+ * <topic>/online is "true" while connected, the broker sets it to "false" (last will) if the
+ * connection is lost.
+ *
+ * With mqtt.commands enabled, the payload "switchToGrid" on <topic>/command switches the
+ * output of the inverter to the grid until the battery is fully charged, like POST /grid.
+ *
+ * Only QoS 0 is used and nothing waits for the broker: the host name is resolved and the TCP
+ * connection established in the background (see TcpConnection), loop() polls the state. An
+ * attempt which isn't complete after MQTT_RESOLVE_TIMEOUT + MQTT_CONNECT_TIMEOUT fails. Failed
+ * attempts are repeated with an exponential backoff.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Mqtt.h"
+#include "Inverter.h"
+#include "Battery.h"
+#include "Telemetry.h"
+#include "StringView.h"
+
+/**
+ * Constructor
+ */
+Mqtt::Mqtt() : client(connection) {
+	online = false;
+	opening = false;
+	connecting = false;
+	nextConnectionAttempt = 0;
+	failedAttempts = 0;
+	brokerHost[0] = 0;
+	memset(lastValues, 0, sizeof(lastValues));
+}
+
+Mqtt::~Mqtt() {
+}
+
+/**
+ * Maintain the connection to the broker and process incoming messages.
+ */
+void Mqtt::loop() {
+	uint32_t now = millis();
+
+	if (strcmp(brokerHost, config->mqttHost) != 0) { // the broker changed, start over
+		if (online || opening || connecting) {
+			client.disconnect();
+			online = false;
+			opening = false;
+			connecting = false;
+		}
+		strcpy(brokerHost, config->mqttHost);
+		failedAttempts = 0;
+		nextConnectionAttempt = now;
+	}
+	if (brokerHost[0] == 0) {
+		return;
+	}
+
+	if (opening) {
+		switch (connection.getState(now)) {
+		case TcpConnection::RESOLVING:
+		case TcpConnection::CONNECTING:
+			break;
+		case TcpConnection::READY:
+			opening = false;
+			sendConnect(now);
+			break;
+		default:
+			LOG_WARN("unable to connect to MQTT broker %s:%d", brokerHost, config->mqttPort);
+			disconnected(now);
+			break;
+		}
+	} else if (online || connecting) {
+		if (!client.loop(now)) {
+			disconnected(now);
+		} else if (connecting && client.isConnected()) {
+			connected();
+		}
+	} else if ((int32_t) (now - nextConnectionAttempt) >= 0 && (WiFi.isConnected() || WiFi.softAPgetStationNum() > 0)) {
+		connect();
+	}
+}
+
+/**
+ * Publish the values of the current sample, called for every status sample.
+ */
+void Mqtt::publish() {
+	if (!online) {
+		return;
+	}
+
+	if (config->mqttBatch) {
+		bool override = inverter.isPowerOverride();
+		publishValue(MAX_CURRENT, F("maxCurrent"), true, PSTR("%u"), override ? 0xffff : inverter.getMaximumSolarCurrent());
+
+		char topic[MQTT_TOPIC_SIZE];
+		char payload[TELEMETRY_PAYLOAD_SIZE];
+		formatTopic(topic, F("state"));
+		telemetry.toJSON(payload, sizeof(payload));
+		client.publish(topic, payload, false);
+	} else {
+		publishValues();
+	}
+}
+
+/**
+ * Start to resolve the broker and to open the TCP connection, loop() sends the CONNECT packet
+ * once it's established.
+ */
+void Mqtt::connect() {
+	connection.begin(brokerHost, config->mqttPort, true, MQTT_RESOLVE_TIMEOUT + MQTT_CONNECT_TIMEOUT);
+	opening = true;
+}
+
+/**
+ * Send the CONNECT packet, the answer is processed in loop().
+ */
+void Mqtt::sendConnect(uint32_t now) {
+	char clientId[CONFIG_NAME_SIZE + 8];
+	char willTopic[MQTT_TOPIC_SIZE];
+	snprintf_P(clientId, sizeof(clientId), PSTR("%s-%06x"), config->wifiHostname, ESP.getChipId());
+	formatTopic(willTopic, F("online"));
+	client.setCallback(processMessage);
+	if (!client.connect(clientId, config->mqttUser, config->mqttPassword, willTopic, "false", config->mqttKeepAlive, now)) {
+		disconnected(now);
+		return;
+	}
+	connecting = true;
+}
+
+/**
+ * The broker accepted the connection, announce we're online and subscribe to the commands.
+ */
+void Mqtt::connected() {
+	char topic[MQTT_TOPIC_SIZE];
+
+	LOG_INFO("connected to MQTT broker %s:%d", config->mqttHost, config->mqttPort);
+	connecting = false;
+	online = true;
+	failedAttempts = 0;
+	memset(lastValues, 0, sizeof(lastValues)); // publish all values again
+
+	formatTopic(topic, F("online"));
+	client.publish(topic, "true", true);
+	if (config->mqttCommands) {
+		formatTopic(topic, F("command"));
+		client.subscribe(topic);
+	}
+}
+
+/**
+ * The connection failed or was lost, schedule the next attempt.
+ */
+void Mqtt::disconnected(uint32_t now) {
+	if (online) {
+		LOG_WARN("lost connection to MQTT broker");
+	}
+	client.disconnect();
+	online = false;
+	opening = false;
+	connecting = false;
+	if (failedAttempts < 0xff) {
+		failedAttempts++;
+	}
+	nextConnectionAttempt = now + getBackoff();
+}
+
+/**
+ * Calculate the time until the next connection attempt: doubled after every failed attempt
+ * up to MQTT_RECONNECT_MAX_INTERVAL with a random jitter of +-25%.
+ */
+uint32_t Mqtt::getBackoff() {
+	uint32_t interval = MQTT_RECONNECT_MIN_INTERVAL;
+	for (uint8_t i = 1; i < failedAttempts && interval < MQTT_RECONNECT_MAX_INTERVAL; i++) {
+		interval *= 2;
+	}
+	interval = min(interval, (uint32_t) MQTT_RECONNECT_MAX_INTERVAL);
+	return interval + random(-(int32_t) interval / 4, interval / 4);
+}
+
+/**
+ * Publish every value which changed since it was last published to its own topic.
+ */
+void Mqtt::publishValues() {
+	bool override = inverter.isPowerOverride();
+
+	publishValue(MAX_CURRENT, F("maxCurrent"), true, PSTR("%u"), override ? 0xffff : inverter.getMaximumSolarCurrent());
+	publishValue(MAX_POWER, F("maxPower"), false, PSTR("%u"), inverter.getMaximumSolarPower());
+	publishValue(OVERRIDE, F("override"), false, override ? PSTR("true") : PSTR("false"));
+	publishValue(PV_VOLTAGE, F("pvVoltage"), false, PSTR("%.1f"), inverter.getPvVoltage());
+	publishValue(PV_POWER, F("pvPower"), false, PSTR("%u"), inverter.getPvPower());
+	publishValue(OUT_POWER, F("outPower"), false, PSTR("%u"), inverter.getOutPower());
+	publishValue(BATTERY_VOLTAGE, F("batteryVoltage"), false, PSTR("%.2f"), battery.getVoltage());
+	publishValue(BATTERY_CURRENT, F("batteryCurrent"), false, PSTR("%d"), battery.getCurrent());
+	publishValue(SOC, F("soc"), false, PSTR("%u"), battery.getSOC());
+	publishValue(MODE, F("mode"), false, PSTR("%d"), inverter.getMode());
+	publishValue(WARNING, F("warning"), false, PSTR("%lu"), inverter.getWarning());
+}
+
+/**
+ * Format the value and publish it to <topic>/<name> if it differs from the last published one.
+ */
+void Mqtt::publishValue(Value index, const __FlashStringHelper *name, bool retain, const char *format, ...) {
+	char value[MQTT_VALUE_SIZE];
+	va_list args;
+	va_start(args, format);
+	vsnprintf_P(value, sizeof(value), format, args);
+	va_end(args);
+
+	if (strcmp(value, lastValues[index]) == 0) {
+		return;
+	}
+
+	char topic[MQTT_TOPIC_SIZE];
+	formatTopic(topic, name);
+	if (client.publish(topic, value, retain)) {
+		strcpy(lastValues[index], value);
+	}
+}
+
+void Mqtt::formatTopic(char *topic, const __FlashStringHelper *name) {
+	snprintf_P(topic, MQTT_TOPIC_SIZE, PSTR("%s/%S"), config->mqttTopic, name);
+}
+
+/**
+ * Handle a message on the command topic (the only one subscribed to).
+ */
+void Mqtt::processMessage(const char *topic, const uint8_t *payload, size_t length) {
+	if (!config->mqttCommands) {
+		return;
+	}
+	if (StringView((const char *) payload, length).equals(F("switchToGrid"))) {
+		LOG_INFO("MQTT command: switch to grid");
+		inverter.switchToGrid();
+	} else {
+		LOG_WARN("unknown MQTT command on %s", topic);
+	}
+}
+
+Mqtt mqtt;
@@ -0,0 +1,72 @@
+/*
+ * Mqtt.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef MQTT_H_
+#define MQTT_H_
+
+#include <ESP8266WiFi.h>
+#include "Logger.h"
+#include "Config.h"
+#include "MqttClient.h"
+#include "TcpConnection.h"
+
+#define MQTT_CONNECT_TIMEOUT 500 // max time allowed for the TCP connection to the broker (in ms)
+#define MQTT_RESOLVE_TIMEOUT 1000 // max time allowed for the DNS lookup of the broker (in ms)
+#define MQTT_RECONNECT_MIN_INTERVAL 1000 // backoff after the first failed connection attempt (in ms)
+#define MQTT_RECONNECT_MAX_INTERVAL 60000 // upper limit of the backoff between connection attempts (in ms)
+#define MQTT_TOPIC_SIZE 64 // maximum length of a topic + 1
+#define MQTT_VALUE_SIZE 12 // maximum length of a single value + 1
+
+class Mqtt
+{
+public:
+    Mqtt();
+    virtual ~Mqtt();
+    void loop();
+    void publish();
+
+private:
+    enum Value
+    {
+        MAX_CURRENT,
+        MAX_POWER,
+        OVERRIDE,
+        PV_VOLTAGE,
+        PV_POWER,
+        OUT_POWER,
+        BATTERY_VOLTAGE,
+        BATTERY_CURRENT,
+        SOC,
+        MODE,
+        WARNING,
+        VALUE_COUNT
+    };
+
+    void connect();
+    void sendConnect(uint32_t now);
+    void connected();
+    void disconnected(uint32_t now);
+    uint32_t getBackoff();
+    void publishValues();
+    void publishValue(Value index, const __FlashStringHelper *name, bool retain, const char *format, ...);
+    void formatTopic(char *topic, const __FlashStringHelper *name);
+    static void processMessage(const char *topic, const uint8_t *payload, size_t length);
+
+    TcpConnection connection;
+    char brokerHost[CONFIG_URL_SIZE]; // the broker host the connection belongs to
+    MqttClient client;
+    bool online; // the broker accepted the connection and the subscriptions are made
+    bool opening; // the host is resolved and the TCP connection established in the background
+    bool connecting; // CONNECT was sent, waiting for CONNACK
+    uint32_t nextConnectionAttempt; // in ms
+    uint8_t failedAttempts; // since the last successful connection
+    char lastValues[VALUE_COUNT][MQTT_VALUE_SIZE]; // the values last published per topic
+};
+
+extern Mqtt mqtt;
+
+#endif /* MQTT_H_ */
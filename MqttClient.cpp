@@ -0,0 +1,293 @@
+/*
+ * MqttClient.cpp
+ *
+ * A minimal MQTT 3.1.1 client supporting only what's needed to publish measurements and to
+ * receive commands: CONNECT (with last will), PUBLISH and SUBSCRIBE with QoS 0 and keep-alive.
+ * Nothing ever waits for the broker, incoming data is processed in loop() as it arrives.
+ * Packets are assembled in a static buffer, so no heap is used.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <string.h>
+#include "MqttClient.h"
+
+#define HEADER_SIZE 5 // maximum size of a fixed header (type + 4 bytes remaining length)
+
+/**
+ * Constructor, the client is used to send and receive the data.
+ */
+MqttClient::MqttClient(Client &client) : client(client) {
+	callback = NULL;
+	rxLength = 0;
+	rxExpected = 0;
+	rxHeader = 0;
+	connected = false;
+	refused = false;
+	keepAlive = 0;
+	packetId = 0;
+	currentTime = 0;
+	connectTime = 0;
+	lastSent = 0;
+	lastReceived = 0;
+	pingPending = false;
+}
+
+MqttClient::~MqttClient() {
+}
+
+/**
+ * Set the function which is called when a message for a subscribed topic is received.
+ */
+void MqttClient::setCallback(Callback callback) {
+	this->callback = callback;
+}
+
+/**
+ * Send the CONNECT packet, the client must be connected to the broker already. The connection
+ * is established when isConnected() returns true. User, password and will are optional (NULL).
+ */
+bool MqttClient::connect(const char *clientId, const char *user, const char *password, const char *willTopic,
+		const char *willMessage, uint16_t keepAlive, uint32_t now) {
+	this->keepAlive = keepAlive;
+	currentTime = now;
+	connectTime = now;
+	lastReceived = now;
+	connected = false;
+	refused = false;
+	pingPending = false;
+	rxLength = 0;
+	rxExpected = 0;
+
+	bool hasUser = user && *user;
+	uint8_t flags = 0x02; // clean session
+	if (willTopic && *willTopic) {
+		flags |= 0x24; // will flag, will retain
+	}
+	if (hasUser) {
+		flags |= 0x80;
+		if (password && *password) {
+			flags |= 0x40;
+		}
+	}
+
+	size_t position = HEADER_SIZE;
+	memcpy(txBuffer + position, "\0\4MQTT\4", 7); // protocol name and level
+	position += 7;
+	txBuffer[position++] = flags;
+	txBuffer[position++] = keepAlive >> 8;
+	txBuffer[position++] = keepAlive & 0xff;
+	position = writeString(position, clientId);
+	if (flags & 0x04) {
+		position = writeString(position, willTopic);
+		position = writeString(position, willMessage);
+	}
+	if (flags & 0x80) {
+		position = writeString(position, user);
+	}
+	if (flags & 0x40) {
+		position = writeString(position, password);
+	}
+	return position > 0 && send(CONNECT, position - HEADER_SIZE);
+}
+
+/**
+ * Publish a message with QoS 0.
+ */
+bool MqttClient::publish(const char *topic, const char *payload, bool retain) {
+	if (!connected) {
+		return false;
+	}
+
+	size_t position = writeString(HEADER_SIZE, topic);
+	size_t length = strlen(payload);
+	if (position == 0 || position + length > MQTT_BUFFER_SIZE) {
+		return false;
+	}
+	memcpy(txBuffer + position, payload, length);
+	return send(PUBLISH | (retain ? 0x01 : 0), position + length - HEADER_SIZE);
+}
+
+/**
+ * Subscribe to a topic with QoS 0.
+ */
+bool MqttClient::subscribe(const char *topic) {
+	if (!connected) {
+		return false;
+	}
+
+	packetId = (packetId == 0xffff ? 1 : packetId + 1);
+	size_t position = HEADER_SIZE;
+	txBuffer[position++] = packetId >> 8;
+	txBuffer[position++] = packetId & 0xff;
+	position = writeString(position, topic);
+	if (position == 0 || position >= MQTT_BUFFER_SIZE) {
+		return false;
+	}
+	txBuffer[position++] = 0; // requested QoS
+	return send(SUBSCRIBE, position - HEADER_SIZE);
+}
+
+/**
+ * Process incoming data and keep the connection alive. Returns false if the connection
+ * is lost or the broker doesn't respond, it has to be re-established then.
+ */
+bool MqttClient::loop(uint32_t now) {
+	currentTime = now;
+	if (!client.connected() || !receive() || refused) {
+		connected = false;
+		return false;
+	}
+
+	if (!connected) {
+		return now - connectTime < MQTT_RESPONSE_TIMEOUT;
+	}
+	if (keepAlive > 0) {
+		if (now - lastReceived > keepAlive * 1500UL) {
+			connected = false;
+			return false;
+		}
+		if (!pingPending && now - lastSent >= keepAlive * 500UL) {
+			pingPending = send(PINGREQ, 0);
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns true if the broker accepted the connection.
+ */
+bool MqttClient::isConnected() {
+	return connected;
+}
+
+/**
+ * Close the connection gracefully (the broker won't publish the will).
+ */
+void MqttClient::disconnect() {
+	if (connected) {
+		send(DISCONNECT, 0);
+	}
+	connected = false;
+	client.stop();
+}
+
+/**
+ * Add the fixed header to the packet in txBuffer (which starts at HEADER_SIZE) and send it.
+ */
+bool MqttClient::send(uint8_t type, size_t length) {
+	uint8_t header[HEADER_SIZE];
+	size_t headerLength = 0;
+
+	header[headerLength++] = type;
+	size_t remaining = length;
+	do {
+		uint8_t digit = remaining % 128;
+		remaining /= 128;
+		header[headerLength++] = digit | (remaining > 0 ? 0x80 : 0);
+	} while (remaining > 0);
+
+	uint8_t *start = txBuffer + HEADER_SIZE - headerLength;
+	memcpy(start, header, headerLength);
+	if (client.write(start, headerLength + length) != headerLength + length) {
+		return false;
+	}
+	lastSent = currentTime;
+	return true;
+}
+
+/**
+ * Write a string with its length prefix to txBuffer, returns the position after it or
+ * 0 if it doesn't fit.
+ */
+size_t MqttClient::writeString(size_t position, const char *text) {
+	size_t length = strlen(text);
+	if (position == 0 || position + 2 + length > MQTT_BUFFER_SIZE) {
+		return 0;
+	}
+	txBuffer[position++] = length >> 8;
+	txBuffer[position++] = length & 0xff;
+	memcpy(txBuffer + position, text, length);
+	return position + length;
+}
+
+/**
+ * Read the available data and process complete packets. Packets larger than the
+ * buffer are skipped. Returns false if the data is malformed.
+ */
+bool MqttClient::receive() {
+	while (client.available() > 0) {
+		if (rxExpected == 0) { // fixed header, byte by byte until the remaining length is complete
+			uint8_t data;
+			if (client.read(&data, 1) != 1) {
+				break;
+			}
+			rxBuffer[rxLength++] = data;
+			if (rxLength >= 2 && !(data & 0x80)) {
+				size_t remaining = 0;
+				for (size_t i = rxLength - 1; i > 0; i--) {
+					remaining = remaining * 128 + (rxBuffer[i] & 0x7f);
+				}
+				rxHeader = rxLength;
+				rxExpected = rxLength + remaining;
+			} else if (rxLength >= HEADER_SIZE) {
+				return false;
+			}
+		} else {
+			size_t missing = rxExpected - rxLength;
+			int length;
+			if (rxExpected <= MQTT_BUFFER_SIZE) {
+				length = client.read(rxBuffer + rxLength, missing);
+			} else {
+				uint8_t discard[32];
+				length = client.read(discard, missing < sizeof(discard) ? missing : sizeof(discard));
+			}
+			if (length <= 0) {
+				break;
+			}
+			rxLength += length;
+		}
+
+		if (rxExpected > 0 && rxLength == rxExpected) {
+			if (rxExpected <= MQTT_BUFFER_SIZE) {
+				processPacket();
+			}
+			lastReceived = currentTime;
+			rxLength = 0;
+			rxExpected = 0;
+		}
+	}
+	return true;
+}
+
+/**
+ * Handle a complete packet in rxBuffer.
+ */
+void MqttClient::processPacket() {
+	switch (rxBuffer[0] & 0xf0) {
+	case CONNACK:
+		if (rxExpected >= rxHeader + 2 && rxBuffer[rxHeader + 1] == 0) {
+			connected = true;
+		} else {
+			refused = true;
+		}
+		break;
+	case PUBLISH: {
+		size_t topicLength = (rxBuffer[rxHeader] << 8) | rxBuffer[rxHeader + 1];
+		size_t payload = rxHeader + 2 + topicLength + ((rxBuffer[0] & 0x06) ? 2 : 0); // skip packet id if QoS > 0
+		if (payload > rxExpected || callback == NULL) {
+			break;
+		}
+		// move the topic one byte to the front to make room for the terminating zero
+		char *topic = (char *) rxBuffer + rxHeader + 1;
+		memmove(topic, rxBuffer + rxHeader + 2, topicLength);
+		topic[topicLength] = 0;
+		callback(topic, rxBuffer + payload, rxExpected - payload);
+		break;
+	}
+	case PINGRESP:
+		pingPending = false;
+		break;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * MqttClient.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef MQTTCLIENT_H_
+#define MQTTCLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Client.h>
+
+#define MQTT_BUFFER_SIZE 256 // maximum size of a packet (incoming larger packets are dropped)
+#define MQTT_RESPONSE_TIMEOUT 5000 // time to wait for the CONNACK (in ms)
+
+/*
+ * Minimal non-blocking MQTT 3.1.1 client (QoS 0 only).
+ *
+ * Note: This class intentionally only depends on the Client interface so it can also be
+ * compiled on the host and tested against a broker (see tools/mqtttest).
+ */
+class MqttClient
+{
+public:
+    typedef void (*Callback)(const char *topic, const uint8_t *payload, size_t length);
+
+    MqttClient(Client &client);
+    virtual ~MqttClient();
+    void setCallback(Callback callback);
+    bool connect(const char *clientId, const char *user, const char *password, const char *willTopic,
+            const char *willMessage, uint16_t keepAlive, uint32_t now);
+    bool publish(const char *topic, const char *payload, bool retain);
+    bool subscribe(const char *topic);
+    bool loop(uint32_t now);
+    bool isConnected();
+    void disconnect();
+
+private:
+    enum PacketType
+    {
+        CONNECT = 0x10,
+        CONNACK = 0x20,
+        PUBLISH = 0x30,
+        SUBSCRIBE = 0x82,
+        SUBACK = 0x90,
+        PINGREQ = 0xc0,
+        PINGRESP = 0xd0,
+        DISCONNECT = 0xe0
+    };
+
+    bool send(uint8_t type, size_t length);
+    size_t writeString(size_t position, const char *text);
+    void processPacket();
+    bool receive();
+
+    Client &client;
+    Callback callback;
+    uint8_t txBuffer[MQTT_BUFFER_SIZE];
+    uint8_t rxBuffer[MQTT_BUFFER_SIZE];
+    size_t rxLength; // bytes of the current packet received so far
+    size_t rxExpected; // total size of the current packet, 0 = header not complete yet
+    size_t rxHeader; // size of the fixed header of the current packet
+    bool connected; // CONNACK received
+    bool refused; // the broker refused the connection
+    uint16_t keepAlive; // in sec
+    uint16_t packetId;
+    uint32_t currentTime; // time of the last call to connect() or loop() (in ms)
+    uint32_t connectTime; // when CONNECT was sent (in ms)
+    uint32_t lastSent; // in ms
+    uint32_t lastReceived; // in ms
+    bool pingPending;
+};
+
+#endif /* MQTTCLIENT_H_ */
@@ -0,0 +1,189 @@
+/*
+ * PowerController.cpp
+ *
+ * Calculates the maximum power a consumer may draw so it uses only PV input, no battery and no grid power.
+ *
+ * Two algorithms are available:
+ * - Step: moves the power by a fixed amount per sample, a simple and robust fallback.
+ * - PI: a proportional-integral controller with the PV voltage as process variable, within
+ *   minPvVoltage..maxPvVoltage the power is held (dead band). A too high battery discharge current is converted into a PV voltage error, the
+ *   most constraining error wins. The output is rate limited and clamped, the integrator tracks
+ *   the limited output (back-calculation) to prevent windup.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "PowerController.h"
+
+#define MAX_SAMPLE_INTERVAL 5.0f // limit for the time between two samples, prevents large jumps after a pause (in sec)
+#define CUTOFF_DELAY 10000 // time the PI controller waits at minimum power for the consumer to follow before cutting off (in ms)
+
+/**
+ * Constructor
+ */
+PowerController::PowerController() {
+	power = 0;
+	integral = 0;
+	error = 0;
+	timestamp = 0;
+	cutoffTime = 0;
+	minPowerTime = 0;
+}
+
+/**
+ * Destructor
+ */
+PowerController::~PowerController() {
+}
+
+/**
+ * Initialize the controller with the initial power.
+ */
+void PowerController::init(const Settings &settings, uint32_t now) {
+	power = settings.initialPower;
+	integral = power;
+	error = 0;
+	timestamp = now;
+	cutoffTime = 0;
+	minPowerTime = 0;
+}
+
+/**
+ * Process a new sample and return the new maximum power (in W).
+ */
+uint16_t PowerController::update(const Settings &settings, const Sample &sample, uint32_t now) {
+	if (power == 0 && cutoffTime > 0) {
+		if (!isOverloaded(settings, sample)) {
+			retryAfterCutoff(settings, sample, now);
+		}
+	} else if (settings.mode == PI) {
+		updatePI(settings, sample, now);
+	} else {
+		updateStep(settings, sample, now);
+	}
+	timestamp = now;
+	return power;
+}
+
+/**
+ * Return the calculated maximum power (in W)
+ */
+uint16_t PowerController::getPower() {
+	return power;
+}
+
+/**
+ * Return the last error of the PI controller (in V), positive = head-room to increase power
+ */
+float PowerController::getError() {
+	return error;
+}
+
+/**
+ * Check if any of the limits is violated, which requires to reduce power.
+ */
+bool PowerController::isOverloaded(const Settings &settings, const Sample &sample) {
+	return sample.outPower > sample.pvPower + settings.outPowerTolerance
+			|| sample.batteryCurrent < settings.maxBatteryDischargeCurrent || sample.busVoltage < settings.minBusVoltage
+			|| sample.pvVoltage < settings.minPvVoltage;
+}
+
+void PowerController::retryAfterCutoff(const Settings &settings, const Sample &sample, uint32_t now) {
+	if ((cutoffTime + settings.cutoffRetryTime * 1000) < now && sample.busVoltage > settings.minBusVoltage
+			&& sample.batterySoc > settings.cutoffRetryMinSoc * 10) {
+		cutoffTime = 0;
+		power = settings.initialPower;
+		integral = power;
+	}
+}
+
+void PowerController::cutoff(uint32_t now) {
+	cutoffTime = (cutoffTime > 0 ? cutoffTime : now);
+	power = 0;
+	integral = 0;
+}
+
+/**
+ * Decrease the power by a fixed step if a limit is violated, increase it if the
+ * PV voltage is above maxPvVoltage.
+ */
+void PowerController::updateStep(const Settings &settings, const Sample &sample, uint32_t now) {
+	if (isOverloaded(settings, sample)) {
+		if (power >= settings.adjustment && power > settings.minPower) {
+			power -= settings.adjustment;
+		} else {
+			cutoff(now);
+		}
+	} else if (sample.pvVoltage > settings.maxPvVoltage) {
+		if (power < settings.maxPower - settings.adjustment) {
+			power += settings.adjustment;
+		} else {
+			power = settings.maxPower;
+		}
+	}
+	error = 0;
+	integral = power; // allows a bumpless switch to the PI controller
+}
+
+/**
+ * Calculate the power with a PI controller.
+ */
+void PowerController::updatePI(const Settings &settings, const Sample &sample, uint32_t now) {
+	float interval = (now - timestamp) / 1000.0f;
+	if (interval > MAX_SAMPLE_INTERVAL) {
+		interval = MAX_SAMPLE_INTERVAL;
+	}
+
+	// no correction within the PV voltage band: the consumer changes its power in steps (e.g. whole
+	// Amperes), without the dead band the integrator would cycle between two of them
+	if (sample.pvVoltage > settings.maxPvVoltage) {
+		error = sample.pvVoltage - settings.maxPvVoltage;
+	} else if (sample.pvVoltage < settings.minPvVoltage) {
+		error = sample.pvVoltage - settings.minPvVoltage;
+	} else {
+		error = 0;
+	}
+	float batteryError = (sample.batteryCurrent - settings.maxBatteryDischargeCurrent) * settings.batteryCurrentWeight;
+	if (batteryError < error) {
+		error = batteryError;
+	}
+	// limits without a proportional process variable are treated like a PV voltage one band width too low
+	if (sample.outPower > sample.pvPower + settings.outPowerTolerance || sample.busVoltage < settings.minBusVoltage) {
+		float limitError = settings.minPvVoltage - settings.maxPvVoltage;
+		if (limitError < error) {
+			error = limitError;
+		}
+	}
+
+	if (power <= settings.minPower && isOverloaded(settings, sample)) {
+		minPowerTime = (minPowerTime > 0 ? minPowerTime : now);
+		if (now - minPowerTime > CUTOFF_DELAY) {
+			minPowerTime = 0;
+			cutoff(now);
+			return;
+		}
+	} else {
+		minPowerTime = 0;
+	}
+
+	float newIntegral = integral + settings.ki * error * interval;
+	float output = newIntegral + settings.kp * error;
+	float limited = output;
+
+	float maxChange = settings.rateLimit * interval;
+	if (limited > power + maxChange) {
+		limited = power + maxChange;
+	} else if (limited < power - maxChange) {
+		limited = power - maxChange;
+	}
+	if (limited > settings.maxPower) {
+		limited = settings.maxPower;
+	} else if (limited < settings.minPower) {
+		limited = settings.minPower;
+	}
+
+	// anti-windup: let the integrator track the limited output
+	integral = (limited != output ? limited - settings.kp * error : newIntegral);
+	power = limited + 0.5f;
+}
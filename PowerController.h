@@ -0,0 +1,77 @@
+/*
+ * PowerController.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef POWERCONTROLLER_H_
+#define POWERCONTROLLER_H_
+
+#include <stdint.h>
+
+/*
+ * Calculates the maximum solar power, tools/simulator and tools/bench use it on the host.
+ */
+class PowerController
+{
+public:
+    enum Mode
+    {
+        Step = 0,
+        PI = 1
+    };
+
+    struct Settings
+    {
+        Mode mode; // the control algorithm to use
+        uint16_t initialPower; // power to start with and after a cutoff (in W)
+        uint16_t minPower; // minimum power, below it the consumer is cut off (in W)
+        uint16_t maxPower; // maximum power to provide to the consumer (in W)
+        uint16_t outPowerTolerance; // tolerance of higher out power against PV input (in W)
+        uint16_t adjustment; // step size of the step controller (in W)
+        int16_t maxBatteryDischargeCurrent; // allowed battery current, negative = discharge (in A)
+        uint16_t minBusVoltage; // minimum bus voltage (in V)
+        float minPvVoltage; // minimum PV voltage (in V)
+        float maxPvVoltage; // PV voltage above which power may be increased, upper end of the dead band of the PI controller (in V)
+        uint32_t cutoffRetryTime; // time until a retry after a cutoff (in sec)
+        uint8_t cutoffRetryMinSoc; // minimum battery soc to retry after a cutoff (in %)
+        float kp; // proportional gain of the PI controller (in W/V)
+        float ki; // integral gain of the PI controller (in W/(V*s))
+        float batteryCurrentWeight; // converts battery over-current into PV voltage error (in V/A)
+        uint16_t rateLimit; // maximum change of power of the PI controller (in W/s)
+    };
+
+    struct Sample
+    {
+        float pvVoltage; // in V
+        uint16_t pvPower; // in W
+        uint16_t outPower; // in W
+        int16_t batteryCurrent; // in A, negative = discharge
+        uint16_t busVoltage; // in V
+        uint16_t batterySoc; // in 0.1%
+    };
+
+    PowerController();
+    virtual ~PowerController();
+    void init(const Settings &settings, uint32_t now);
+    uint16_t update(const Settings &settings, const Sample &sample, uint32_t now);
+    uint16_t getPower();
+    float getError();
+
+private:
+    bool isOverloaded(const Settings &settings, const Sample &sample);
+    void retryAfterCutoff(const Settings &settings, const Sample &sample, uint32_t now);
+    void cutoff(uint32_t now);
+    void updateStep(const Settings &settings, const Sample &sample, uint32_t now);
+    void updatePI(const Settings &settings, const Sample &sample, uint32_t now);
+
+    uint16_t power; // in W
+    float integral; // in W
+    float error; // in V
+    uint32_t timestamp; // in ms
+    uint32_t cutoffTime; // in ms
+    uint32_t minPowerTime; // since when the PI controller is overloaded at minimum power (in ms)
+};
+
+#endif /* POWERCONTROLLER_H_ */
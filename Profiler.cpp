@@ -0,0 +1,64 @@
+/*
+ * Profiler.cpp
+ *
+ * Collects the run time of hot code sections in histograms if DEBUG_PERF is defined (see
+ * Config.h). The time is measured with the cpu cycle counter (a single register read), so
+ * even sections of a few microseconds are resolved. Without DEBUG_PERF the PROFILE() markers
+ * compile to nothing and no memory is used for the histograms.
+ *
+ * The results are served at /debug/perf (in cycles, divide by cpuMHz for us), a DELETE of
+ * /debug/perf clears them.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Profiler.h"
+
+/**
+ * Add the duration of one run of the section.
+ */
+void Profiler::record(Section section, uint32_t cycles) {
+#ifdef DEBUG_PERF
+	histograms[section].add(cycles);
+#else
+	(void) section;
+	(void) cycles;
+#endif
+}
+
+void Profiler::reset() {
+#ifdef DEBUG_PERF
+	for (uint8_t i = 0; i < SECTION_COUNT; i++) {
+		histograms[i].reset();
+	}
+#endif
+}
+
+/**
+ * The statistics of all sections as JSON.
+ */
+String Profiler::toJSON() {
+	JsonDocument doc;
+
+#ifdef DEBUG_PERF
+	const char *sectionNames[] = { "WebServer::loop", "Inverter::readResponse", "Inverter::parseStatusResponse",
+			"Inverter::toJSON", "CRCUtil::checkCRC", "WLAN::checkConnection", "Battery::loop" };
+
+	doc[F("enabled")] = true;
+	doc[F("cpuMHz")] = ESP.getCpuFreqMHz();
+	JsonObject sections = doc[F("sections")].to<JsonObject>();
+	for (uint8_t i = 0; i < SECTION_COUNT; i++) {
+		JsonObject node = sections[sectionNames[i]].to<JsonObject>();
+		histograms[i].toJSON(node);
+	}
+#else
+	doc[F("enabled")] = false;
+#endif
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
+
+Profiler profiler;
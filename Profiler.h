@@ -0,0 +1,72 @@
+/*
+ * Profiler.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Histogram.h"
+
+/*
+ * Measure the run time of the enclosing block (function) as the given section, e.g.
+ * PROFILE(BATTERY_LOOP); - compiles to nothing unless DEBUG_PERF is defined.
+ */
+#ifdef DEBUG_PERF
+#define PROFILE(section) Profiler::Scope profilerScope(Profiler::section)
+#else
+#define PROFILE(section)
+#endif
+
+class Profiler
+{
+public:
+    enum Section
+    {
+        WEB_SERVER_LOOP,
+        INVERTER_READ_RESPONSE,
+        PARSE_STATUS_RESPONSE,
+        INVERTER_TO_JSON,
+        CHECK_CRC,
+        WLAN_CHECK_CONNECTION,
+        BATTERY_LOOP,
+        SECTION_COUNT
+    };
+
+    /*
+     * Records the cycles between its construction and destruction.
+     */
+    class Scope
+    {
+    public:
+        Scope(Section section);
+        ~Scope();
+    private:
+        Section section;
+        uint32_t start; // in cpu cycles
+    };
+
+    void record(Section section, uint32_t cycles);
+    void reset();
+    String toJSON();
+
+private:
+#ifdef DEBUG_PERF
+    Histogram histograms[SECTION_COUNT]; // in cpu cycles
+#endif
+};
+
+extern Profiler profiler;
+
+inline Profiler::Scope::Scope(Section section) : section(section), start(ESP.getCycleCount()) {
+}
+
+inline Profiler::Scope::~Scope() {
+	profiler.record(section, ESP.getCycleCount() - start);
+}
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,103 @@
+/*
+ * RateLimiter.cpp
+ *
+ * A token bucket per client (by IP address): it's refilled with settings.rate requests per
+ * second up to settings.burst and every request takes one token. The buckets of
+ * RATE_LIMITER_CLIENTS clients are kept, an unknown client replaces the least recently seen one
+ * and starts with a full bucket.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "RateLimiter.h"
+#include <string.h>
+
+/**
+ * Constructor
+ */
+RateLimiter::RateLimiter() {
+	memset(clients, 0, sizeof(clients));
+	evictions = 0;
+}
+
+/**
+ * Find the bucket of the client and refill it, replace the least recently used one if the
+ * client is unknown.
+ */
+RateLimiter::Client &RateLimiter::getClient(const Settings &settings, uint32_t address, uint32_t now) {
+	Client *oldest = &clients[0];
+
+	for (uint8_t i = 0; i < RATE_LIMITER_CLIENTS; i++) {
+		Client &client = clients[i];
+		if (client.address == address) {
+			refill(settings, client, now);
+			return client;
+		}
+		if (client.address == 0 || (oldest->address != 0 && (int32_t) (client.lastRefill - oldest->lastRefill) < 0)) {
+			oldest = &client;
+		}
+	}
+
+	if (oldest->address != 0) {
+		evictions++;
+	}
+	oldest->address = address;
+	oldest->tokens = settings.burst * (uint32_t) RATE_LIMITER_TOKEN;
+	oldest->lastRefill = now;
+	oldest->admitted = 0;
+	oldest->rejected = 0;
+	return *oldest;
+}
+
+/**
+ * Take a token for a request, returns false (and counts the rejection) if there is none.
+ */
+bool RateLimiter::take(Client &client) {
+	if (client.tokens < RATE_LIMITER_TOKEN) {
+		client.rejected++;
+		return false;
+	}
+	client.tokens -= RATE_LIMITER_TOKEN;
+	client.admitted++;
+	return true;
+}
+
+/**
+ * Return the time until the client has a token again (in sec, at least 1).
+ */
+uint32_t RateLimiter::getRetryAfter(const Settings &settings, const Client &client) {
+	uint32_t missing = (client.tokens < RATE_LIMITER_TOKEN ? RATE_LIMITER_TOKEN - client.tokens : 0);
+	uint32_t retryAfter = (missing / settings.rate + 999) / 1000;
+	return (retryAfter > 1 ? retryAfter : 1);
+}
+
+/**
+ * Access the bucket at the index (0 to RATE_LIMITER_CLIENTS - 1), an address of 0 means unused.
+ */
+const RateLimiter::Client &RateLimiter::getClient(uint8_t index) {
+	return clients[index];
+}
+
+/**
+ * Return how often a bucket was replaced by a new client.
+ */
+uint32_t RateLimiter::getEvictions() {
+	return evictions;
+}
+
+/**
+ * Add the tokens earned since the last request.
+ */
+void RateLimiter::refill(const Settings &settings, Client &client, uint32_t now) {
+	uint32_t elapsed = now - client.lastRefill;
+	uint32_t maximum = settings.burst * (uint32_t) RATE_LIMITER_TOKEN;
+
+	client.lastRefill = now;
+	if (elapsed >= maximum / settings.rate) { // prevents an overflow after a long pause
+		client.tokens = maximum;
+	} else {
+		uint32_t tokens = client.tokens + elapsed * settings.rate;
+		client.tokens = (tokens < maximum ? tokens : maximum);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * RateLimiter.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef RATELIMITER_H_
+#define RATELIMITER_H_
+
+#include <stdint.h>
+
+#define RATE_LIMITER_CLIENTS 8 // number of clients with their own token bucket, the least recently seen is replaced
+#define RATE_LIMITER_TOKEN 1000 // tokens are counted in 1/1000 requests
+
+/*
+ * Token buckets of the admission control, tested on the host by tools/httpbench/ratelimitertest.cpp.
+ */
+class RateLimiter
+{
+public:
+    struct Settings
+    {
+        uint16_t rate; // requests per second per client (must not be 0)
+        uint16_t burst; // number of requests a client may send at once after a pause
+    };
+
+    struct Client
+    {
+        uint32_t address; // IPv4 address, 0 = unused
+        uint32_t tokens; // in 1/RATE_LIMITER_TOKEN requests
+        uint32_t lastRefill; // in ms
+        uint32_t admitted;
+        uint32_t rejected;
+    };
+
+    RateLimiter();
+    Client &getClient(const Settings &settings, uint32_t address, uint32_t now);
+    bool take(Client &client);
+    uint32_t getRetryAfter(const Settings &settings, const Client &client);
+    const Client &getClient(uint8_t index);
+    uint32_t getEvictions();
+
+private:
+    void refill(const Settings &settings, Client &client, uint32_t now);
+
+    Client clients[RATE_LIMITER_CLIENTS];
+    uint32_t evictions; // clients whose bucket was replaced by a new client
+};
+
+#endif /* RATELIMITER_H_ */
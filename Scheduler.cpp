@@ -0,0 +1,151 @@
+/*
+ * Scheduler.cpp
+ *
+ * A cooperative scheduler for the module loops. Every task has a period, a time budget and a
+ * priority. In each pass (one call of loop()) every due task runs at most once: always the
+ * one with the highest priority, between tasks of equal priority the one which is due the
+ * longest (earliest deadline first). The choice is made again after every task, so a task
+ * with a high priority which becomes due meanwhile is started before the remaining ones.
+ *
+ * Tasks can't be interrupted, a task with a high priority waits at most for its period plus
+ * the longest run of another task. This bounds e.g. the time until the serial input of the
+ * inverter is read, independent of how many HTTP requests are served or whether the WiFi
+ * reconnects. Runs exceeding the budget and runs which start late are counted per task and
+ * served at /debug/tasks.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Scheduler.h"
+#include "Logger.h"
+
+/**
+ * Constructor
+ */
+Scheduler::Scheduler() {
+	taskCount = 0;
+	passes = 0;
+	startTime = 0;
+}
+
+Scheduler::~Scheduler() {
+}
+
+/**
+ * Register a task which is called every period (in ms) and usually returns within
+ * the budget (in us). Returns false if there's no space for the task.
+ */
+bool Scheduler::addTask(const __FlashStringHelper *name, TaskFunction function, uint32_t period, uint32_t budget,
+		Priority priority) {
+	if (taskCount >= SCHEDULER_MAX_TASKS) {
+		LOG_ERROR("unable to add task %S, increase SCHEDULER_MAX_TASKS", name);
+		return false;
+	}
+
+	Task &task = tasks[taskCount++];
+	memset(&task, 0, sizeof(Task));
+	task.name = name;
+	task.function = function;
+	task.period = period * 1000;
+	task.budget = budget;
+	task.priority = priority;
+	task.due = micros();
+	return true;
+}
+
+/**
+ * Run all due tasks once in the order of their priority and deadline.
+ */
+void Scheduler::loop() {
+	if (passes++ == 0) {
+		startTime = millis();
+	}
+	for (uint8_t i = 0; i < taskCount; i++) {
+		tasks[i].ran = false;
+	}
+
+	Task *task;
+	while ((task = getNext(micros())) != NULL) {
+		run(*task);
+	}
+}
+
+/**
+ * Find the due task with the highest priority and the earliest deadline, NULL if none is due.
+ */
+Scheduler::Task *Scheduler::getNext(uint32_t now) {
+	Task *next = NULL;
+
+	for (uint8_t i = 0; i < taskCount; i++) {
+		Task &task = tasks[i];
+		if (task.ran || (int32_t) (now - task.due) < 0) {
+			continue;
+		}
+		if (next == NULL || task.priority > next->priority
+				|| (task.priority == next->priority && (int32_t) (task.due - next->due) < 0)) {
+			next = &task;
+		}
+	}
+	return next;
+}
+
+/**
+ * Run the task, update its statistics and schedule its next run.
+ */
+void Scheduler::run(Task &task) {
+	uint32_t start = micros();
+	uint32_t delay = start - task.due;
+
+	task.function();
+
+	uint32_t duration = micros() - start;
+	task.ran = true;
+	task.runs++;
+	task.totalTime += duration;
+	task.maxDuration = max(task.maxDuration, duration);
+	task.maxDelay = max(task.maxDelay, delay);
+	if (duration > task.budget) {
+		task.overruns++;
+	}
+	if (task.period > 0 && delay > task.period) {
+		task.missed++;
+	}
+
+	task.due += task.period;
+	if ((int32_t) (start - task.due) >= 0) { // don't catch up on missed runs
+		task.due = start + task.period;
+	}
+}
+
+/**
+ * The statistics per task. load is the share of time spent in the task (in 0.1%).
+ */
+String Scheduler::toJSON() {
+	JsonDocument doc;
+	uint32_t elapsed = millis() - startTime;
+
+	doc[F("passes")] = passes;
+	JsonArray array = doc[F("tasks")].to<JsonArray>();
+	for (uint8_t i = 0; i < taskCount; i++) {
+		Task &task = tasks[i];
+		JsonObject node = array.add<JsonObject>();
+		node[F("name")] = task.name;
+		node[F("priority")] = (int) task.priority;
+		node[F("period")] = task.period / 1000;
+		node[F("budget")] = task.budget;
+		node[F("runs")] = task.runs;
+		node[F("overruns")] = task.overruns;
+		node[F("missed")] = task.missed;
+		node[F("average")] = task.runs > 0 ? (uint32_t) (task.totalTime / task.runs) : 0;
+		node[F("max")] = task.maxDuration;
+		node[F("maxDelay")] = task.maxDelay;
+		node[F("load")] = elapsed > 0 ? (uint32_t) (task.totalTime / elapsed) : 0; // us per ms = 0.1%
+	}
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
+
+Scheduler scheduler;
@@ -0,0 +1,65 @@
+/*
+ * Scheduler.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define SCHEDULER_MAX_TASKS 10
+
+class Scheduler
+{
+public:
+    typedef void (*TaskFunction)();
+
+    enum Priority
+    {
+        PRIORITY_LOW = 0,
+        PRIORITY_NORMAL = 1,
+        PRIORITY_HIGH = 2,
+        PRIORITY_CRITICAL = 3
+    };
+
+    Scheduler();
+    virtual ~Scheduler();
+    bool addTask(const __FlashStringHelper *name, TaskFunction function, uint32_t period, uint32_t budget,
+            Priority priority);
+    void loop();
+    String toJSON();
+
+private:
+    struct Task
+    {
+        const __FlashStringHelper *name;
+        TaskFunction function;
+        uint32_t period; // in us, 0 = run in every pass
+        uint32_t budget; // expected maximum duration of one run (in us)
+        Priority priority;
+        uint32_t due; // when the task should run next (in us)
+        bool ran; // true if the task already ran in the current pass
+        uint32_t runs;
+        uint32_t overruns; // runs which took longer than the budget
+        uint32_t missed; // runs which started more than one period late
+        uint32_t maxDuration; // in us
+        uint32_t maxDelay; // longest time between due and start (in us)
+        uint64_t totalTime; // in us
+    };
+
+    Task *getNext(uint32_t now);
+    void run(Task &task);
+
+    Task tasks[SCHEDULER_MAX_TASKS];
+    uint8_t taskCount;
+    uint32_t passes;
+    uint32_t startTime; // in ms
+};
+
+extern Scheduler scheduler;
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,245 @@
+/*
+ * SocEstimator.cpp
+ *
+ * Estimates the state of charge of the battery with a one-state extended Kalman filter
+ * in fixed-point arithmetic. The prediction step counts coulombs, the correction step
+ * compares the measured terminal voltage against the open circuit voltage (OCV) curve of
+ * the configured battery type plus the voltage drop over the estimated internal resistance.
+ *
+ * Where the OCV curve is flat (e.g. the plateau of LiFePO4 cells) the filter automatically
+ * relies on the coulomb counter, where it is steep the voltage pulls the estimation back.
+ * An update costs a few 64bit multiplications/divisions, roughly 20-50us on an ESP8266.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "SocEstimator.h"
+
+#define SOC_ONE (1L << 24) // 100% state of charge
+#define VARIANCE_ONE (1L << 30) // variance of 1.0 (100%^2)
+#define VARIANCE_INITIAL (VARIANCE_ONE / 25) // initial uncertainty of 20%
+#define VARIANCE_MIN 1000 // lower limit to keep the filter responsive
+#define PROCESS_NOISE 120 // growth of variance per second, a random walk of ~2% per hour
+#define VOLTAGE_NOISE 10000 // variance of the voltage measurement incl. model error (in mV^2, 100mV)
+#define CALIBRATION_NOISE (VARIANCE_ONE / 10000) // variance of a full/empty detection (1%)
+#define INNOVATION_GATE 16 // reject voltage measurements deviating more than 4 sigma
+#define RESISTANCE_INITIAL 20 // initial internal resistance of the pack (in mOhm)
+#define RESISTANCE_MAX 1000 // upper limit of a plausible resistance sample (in mOhm)
+#define RESISTANCE_MIN_STEP 5 // minimum change of current to sample the resistance (in A)
+#define RESISTANCE_FILTER 8 // low-pass factor for the resistance estimation
+
+/**
+ * Shape of the open circuit voltage curves per battery type (see Config::BatteryType) in
+ * 1/1000 of the range between config->batteryVoltageEmpty (0%) and config->batteryVoltageNominal (100%).
+ * The values must be strictly increasing.
+ */
+const uint16_t SocEstimator::ocvCurves[][OCV_CURVE_POINTS] = {
+		{ 0, 95, 190, 290, 390, 490, 590, 690, 790, 895, 1000 }, // LeadAcid, almost linear
+		{ 0, 260, 400, 480, 540, 590, 640, 700, 770, 860, 1000 }, // NiMh
+		{ 0, 300, 450, 520, 570, 610, 650, 700, 760, 850, 1000 }, // LiIon, flat plateau
+		{ 0, 100, 200, 300, 400, 500, 600, 700, 800, 900, 1000 } // Other, linear
+};
+
+/**
+ * Constructor
+ */
+SocEstimator::SocEstimator() {
+	soc = 0;
+	variance = VARIANCE_INITIAL;
+	resistance = RESISTANCE_INITIAL;
+	lastVoltage = 0;
+	lastCurrent = 0;
+	initialized = false;
+}
+
+/**
+ * Destructor
+ */
+SocEstimator::~SocEstimator() {
+}
+
+/**
+ * Forget the current estimation, the next correction will re-initialize it from the OCV curve.
+ */
+void SocEstimator::reset() {
+	soc = 0;
+	variance = VARIANCE_INITIAL;
+	initialized = false;
+}
+
+/**
+ * Prediction step: integrate the current (in A, positive = charging) over the duration (in ms).
+ *
+ * 1Ah = 3600000Ams
+ */
+void SocEstimator::predict(int16_t current, uint32_t duration) {
+	if (!initialized || config->batteryCapacity == 0) {
+		return;
+	}
+
+	soc += (int64_t) current * duration * SOC_ONE / ((int64_t) config->batteryCapacity * 3600000);
+	soc = constrain(soc, 0, SOC_ONE);
+
+	variance += (int64_t) duration * PROCESS_NOISE / 1000;
+	limitVariance();
+}
+
+/**
+ * Correction step: compare the measured terminal voltage (in V) at the given current (in A)
+ * with the expected voltage OCV(soc) + current * resistance.
+ */
+void SocEstimator::correct(float voltage, int16_t current) {
+	int32_t voltageMv = voltage * 1000;
+	if (voltageMv <= 0) {
+		return;
+	}
+
+	updateResistance(voltageMv, current);
+
+	if (!initialized) {
+		soc = getSocFromOcv(voltageMv - current * resistance);
+		variance = VARIANCE_INITIAL;
+		initialized = true;
+		LOG_INFO("initialized soc estimation to %d%% at %dmV", getSOC() / 10, voltageMv);
+		return;
+	}
+
+	// above the resting voltage of a full pack we're in absorption/float charge, the OCV model does not apply
+	if (voltage > config->batteryVoltageNominal && current > 0) {
+		return;
+	}
+
+	int32_t slope; // dOCV/dSOC in mV per 100%
+	int32_t expected = getOcv(soc, slope) + current * resistance;
+	int32_t innovation = voltageMv - expected;
+
+	// the uncertainty of the resistance (~50%) adds noise under load
+	int64_t loadNoise = (int64_t) current * resistance / 2;
+	int64_t noise = VOLTAGE_NOISE + loadNoise * loadNoise;
+	int64_t innovationVariance = (((int64_t) slope * slope * variance) >> 30) + noise;
+
+	if ((int64_t) innovation * innovation > INNOVATION_GATE * innovationVariance) {
+		return;
+	}
+
+	int64_t gain = (int64_t) variance * slope / innovationVariance; // Q30 per mV
+	soc += (gain * innovation) >> 6;
+	soc = constrain(soc, 0, SOC_ONE);
+	variance -= (gain * slope * variance) >> 30;
+	limitVariance();
+}
+
+/**
+ * Apply a direct measurement of the state of charge (in 0.1%), e.g. when the battery
+ * is detected as fully charged or empty. Instead of overwriting the estimation, it's
+ * weighted by the current uncertainty.
+ */
+void SocEstimator::calibrate(uint16_t soc) {
+	if (!initialized) {
+		this->soc = (int64_t) soc * SOC_ONE / 1000;
+		variance = CALIBRATION_NOISE;
+		initialized = true;
+		return;
+	}
+
+	int32_t measured = (int64_t) soc * SOC_ONE / 1000;
+	int64_t gain = ((int64_t) variance << 30) / (variance + CALIBRATION_NOISE); // Q30
+	this->soc += (gain * (measured - this->soc)) >> 30;
+	this->soc = constrain(this->soc, 0, SOC_ONE);
+	variance -= (gain * variance) >> 30;
+	limitVariance();
+}
+
+/**
+ * Get the estimated state of charge in 0.1%
+ */
+uint16_t SocEstimator::getSOC() {
+	return ((int64_t) soc * 1000 + SOC_ONE / 2) / SOC_ONE;
+}
+
+/**
+ * Get the standard deviation of the estimated state of charge in 0.1%
+ */
+uint16_t SocEstimator::getUncertainty() {
+	return sqrt((float) variance / VARIANCE_ONE) * 1000;
+}
+
+/**
+ * Get the estimated internal resistance of the battery pack in mOhm
+ */
+uint16_t SocEstimator::getResistance() {
+	return resistance;
+}
+
+const uint16_t *SocEstimator::getOcvCurve() {
+	switch (config->batteryType) {
+	case Config::LeadAcid:
+		return ocvCurves[0];
+	case Config::NiMh:
+		return ocvCurves[1];
+	case Config::LiIon:
+		return ocvCurves[2];
+	default:
+		return ocvCurves[3];
+	}
+}
+
+/**
+ * Interpolate the open circuit voltage (in mV) for a state of charge (Q24) and
+ * return the slope of the curve at this point (in mV per 100%).
+ */
+int32_t SocEstimator::getOcv(int32_t soc, int32_t &slope) {
+	const uint16_t *curve = getOcvCurve();
+	int32_t empty = config->batteryVoltageEmpty * 1000;
+	int32_t range = config->batteryVoltageNominal * 1000 - empty;
+
+	int32_t position = (int64_t) soc * (OCV_CURVE_POINTS - 1) * 1000 / SOC_ONE; // in 1/1000 of a segment
+	uint8_t index = min(position / 1000, (int32_t) OCV_CURVE_POINTS - 2);
+	int32_t fraction = position - index * 1000;
+	int32_t delta = curve[index + 1] - curve[index];
+
+	slope = delta * range * (OCV_CURVE_POINTS - 1) / 1000;
+	return empty + (int64_t) (curve[index] * 1000 + delta * fraction) * range / 1000000;
+}
+
+/**
+ * Find the state of charge (Q24) for an open circuit voltage (in mV) by inverting the OCV curve.
+ */
+int32_t SocEstimator::getSocFromOcv(int32_t ocv) {
+	const uint16_t *curve = getOcvCurve();
+	int32_t empty = config->batteryVoltageEmpty * 1000;
+	int32_t range = config->batteryVoltageNominal * 1000 - empty;
+	if (range <= 0) {
+		return SOC_ONE / 2;
+	}
+
+	int32_t shape = constrain((int64_t) (ocv - empty) * 1000 / range, 0, 1000);
+	uint8_t index = 0;
+	while (index < OCV_CURVE_POINTS - 2 && curve[index + 1] < shape) {
+		index++;
+	}
+	int32_t fraction = (shape - curve[index]) * 1000 / (curve[index + 1] - curve[index]);
+	return (int64_t) (index * 1000 + constrain(fraction, 0, 1000)) * SOC_ONE / ((OCV_CURVE_POINTS - 1) * 1000);
+}
+
+/**
+ * Sample the internal resistance from the voltage change caused by a step in current
+ * (R = dV / dI) and feed it to a low-pass filter.
+ */
+void SocEstimator::updateResistance(int32_t voltage, int16_t current) {
+	int16_t deltaCurrent = current - lastCurrent;
+
+	if (lastVoltage > 0 && abs(deltaCurrent) >= RESISTANCE_MIN_STEP) {
+		int32_t sample = (voltage - lastVoltage) / deltaCurrent;
+		if (sample > 0 && sample < RESISTANCE_MAX) {
+			resistance += (sample - resistance) / RESISTANCE_FILTER;
+		}
+	}
+	lastVoltage = voltage;
+	lastCurrent = current;
+}
+
+void SocEstimator::limitVariance() {
+	variance = constrain(variance, VARIANCE_MIN, VARIANCE_ONE);
+}
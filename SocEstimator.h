@@ -0,0 +1,45 @@
+/*
+ * SocEstimator.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef SOCESTIMATOR_H_
+#define SOCESTIMATOR_H_
+
+#include <Arduino.h>
+#include "Logger.h"
+#include "Config.h"
+
+#define OCV_CURVE_POINTS 11 // number of supporting points of the open circuit voltage curves (0%, 10%, ... 100%)
+
+class SocEstimator {
+public:
+	SocEstimator();
+	virtual ~SocEstimator();
+	void reset();
+	void predict(int16_t current, uint32_t duration);
+	void correct(float voltage, int16_t current);
+	void calibrate(uint16_t soc);
+	uint16_t getSOC();
+	uint16_t getUncertainty();
+	uint16_t getResistance();
+private:
+	static const uint16_t ocvCurves[][OCV_CURVE_POINTS];
+
+	int32_t soc; // state of charge, 100% = SOC_ONE (Q24)
+	int32_t variance; // variance of the soc estimation, 1.0 = VARIANCE_ONE (Q30)
+	uint16_t resistance; // estimated internal resistance of the battery pack (in mOhm)
+	int32_t lastVoltage; // in mV
+	int16_t lastCurrent; // in A
+	bool initialized;
+
+	const uint16_t *getOcvCurve();
+	int32_t getOcv(int32_t soc, int32_t &slope);
+	int32_t getSocFromOcv(int32_t ocv);
+	void updateResistance(int32_t voltage, int16_t current);
+	void limitVariance();
+};
+
+#endif /* SOCESTIMATOR_H_ */
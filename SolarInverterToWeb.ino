@@ -11,29 +11,37 @@
 #include "Inverter.h"
 #include "WebServer.h"
 #include "WLAN.h"
+#include "HeapMonitor.h"
+#include "Mqtt.h"
+#include "Modbus.h"
+#include "ApiServer.h"
+#include "Scheduler.h"
 
 void setup() {
 	logger.init();
-	logger.info(F("Starting solar monitor..."));
+	LOG_INFO("Starting solar monitor...");
 
 	config.init();
-	wlan.init();
-	webServer.init();
+	heapMonitor.init();
 	battery.init();
 	inverter.init();
-}
-
-void loop() {
-	webServer.loop();
-	inverter.loop();
-	wlan.loop();
+	wlan.init();
+	webServer.init();
+	modbus.init();
+	apiServer.init();
 
-#ifdef DEBUG_MEM
-    printHeapInfo();
-#endif
+	// period in ms, budget in us - the inverter task guarantees the serial input is read at least every 5ms + the longest other task
+	scheduler.addTask(F("inverter"), []() { inverter.loop(); }, 5, 2000, Scheduler::PRIORITY_CRITICAL);
+	scheduler.addTask(F("modbus"), []() { modbus.loop(); }, 10, 2000, Scheduler::PRIORITY_HIGH);
+	scheduler.addTask(F("apiServer"), []() { apiServer.loop(); }, 5, 5000, Scheduler::PRIORITY_NORMAL);
+	scheduler.addTask(F("webServer"), []() { webServer.loop(); }, 0, 20000, Scheduler::PRIORITY_NORMAL);
+	scheduler.addTask(F("mqtt"), []() { mqtt.loop(); }, 20, 5000, Scheduler::PRIORITY_NORMAL);
+	scheduler.addTask(F("logger"), []() { logger.loop(); }, 20, 1000, Scheduler::PRIORITY_LOW);
+	scheduler.addTask(F("wlan"), []() { wlan.loop(); }, 100, 5000, Scheduler::PRIORITY_LOW);
+	scheduler.addTask(F("config"), []() { config.loop(); }, 1000, 50000, Scheduler::PRIORITY_LOW);
+	scheduler.addTask(F("heapMonitor"), []() { heapMonitor.sample(); }, HEAP_SAMPLE_INTERVAL, 2000, Scheduler::PRIORITY_LOW);
 }
 
-void printHeapInfo() {
-	logger.debug(F("free: %u, frag: %u, maxfree: %u"), ESP.getFreeHeap(), ESP.getHeapFragmentation(), ESP.getMaxFreeBlockSize());
-    delay(500);
+void loop() {
+	scheduler.loop();
 }
@@ -0,0 +1,55 @@
+/*
+ * StringView.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef STRINGVIEW_H_
+#define STRINGVIEW_H_
+
+#include <Arduino.h>
+
+/*
+ * A reference to characters owned by someone else (not necessarily null terminated), to compare
+ * and pass text without creating String temporaries on the heap.
+ */
+class StringView
+{
+public:
+    StringView(const char *text) : text(text), length(strlen(text)) {
+    }
+
+    StringView(const char *text, size_t length) : text(text), length(length) {
+    }
+
+    StringView(const String &string) : text(string.c_str()), length(string.length()) {
+    }
+
+    const char *data() const {
+        return text;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool equals(const char *other) const {
+        return strlen(other) == length && memcmp(text, other, length) == 0;
+    }
+
+    bool equals(const __FlashStringHelper *other) const {
+        return strlen_P((PGM_P) other) == length && memcmp_P(text, (PGM_P) other, length) == 0;
+    }
+
+    bool startsWith(const __FlashStringHelper *prefix) const {
+        size_t prefixLength = strlen_P((PGM_P) prefix);
+        return prefixLength <= length && memcmp_P(text, (PGM_P) prefix, prefixLength) == 0;
+    }
+
+private:
+    const char *text;
+    size_t length;
+};
+
+#endif /* STRINGVIEW_H_ */
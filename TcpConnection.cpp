@@ -0,0 +1,295 @@
+/*
+ * TcpConnection.cpp
+ *
+ * WiFi.hostByName() and WiFiClient::connect() wait until the lookup or the handshake is
+ * complete, which stalls the loop (and the inverter) for up to their timeout whenever the peer
+ * is unreachable. Here the lookup uses lwIP's dns_gethostbyname() and the connection
+ * tcp_connect(), both report the result in a callback. The callbacks run in the system context
+ * between two passes of the loop, they only change the state and queue the received data.
+ *
+ * Received pbufs are kept until they're read and acknowledged to the peer only then, so the TCP
+ * window limits the memory used. Writes are copied into the send buffer of lwIP and never wait
+ * for room, write() returns the number of bytes which fit.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "TcpConnection.h"
+
+/**
+ * Constructor
+ */
+TcpConnection::TcpConnection() {
+	pcb = NULL;
+	rx = NULL;
+	rxOffset = 0;
+	state = IDLE;
+	host[0] = 0;
+	port = 0;
+	connectAfterResolve = false;
+	startTime = 0;
+	timeout = 0;
+}
+
+TcpConnection::~TcpConnection() {
+	stop();
+}
+
+/**
+ * Start to resolve the host and, if connect is true, to connect to it. Poll getState() for the
+ * result, the attempt fails if it isn't complete after timeout (in ms).
+ */
+void TcpConnection::begin(const char *host, uint16_t port, bool connect, uint32_t timeout) {
+	stop();
+	snprintf_P(this->host, sizeof(this->host), PSTR("%s"), host);
+	this->port = port;
+	this->timeout = timeout;
+	connectAfterResolve = connect;
+	startTime = millis();
+	state = RESOLVING;
+
+	ip_addr_t resolvedAddress;
+	err_t result = dns_gethostbyname(this->host, &resolvedAddress, onResolved, this);
+	if (result == ERR_OK) { // an ip address or cached
+		resolved(&resolvedAddress);
+	} else if (result != ERR_INPROGRESS) {
+		state = FAILED;
+	}
+}
+
+/**
+ * Return the state of the connection, an attempt which takes longer than its timeout is
+ * aborted here.
+ */
+TcpConnection::State TcpConnection::getState(uint32_t now) {
+	if ((state == RESOLVING || state == CONNECTING) && now - startTime > timeout) {
+		close();
+		state = FAILED;
+	}
+	return state;
+}
+
+/**
+ * Return the resolved address of the host.
+ */
+IPAddress TcpConnection::getAddress() {
+	return address;
+}
+
+/**
+ * Start to connect (see begin()), returns 1 if the attempt was started. The connection is only
+ * usable once connected() returns true.
+ */
+int TcpConnection::connect(IPAddress ip, uint16_t port) {
+	begin(ip.toString().c_str(), port, true, TCP_CONNECTION_TIMEOUT);
+	return (state != FAILED);
+}
+
+int TcpConnection::connect(const char *host, uint16_t port) {
+	begin(host, port, true, TCP_CONNECTION_TIMEOUT);
+	return (state != FAILED);
+}
+
+size_t TcpConnection::write(uint8_t data) {
+	return write(&data, 1);
+}
+
+/**
+ * Queue the data for sending, returns how much fitted into the send buffer.
+ */
+size_t TcpConnection::write(const uint8_t *buffer, size_t size) {
+	if (pcb == NULL || state != READY || size == 0) {
+		return 0;
+	}
+	size_t length = min(size, (size_t) tcp_sndbuf(pcb));
+	if (length == 0 || tcp_write(pcb, buffer, length, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+		return 0;
+	}
+	tcp_output(pcb);
+	return length;
+}
+
+int TcpConnection::available() {
+	return (rx == NULL ? 0 : rx->tot_len - rxOffset);
+}
+
+int TcpConnection::read() {
+	uint8_t data;
+	return (read(&data, 1) == 1 ? data : -1);
+}
+
+int TcpConnection::read(uint8_t *buffer, size_t size) {
+	size_t copied = 0;
+	while (rx != NULL && copied < size) {
+		size_t length = min(size - copied, (size_t) (rx->len - rxOffset));
+		memcpy(buffer + copied, (uint8_t *) rx->payload + rxOffset, length);
+		copied += length;
+		consume(length);
+	}
+	return copied;
+}
+
+int TcpConnection::peek() {
+	return (rx == NULL ? -1 : ((uint8_t *) rx->payload)[rxOffset]);
+}
+
+void TcpConnection::flush() {
+	flush(0);
+}
+
+/**
+ * Send the queued data now, doesn't wait for the acknowledgement.
+ */
+bool TcpConnection::flush(unsigned int) {
+	if (pcb != NULL && state == READY) {
+		tcp_output(pcb);
+	}
+	return true;
+}
+
+/**
+ * Close the connection (or abort the attempt) and discard the unread data.
+ */
+bool TcpConnection::stop(unsigned int) {
+	close();
+	if (rx != NULL) {
+		pbuf_free(rx);
+		rx = NULL;
+	}
+	rxOffset = 0;
+	state = IDLE;
+	return true;
+}
+
+/**
+ * Returns true while the connection is established or received data is left.
+ */
+uint8_t TcpConnection::connected() {
+	return (state == READY && pcb != NULL) || available() > 0;
+}
+
+TcpConnection::operator bool() {
+	return connected();
+}
+
+/**
+ * The address of the host is known, connect to it if requested.
+ */
+void TcpConnection::resolved(const ip_addr_t *resolvedAddress) {
+	address = IPAddress(resolvedAddress);
+	if (!connectAfterResolve) {
+		state = READY;
+		return;
+	}
+
+	pcb = tcp_new();
+	if (pcb == NULL) {
+		state = FAILED;
+		return;
+	}
+	tcp_arg(pcb, this);
+	tcp_err(pcb, onError);
+	tcp_recv(pcb, onReceive);
+	tcp_nagle_disable(pcb);
+	state = CONNECTING;
+	if (tcp_connect(pcb, resolvedAddress, port, onConnected) != ERR_OK) {
+		close();
+		state = FAILED;
+	}
+}
+
+/**
+ * Release the read part of the first pbuf and open the receive window accordingly.
+ */
+void TcpConnection::consume(size_t length) {
+	rxOffset += length;
+	if (rxOffset >= rx->len) {
+		pbuf *head = rx;
+		rx = rx->next;
+		if (rx != NULL) {
+			pbuf_ref(rx); // keeps the rest of the chain when the head is freed
+		}
+		pbuf_free(head);
+		rxOffset = 0;
+	}
+	if (pcb != NULL) {
+		tcp_recved(pcb, length);
+	}
+}
+
+/**
+ * Detach from the pcb and close it, abort it if that's not possible.
+ */
+void TcpConnection::close() {
+	if (pcb == NULL) {
+		return;
+	}
+	tcp_arg(pcb, NULL);
+	tcp_err(pcb, NULL);
+	tcp_recv(pcb, NULL);
+	if (tcp_close(pcb) != ERR_OK) {
+		tcp_abort(pcb);
+	}
+	pcb = NULL;
+}
+
+void TcpConnection::onResolved(const char *name, const ip_addr_t *address, void *argument) {
+	TcpConnection *connection = (TcpConnection *) argument;
+	if (connection->state != RESOLVING || strcmp(name, connection->host) != 0) {
+		return; // an earlier attempt which was stopped or timed out
+	}
+	if (address == NULL) {
+		connection->state = FAILED;
+	} else {
+		connection->resolved(address);
+	}
+}
+
+err_t TcpConnection::onConnected(void *argument, tcp_pcb *, err_t) {
+	TcpConnection *connection = (TcpConnection *) argument;
+	if (connection != NULL) {
+		connection->state = READY;
+	}
+	return ERR_OK;
+}
+
+err_t TcpConnection::onReceive(void *argument, tcp_pcb *pcb, pbuf *buffer, err_t) {
+	TcpConnection *connection = (TcpConnection *) argument;
+	if (connection == NULL) {
+		if (buffer != NULL) {
+			pbuf_free(buffer);
+		}
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
+	if (buffer == NULL) { // closed by the peer
+		tcp_arg(pcb, NULL);
+		tcp_err(pcb, NULL);
+		tcp_recv(pcb, NULL);
+		connection->pcb = NULL;
+		connection->state = CLOSED;
+		if (tcp_close(pcb) != ERR_OK) {
+			tcp_abort(pcb);
+			return ERR_ABRT;
+		}
+		return ERR_OK;
+	}
+	if (connection->rx == NULL) {
+		connection->rx = buffer;
+	} else {
+		pbuf_cat(connection->rx, buffer);
+	}
+	return ERR_OK;
+}
+
+/**
+ * lwIP already freed the pcb.
+ */
+void TcpConnection::onError(void *argument, err_t) {
+	TcpConnection *connection = (TcpConnection *) argument;
+	if (connection != NULL) {
+		connection->pcb = NULL;
+		connection->state = (connection->state == READY ? CLOSED : FAILED);
+	}
+}
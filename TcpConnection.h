@@ -0,0 +1,79 @@
+/*
+ * TcpConnection.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef TCPCONNECTION_H_
+#define TCPCONNECTION_H_
+
+#include <Arduino.h>
+#include <Client.h>
+#include <IPAddress.h>
+#include <lwip/tcp.h>
+#include <lwip/dns.h>
+#include "Config.h"
+
+#define TCP_CONNECTION_TIMEOUT 1500 // default time allowed for the lookup and the connection (in ms)
+
+/*
+ * A TCP client connection which never waits: the host name is resolved and the connection
+ * established in the background, the state is polled with getState().
+ */
+class TcpConnection : public Client
+{
+public:
+    enum State
+    {
+        IDLE = 0, // not started or stopped
+        RESOLVING = 1, // waiting for the DNS lookup
+        CONNECTING = 2, // waiting for the TCP handshake
+        READY = 3, // connected, or the address is resolved if no connection was requested
+        CLOSED = 4, // the connection was closed by the peer or lost
+        FAILED = 5 // the lookup or the connection failed or timed out
+    };
+
+    TcpConnection();
+    virtual ~TcpConnection();
+    void begin(const char *host, uint16_t port, bool connect, uint32_t timeout);
+    State getState(uint32_t now);
+    IPAddress getAddress();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    bool flush(unsigned int maxWaitMs) override;
+    bool stop(unsigned int maxWaitMs = 0) override;
+    uint8_t connected() override;
+    operator bool() override;
+
+private:
+    void resolved(const ip_addr_t *address);
+    void consume(size_t length);
+    void close();
+    static void onResolved(const char *name, const ip_addr_t *address, void *argument);
+    static err_t onConnected(void *argument, tcp_pcb *pcb, err_t error);
+    static err_t onReceive(void *argument, tcp_pcb *pcb, pbuf *buffer, err_t error);
+    static void onError(void *argument, err_t error);
+
+    tcp_pcb *pcb;
+    pbuf *rx; // received data which wasn't read yet
+    size_t rxOffset; // read position in the first pbuf of rx
+    volatile State state;
+    char host[CONFIG_URL_SIZE];
+    uint16_t port;
+    IPAddress address; // resolved address of host
+    bool connectAfterResolve; // false if only the address is needed (e.g. for UDP)
+    uint32_t startTime; // of the lookup (in ms)
+    uint32_t timeout; // for the lookup and the connection (in ms)
+};
+
+#endif /* TCPCONNECTION_H_ */
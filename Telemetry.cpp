@@ -0,0 +1,92 @@
+/*
+ * Telemetry.cpp
+ *
+ * Sends the key values of every status sample as one UDP datagram to a multicast group or as
+ * broadcast. Any number of consumers on the local network (e.g. EV charger, heat pump, data
+ * logger) can listen to it, while polling /data would cost one HTTP transaction per consumer.
+ *
+ * The datagram is a single line of JSON, e.g.
+ * {"seq":1234,"time":567890,"maxCurrent":78,"maxPower":1800,"override":false,"pvVoltage":228.5,
+ *  "pvPower":2050,"outPower":1760,"batteryVoltage":26.80,"batteryCurrent":3,"soc":853,"mode":3,"warning":0}
+ *
+ * maxCurrent is in 0.1A (0xffff if the override switch is active), soc in 0.1%. The sequence number
+ * increases with every sample, so consumers can detect lost datagrams.
+ *
+ * It's sent on the station interface if connected and on the AP interface if clients are
+ * connected to it.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "Telemetry.h"
+
+/**
+ * Constructor
+ */
+Telemetry::Telemetry() {
+	sequence = 0;
+}
+
+Telemetry::~Telemetry() {
+}
+
+/**
+ * Send the current values of the inverter and battery, called for every status sample.
+ */
+void Telemetry::publish() {
+	sequence++;
+	if (config->telemetryMode == TELEMETRY_DISABLED) {
+		return;
+	}
+
+	char payload[TELEMETRY_PAYLOAD_SIZE];
+	size_t length = toJSON(payload, sizeof(payload));
+
+	if (WiFi.isConnected()) {
+		send(WiFi.localIP(), WiFi.subnetMask(), payload, length);
+	}
+	if (WiFi.softAPgetStationNum() > 0) {
+		IPAddress netmask;
+		netmask.fromString(config->wifiApNetmask);
+		send(WiFi.softAPIP(), netmask, payload, length);
+	}
+}
+
+/**
+ * Write the current values as JSON to the buffer (also used by Mqtt), returns the length.
+ */
+size_t Telemetry::toJSON(char *buffer, size_t size) {
+	bool override = inverter.isPowerOverride();
+	int length = snprintf_P(buffer, size,
+			PSTR("{\"seq\":%lu,\"time\":%lu,\"maxCurrent\":%u,\"maxPower\":%u,\"override\":%S,\"pvVoltage\":%.1f,"
+					"\"pvPower\":%u,\"outPower\":%u,\"batteryVoltage\":%.2f,\"batteryCurrent\":%d,\"soc\":%u,"
+					"\"mode\":%d,\"warning\":%lu}"), sequence, millis(),
+			override ? 0xffff : inverter.getMaximumSolarCurrent(), inverter.getMaximumSolarPower(),
+			override ? PSTR("true") : PSTR("false"), inverter.getPvVoltage(), inverter.getPvPower(),
+			inverter.getOutPower(), battery.getVoltage(), battery.getCurrent(), battery.getSOC(), inverter.getMode(),
+			inverter.getWarning());
+	return min((size_t) max(length, 0), size - 1);
+}
+
+/**
+ * Send the datagram via the interface with the given address.
+ */
+bool Telemetry::send(IPAddress interfaceAddress, IPAddress netmask, const char *payload, size_t length) {
+	if (config->telemetryMode == TELEMETRY_MULTICAST) {
+		IPAddress group;
+		group.fromString(config->telemetryAddress);
+		if (!udp.beginPacketMulticast(group, config->telemetryPort, interfaceAddress)) {
+			return false;
+		}
+	} else {
+		IPAddress broadcast((uint32_t) interfaceAddress | ~(uint32_t) netmask);
+		if (!udp.beginPacket(broadcast, config->telemetryPort)) {
+			return false;
+		}
+	}
+	udp.write((const uint8_t *) payload, length);
+	return udp.endPacket();
+}
+
+Telemetry telemetry;
@@ -0,0 +1,43 @@
+/*
+ * Telemetry.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "Logger.h"
+#include "Config.h"
+#include "Inverter.h"
+
+#define TELEMETRY_PAYLOAD_SIZE 256
+
+class Telemetry
+{
+public:
+    enum TelemetryMode
+    {
+        TELEMETRY_DISABLED = 0,
+        TELEMETRY_MULTICAST = 1,
+        TELEMETRY_BROADCAST = 2
+    };
+
+    Telemetry();
+    virtual ~Telemetry();
+    void publish();
+    size_t toJSON(char *buffer, size_t size);
+
+private:
+    bool send(IPAddress interfaceAddress, IPAddress netmask, const char *payload, size_t length);
+
+    WiFiUDP udp;
+    uint32_t sequence; // number of the sample, allows consumers to detect lost datagrams
+};
+
+extern Telemetry telemetry;
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,172 @@
+/*
+ * UploadFile.cpp
+ *
+ * Writes an uploaded file so that a failed or aborted upload never leaves a truncated file
+ * behind: the data goes to UPLOAD_TEMP_FILE, which is only renamed to the final name once
+ * the upload is complete. Between close() and commit() the complete data can be checked
+ * in UPLOAD_TEMP_FILE (e.g. a new configuration).
+ *
+ * The chunks of an upload (up to HTTP_UPLOAD_BUFLEN bytes, cut at arbitrary positions) are
+ * collected in a buffer with the size of a block of the file system, so LittleFS always gets
+ * whole blocks at block aligned offsets and doesn't have to read back and program partial
+ * pages for every chunk. The buffer is only allocated while an upload is running.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include "UploadFile.h"
+#include "Logger.h"
+
+/**
+ * Constructor
+ */
+UploadFile::UploadFile() {
+	buffer = NULL;
+	bufferSize = 0;
+	length = 0;
+	size = 0;
+	closed = false;
+	startTime = 0;
+	duration = 0;
+}
+
+UploadFile::~UploadFile() {
+	abort();
+}
+
+/**
+ * Start a new upload which will be stored as path.
+ */
+bool UploadFile::open(const String &path) {
+	abort();
+	this->path = path;
+	size = 0;
+	length = 0;
+	duration = 0;
+	startTime = millis();
+
+	file = LittleFS.open(UPLOAD_TEMP_FILE, "w");
+	if (!file) {
+		LOG_ERROR("Failed to open %s", UPLOAD_TEMP_FILE);
+		return false;
+	}
+
+	FSInfo info;
+	LittleFS.info(info);
+	bufferSize = min(info.blockSize, (size_t) UPLOAD_BUFFER_MAX_SIZE);
+	buffer = (uint8_t *) malloc(bufferSize);
+	if (buffer == NULL) {
+		LOG_WARN("no memory for the upload buffer, writing unbuffered");
+		bufferSize = 0;
+	}
+	return true;
+}
+
+/**
+ * Add the next chunk of data.
+ */
+bool UploadFile::write(const uint8_t *data, size_t dataLength) {
+	if (!file) {
+		return false;
+	}
+	size += dataLength;
+	if (buffer == NULL) {
+		return file.write(data, dataLength) == dataLength;
+	}
+
+	while (dataLength > 0) {
+		size_t count = min(dataLength, bufferSize - length);
+		memcpy(buffer + length, data, count);
+		length += count;
+		data += count;
+		dataLength -= count;
+		if (length == bufferSize && !flush()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Write the rest of the data and close UPLOAD_TEMP_FILE, the existing file is not replaced yet.
+ */
+bool UploadFile::close() {
+	if (!file) {
+		return closed;
+	}
+	bool success = flush();
+	file.close();
+	release();
+	if (!success) {
+		LOG_ERROR("could not write %s", UPLOAD_TEMP_FILE);
+		LittleFS.remove(UPLOAD_TEMP_FILE);
+		return false;
+	}
+	closed = true;
+	return true;
+}
+
+/**
+ * Write the rest of the data (if not closed yet) and replace the file with the uploaded one.
+ */
+bool UploadFile::commit() {
+	if (!close()) {
+		return false;
+	}
+	closed = false;
+	if (!LittleFS.rename(UPLOAD_TEMP_FILE, path)) {
+		LOG_ERROR("could not store %s", path.c_str());
+		LittleFS.remove(UPLOAD_TEMP_FILE);
+		return false;
+	}
+	duration = millis() - startTime;
+	return true;
+}
+
+/**
+ * Discard the uploaded data, the existing file stays untouched.
+ */
+void UploadFile::abort() {
+	if (file || closed) {
+		file.close();
+		LittleFS.remove(UPLOAD_TEMP_FILE);
+	}
+	closed = false;
+	release();
+}
+
+/**
+ * Return the name under which the file is stored.
+ */
+const String &UploadFile::getPath() {
+	return path;
+}
+
+/**
+ * Return the number of bytes received.
+ */
+size_t UploadFile::getSize() {
+	return size;
+}
+
+/**
+ * Return the time from the start of the upload until the file was stored (in ms).
+ */
+uint32_t UploadFile::getDuration() {
+	return duration;
+}
+
+bool UploadFile::flush() {
+	if (length > 0 && file.write(buffer, length) != length) {
+		return false;
+	}
+	length = 0;
+	return true;
+}
+
+void UploadFile::release() {
+	free(buffer);
+	buffer = NULL;
+	length = 0;
+}
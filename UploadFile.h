@@ -0,0 +1,47 @@
+/*
+ * UploadFile.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef UPLOADFILE_H_
+#define UPLOADFILE_H_
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FS.h>
+
+#define UPLOAD_TEMP_FILE "/upload.tmp" // the data is written here until the upload is complete
+#define UPLOAD_BUFFER_MAX_SIZE 4096 // upper limit of the write buffer, otherwise the block size of the file system
+
+class UploadFile
+{
+public:
+    UploadFile();
+    virtual ~UploadFile();
+    bool open(const String &path);
+    bool write(const uint8_t *data, size_t length);
+    bool close();
+    bool commit();
+    void abort();
+    const String &getPath();
+    size_t getSize();
+    uint32_t getDuration();
+
+private:
+    bool flush();
+    void release();
+
+    File file;
+    String path; // the final name of the file
+    uint8_t *buffer;
+    size_t bufferSize;
+    size_t length; // number of bytes in the buffer
+    size_t size; // total number of bytes received
+    bool closed; // true if the data is completely written to UPLOAD_TEMP_FILE
+    uint32_t startTime; // in ms
+    uint32_t duration; // in ms
+};
+
+#endif /* UPLOADFILE_H_ */
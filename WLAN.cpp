@@ -7,6 +7,11 @@
  * So no power from a connected battery or grid is used.
  * This is useful e.g. when charging an electric car.
  *
+ * If configured, the maximum solar current is pushed to the consumer via HTTP POST or
+ * UDP as soon as it changes, so the consumer doesn't have to poll /maxCurrent. The address
+ * of the consumer is resolved and the connection established in the background, loop() only
+ * polls their state and the sample path only sends on a ready connection.
+ *
  * When a client is connected to our AP, the output D5 goes high,
  * allowing an LED to signal a connected client. When this device is
  * connected to the consumer's WLAN, D6 will go high.
@@ -15,14 +20,37 @@
  *      Author: Michael Neuweiler
  */
 
+#include <coredecls.h> // crc32()
 #include "WLAN.h"
+#include "WebServer.h"
+#include "Profiler.h"
 
 /**
  * Constructor
  */
 WLAN::WLAN() {
-	lastConnectionAttempt = 0;
+	nextConnectionAttempt = 0;
+	connectStartTime = 0;
+	fastConnect = false;
+	deferred = false;
+	connectionAttempts = 0;
+	fastAttempts = 0;
+	failedAttempts = 0;
+	suppressedAttempts = 0;
+	blockedTime = 0;
+	connectingTime = 0;
+	memset(&stationCache, 0, sizeof(stationCache));
+	stationState = STATION_DISABLED;
 	isConnected = false;
+	lastPushTime = 0;
+	pushRetryTime = 0;
+	lastPushedPower = -1;
+	lastPushedOverride = false;
+	pushHost[0] = 0;
+	pushPort = 0;
+	pushMode = PUSH_DISABLED;
+	pushes = 0;
+	pushFailures = 0;
 }
 
 WLAN::~WLAN() {
@@ -35,24 +63,25 @@ void WLAN::init() {
 	pinMode(PIN_LED_WIFI_CONNECTED, OUTPUT);
 
 	uint8_t wifiMode = WIFI_AP_STA; // act as AccessPoint or Station
-	if (config.wifiStationSsid[0] == 0) {
+	if (config->wifiStationSsid[0] == 0) {
 		wifiMode = WIFI_AP; // act as AccessPoint only
 	}
-	if (config.wifiApSsid[0] == 0) {
+	if (config->wifiApSsid[0] == 0) {
 		wifiMode = WIFI_STA; // act as Station only
 	}
 
 	WiFi.persistent(false); // prevent flash memory wear ! (https://github.com/esp8266/Arduino/issues/1054)
-	WiFi.hostname(config.wifiHostname);
+	WiFi.hostname(config->wifiHostname);
 
-	if (wifiMode == WIFI_AP_STA || wifiMode == WIFI_STA) {
-		setupStation();
-	}
+	// start the AP first, the station connects in the background (see checkConnection())
 	if (wifiMode == WIFI_AP_STA || wifiMode == WIFI_AP) {
 		setupAccessPoint();
 	}
+	if (wifiMode == WIFI_AP_STA || wifiMode == WIFI_STA) {
+		setupStation();
+	}
 
-	if (config.wifiApNAT && wifiMode == WIFI_AP_STA) {
+	if (config->wifiApNAT && wifiMode == WIFI_AP_STA) {
 		setupNAT();
 	}
 }
@@ -61,7 +90,10 @@ void WLAN::init() {
  * The main processing logic.
  */
 void WLAN::loop() {
+	uint32_t now = millis();
 	checkConnection();
+	preparePush(now);
+	pushMaxCurrent();
 }
 
 /**
@@ -69,55 +101,194 @@ void WLAN::loop() {
  * and set digital ports high/low accordingly. Tries to (re)establish
  * a connection to the target WLAN.
  *
+ * The connection is established asynchronously, this is only polling the state so the AP,
+ * web server and inverter keep running while the station connects.
  * As in dual mode (WIFI_AP_STA) the auto reconnect has to be
- * disabled, we need to manually try to connect to the AP every 15sec.
+ * disabled, we need to manually try to (re)connect. While the station searches the network,
+ * the softAP is blocked, so failed attempts are retried with an exponential backoff and
+ * postponed while clients are using the web server.
+ *
+ * The time the loop spends here while the station isn't connected (polling the state, reading
+ * and writing the station cache, starting the attempt and logging) is summed up in blockedTime.
  */
 void WLAN::checkConnection() {
-	if (WiFi.isConnected()) {
-		isConnected = true;
-	} else {
-		isConnected = false;
+	PROFILE(WLAN_CHECK_CONNECTION);
+	uint32_t start = micros();
+	uint32_t now = millis();
+	StationState previousState = stationState;
 
-		// we try to (re)establish connection every 15sec, this allows softAP to work (although it gets blocked for 1-2sec)
-		if (config.wifiStationSsid[0] && millis() - lastConnectionAttempt > config.wifiStationReconnectInterval) {
-			logger.info(F("attempting to (re)connect to %s"), config.wifiStationSsid);
-			WiFi.reconnect();
-			lastConnectionAttempt = millis();
+	switch (stationState) {
+	case STATION_CONNECTING:
+		if (WiFi.isConnected()) {
+			uint32_t duration = now - connectStartTime;
+			stationState = STATION_CONNECTED;
+			connectingTime += duration;
+			connectDuration.add(duration);
+			failedAttempts = 0;
+			saveStationCache();
+			LOG_INFO("connected to %s as %s after %lums", config->wifiStationSsid, WiFi.localIP().toString().c_str(),
+					duration);
+		} else if (WiFi.status() == WL_NO_SSID_AVAIL || WiFi.status() == WL_CONNECT_FAILED
+				|| now - connectStartTime > STATION_CONNECT_TIMEOUT) {
+			LOG_WARN("unable to connect to %s (status %d)", config->wifiStationSsid, WiFi.status());
+			connectingTime += now - connectStartTime;
+			stationState = STATION_DISCONNECTED;
+			if (fastConnect) { // maybe the AP changed its channel, retry immediately with a full scan
+				invalidateStationCache();
+				nextConnectionAttempt = now;
+			} else {
+				failedAttempts++;
+				nextConnectionAttempt = now + getBackoff();
+			}
+		}
+		break;
+	case STATION_CONNECTED:
+		if (!WiFi.isConnected()) {
+			LOG_WARN("lost connection to %s", config->wifiStationSsid);
+			stationState = STATION_DISCONNECTED;
+			nextConnectionAttempt = now;
 		}
+		break;
+	case STATION_DISCONNECTED:
+		if ((int32_t) (now - nextConnectionAttempt) >= 0) {
+			if (isServingClients() && now - nextConnectionAttempt < RECONNECT_MAX_DEFER) {
+				if (!deferred) {
+					deferred = true;
+					suppressedAttempts++;
+				}
+				break;
+			}
+			deferred = false;
+			LOG_INFO("attempting to (re)connect to %s", config->wifiStationSsid);
+			connectStation();
+		}
+		break;
+	case STATION_DISABLED:
+		break;
+	}
+	isConnected = (stationState == STATION_CONNECTED);
+	if (previousState != STATION_DISABLED && (previousState != STATION_CONNECTED || !isConnected)) {
+		blockedTime += micros() - start;
 	}
 
 	// indicate connection status via LED
 	digitalWrite(PIN_LED_WIFI_CONNECTED, (isConnected ? HIGH : LOW));
 }
 
+/**
+ * Start to connect to the configured network, this doesn't wait for the connection.
+ */
 void WLAN::setupStation() {
+	uint32_t start = micros();
 	WiFi.setAutoReconnect(false); // auto-reconnect tries every 1sec, messes up soft-ap (can't connect)
-	logger.info(F("Wifi: connecting to access point %s"), config.wifiStationSsid);
-	WiFi.begin(config.wifiStationSsid, config.wifiStationPassword);
+	LOG_INFO("Wifi: connecting to access point %s", config->wifiStationSsid);
+	connectStation();
+	blockedTime += micros() - start;
+}
+
+/**
+ * Start a connection attempt. If the BSSID and channel of the last successful connection are
+ * known, only this channel is probed which takes a fraction of the time of a full scan.
+ */
+void WLAN::connectStation() {
+	fastConnect = loadStationCache();
+	if (fastConnect) {
+		WiFi.begin(config->wifiStationSsid, config->wifiStationPassword, stationCache.channel, stationCache.bssid);
+		fastAttempts++;
+	} else {
+		WiFi.begin(config->wifiStationSsid, config->wifiStationPassword);
+	}
+	connectionAttempts++;
+	connectStartTime = millis();
+	stationState = STATION_CONNECTING;
+}
+
+/**
+ * Calculate the time until the next connection attempt: the reconnect interval doubled with
+ * every failed attempt up to RECONNECT_MAX_INTERVAL, +/- 25% jitter.
+ */
+uint32_t WLAN::getBackoff() {
+	uint32_t interval = config->wifiStationReconnectInterval;
+	for (uint8_t i = 1; i < failedAttempts && interval < RECONNECT_MAX_INTERVAL; i++) {
+		interval *= 2;
+	}
+	interval = min(interval, (uint32_t) RECONNECT_MAX_INTERVAL);
+	return interval + random(-(int32_t) interval / 4, interval / 4);
+}
+
+/**
+ * Returns true if clients connected to our AP recently used the web server.
+ */
+bool WLAN::isServingClients() {
+	return WiFi.softAPgetStationNum() > 0 && millis() - webServer.getLastRequestTime() < ACTIVE_CLIENT_TIMEOUT;
+}
 
-	uint8_t i = 60;
-	while (!WiFi.isConnected() && i-- > 0) {
-		logger.console(F("waiting (%d)..."), i);
-		delay(500);
+/**
+ * Read the BSSID and channel of the last connection from the RTC memory (survives a reset
+ * but not a power loss). Returns false if no valid data is available.
+ */
+bool WLAN::loadStationCache() {
+	if (!ESP.rtcUserMemoryRead(WIFI_RTC_OFFSET, (uint32_t *) &stationCache, sizeof(stationCache))) {
+		return false;
 	}
-	logger.info(F("started WiFi Station: %s"), WiFi.localIP().toString().c_str());
+	return stationCache.crc == crc32(((uint8_t *) &stationCache) + 4, sizeof(stationCache) - 4)
+			&& stationCache.channel > 0;
+}
+
+/**
+ * Store the BSSID and channel of the current connection in the RTC memory.
+ */
+void WLAN::saveStationCache() {
+	memcpy(stationCache.bssid, WiFi.BSSID(), sizeof(stationCache.bssid));
+	stationCache.channel = WiFi.channel();
+	stationCache.crc = crc32(((uint8_t *) &stationCache) + 4, sizeof(stationCache) - 4);
+	ESP.rtcUserMemoryWrite(WIFI_RTC_OFFSET, (uint32_t *) &stationCache, sizeof(stationCache));
+}
+
+void WLAN::invalidateStationCache() {
+	memset(&stationCache, 0, sizeof(stationCache));
+	ESP.rtcUserMemoryWrite(WIFI_RTC_OFFSET, (uint32_t *) &stationCache, sizeof(stationCache));
 }
 
+/**
+ * Convert the connection statistics into a JSON string.
+ */
+String WLAN::metricsToJSON() {
+	JsonDocument doc;
+
+	doc[F("state")] = stationState;
+	doc[F("attempts")] = connectionAttempts;
+	doc[F("fastAttempts")] = fastAttempts;
+	doc[F("failedAttempts")] = failedAttempts;
+	doc[F("suppressedAttempts")] = suppressedAttempts;
+	doc[F("blockedTime")] = blockedTime / 1000;
+	doc[F("connectingTime")] = connectingTime + (stationState == STATION_CONNECTING ? millis() - connectStartTime : 0);
+	if (stationState == STATION_DISCONNECTED) {
+		doc[F("nextAttempt")] = (int32_t) (nextConnectionAttempt - millis());
+	}
+	JsonObject duration = doc[F("connectDuration")].to<JsonObject>();
+	connectDuration.toJSON(duration);
+	doc[F("pushes")] = pushes;
+	doc[F("pushFailures")] = pushFailures;
+
+	String str;
+	serializeJson(doc, str);
+	return str;
+}
 
 void WLAN::setupAccessPoint() {
 	IPAddress localIp;
-	localIp.fromString(config.wifiApAddress);
+	localIp.fromString(config->wifiApAddress);
 	IPAddress gateway;
-	gateway.fromString(config.wifiApGateway);
+	gateway.fromString(config->wifiApGateway);
 	IPAddress subnet;
-	subnet.fromString(config.wifiApNetmask);
+	subnet.fromString(config->wifiApNetmask);
 
 	WiFi.softAPConfig(localIp, gateway, subnet);
-	WiFi.softAP(config.wifiApSsid, config.wifiApPassword, config.wifiApChannel);
-	delay(100); // wait for SYSTEM_EVENT_AP_START
+	WiFi.softAP(config->wifiApSsid, config->wifiApPassword, config->wifiApChannel);
 
-	logger.info(F("started WiFi AP %s on ip %s, channel %d"), config.wifiApSsid, WiFi.softAPIP().toString().c_str(),
-			config.wifiApChannel);
+	LOG_INFO("started WiFi AP %s on ip %s, channel %d", config->wifiApSsid, WiFi.softAPIP().toString().c_str(),
+			config->wifiApChannel);
 }
 
 /**
@@ -128,13 +299,13 @@ void WLAN::setupAccessPoint() {
  */
 void WLAN::setupNAT() {
 	err_t ret = ip_napt_init(NAPT, NAPT_PORT);
-	logger.debug(F("ip_napt_init: %d (OK=%d)"), ret);
+	LOG_DEBUG("ip_napt_init: %d (OK=%d)", ret, ERR_OK);
 	if (ret == ERR_OK) {
 		ret = ip_napt_enable_no(SOFTAP_IF, 1);
-		logger.debug(F("ip_napt_enable_no: %d"), ret);
+		LOG_DEBUG("ip_napt_enable_no: %d", ret);
 	}
 	if (ret != ERR_OK) {
-		logger.error(F("NAPT initialization failed\n"));
+		LOG_ERROR("NAPT initialization failed");
 	}
 
 	if (WiFi.isConnected()) { // give station's DNS servers to AP side (for NAT)
@@ -143,4 +314,121 @@ void WLAN::setupNAT() {
 	}
 }
 
+/**
+ * Returns true if the consumer can be reached, either through the station's network or
+ * as a client of our AP.
+ */
+bool WLAN::isConsumerReachable() {
+	return isConnected || WiFi.softAPgetStationNum() > 0;
+}
+
+/**
+ * Resolve the address of the consumer and establish the HTTP connection, so the push in the
+ * sample path never blocks. Both run in the background (see TcpConnection), here we only poll
+ * the state. If they aren't complete after PUSH_RESOLVE_TIMEOUT + PUSH_CONNECT_TIMEOUT, or fail,
+ * we wait PUSH_RETRY_INTERVAL before the next attempt. If the consumer is changed (PATCH /config
+ * or upload), the resolved address and the connection are dropped.
+ */
+void WLAN::preparePush(uint32_t now) {
+	if (strcmp(pushHost, config->consumerHost) != 0 || pushPort != config->consumerPort || pushMode != config->consumerPushMode) {
+		pushConnection.stop();
+		strcpy(pushHost, config->consumerHost);
+		pushPort = config->consumerPort;
+		pushMode = config->consumerPushMode;
+		pushRetryTime = 0;
+	}
+	if (pushMode == PUSH_DISABLED || pushHost[0] == 0 || !isConsumerReachable()
+			|| (pushRetryTime > 0 && now - pushRetryTime < PUSH_RETRY_INTERVAL)) {
+		return;
+	}
+
+	switch (pushConnection.getState(now)) {
+	case TcpConnection::RESOLVING:
+	case TcpConnection::CONNECTING:
+	case TcpConnection::READY:
+		break;
+	case TcpConnection::FAILED:
+		LOG_WARN("unable to resolve or connect to consumer %s:%d", pushHost, pushPort);
+		pushConnection.stop();
+		pushFailures++;
+		pushRetryTime = now;
+		break;
+	default: // not started yet or closed by the consumer
+		pushConnection.begin(pushHost, pushPort, pushMode == PUSH_HTTP, PUSH_RESOLVE_TIMEOUT + PUSH_CONNECT_TIMEOUT);
+		break;
+	}
+}
+
+/**
+ * Push the maximum solar current to the consumer if the maximum power changed by more than
+ * the configured threshold or the heartbeat interval elapsed.
+ *
+ * The HTTP connection is kept alive and responses are discarded without waiting for them.
+ * Nothing is sent until preparePush() resolved the consumer (and connected), a push which
+ * isn't possible yet is repeated by loop().
+ */
+void WLAN::pushMaxCurrent() {
+	if (config->consumerPushMode == PUSH_DISABLED || pushHost[0] == 0 || strcmp(pushHost, config->consumerHost) != 0
+			|| !isConsumerReachable()) {
+		return; // the consumer changed, wait for preparePush()
+	}
+
+	while (pushConnection.available()) { // drop the response of the last request
+		uint8_t discard[64];
+		pushConnection.read(discard, sizeof(discard));
+	}
+
+	uint16_t power = inverter.getMaximumSolarPower();
+	bool override = inverter.isPowerOverride();
+	uint32_t now = millis();
+	bool changed = abs((int32_t) power - lastPushedPower) >= config->consumerPushThreshold || override != lastPushedOverride;
+	bool heartbeat = config->consumerHeartbeatInterval > 0 && now - lastPushTime >= config->consumerHeartbeatInterval;
+
+	if (!(changed || heartbeat) || (pushRetryTime > 0 && now - pushRetryTime < PUSH_RETRY_INTERVAL)
+			|| pushConnection.getState(now) != TcpConnection::READY) {
+		return;
+	}
+
+	char payload[48];
+	uint16_t maxCurrent = override ? 0xffff : inverter.getMaximumSolarCurrent();
+	snprintf_P(payload, sizeof(payload), PSTR("{\"maxCurrent\": %u, \"maxPower\": %u}"), maxCurrent, power);
+
+	if (config->consumerPushMode == PUSH_HTTP ? sendHttp(payload) : sendUdp(payload)) {
+		lastPushedPower = power;
+		lastPushedOverride = override;
+		lastPushTime = now;
+		pushRetryTime = 0;
+		pushes++;
+	} else {
+		LOG_WARN("unable to push max current to %s:%d", pushHost, pushPort);
+		pushConnection.stop(); // reconnect in preparePush()
+		pushFailures++;
+		pushRetryTime = now;
+	}
+}
+
+/**
+ * Send the payload via HTTP POST on the persistent connection, returns false if the request
+ * couldn't be written completely.
+ */
+bool WLAN::sendHttp(const char *payload) {
+	char header[CONFIG_URL_SIZE * 2 + 96];
+	size_t payloadLength = strlen(payload);
+	size_t headerLength = snprintf_P(header, sizeof(header), PSTR("POST %s HTTP/1.1\r\nHost: %s\r\n"
+			"Content-Type: application/json\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n"),
+			config->consumerPath, pushHost, payloadLength);
+
+	return headerLength < sizeof(header) && pushConnection.write(header, headerLength) == headerLength
+			&& pushConnection.write(payload, payloadLength) == payloadLength;
+}
+
+/**
+ * Send the payload as UDP datagram.
+ */
+bool WLAN::sendUdp(const char *payload) {
+	size_t length = strlen(payload);
+	return pushUdp.beginPacket(pushConnection.getAddress(), pushPort) && pushUdp.write((const uint8_t *) payload, length) == length
+			&& pushUdp.endPacket();
+}
+
 WLAN wlan;
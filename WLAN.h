@@ -11,34 +11,104 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h>
 #include <WiFiClient.h>
+#include <WiFiUdp.h>
 #include <lwip/napt.h>
 #include <lwip/dns.h>
 //#include <dhcpserver.h>
 
 #include "Logger.h"
 #include "Inverter.h"
+#include "Histogram.h"
+#include "TcpConnection.h"
 
 #define NAPT 1000
 #define NAPT_PORT 10
 
+#define STATION_CONNECT_TIMEOUT 30000 // max time to wait for the connection to the station's network (in ms)
+#define RECONNECT_MAX_INTERVAL 300000 // upper limit of the backoff between connection attempts (in ms)
+#define RECONNECT_MAX_DEFER 120000 // max time a connection attempt is postponed while clients are served (in ms)
+#define ACTIVE_CLIENT_TIMEOUT 10000 // time after the last web request at which clients are considered inactive (in ms)
+#define WIFI_RTC_OFFSET 0 // position of the station cache in the RTC user memory (in 4 byte blocks)
+#define PUSH_CONNECT_TIMEOUT 500 // max time allowed for the connection to the consumer (in ms)
+#define PUSH_RETRY_INTERVAL 5000 // time to wait after a failed push (in ms)
+#define PUSH_RESOLVE_TIMEOUT 1000 // max time allowed for the DNS lookup of the consumer (in ms)
+
 class WLAN
 {
 public:
+    enum PushMode
+    {
+        PUSH_DISABLED = 0,
+        PUSH_HTTP = 1,
+        PUSH_UDP = 2
+    };
+
+    enum StationState
+    {
+        STATION_DISABLED,
+        STATION_CONNECTING,
+        STATION_CONNECTED,
+        STATION_DISCONNECTED
+    };
+
     WLAN();
     virtual ~WLAN();
     void init();
     void loop();
+    void pushMaxCurrent();
+    String metricsToJSON();
 
 private:
+    struct StationCache
+    {
+        uint32_t crc; // of the following data
+        uint8_t bssid[6];
+        uint8_t channel; // 0 = invalid
+        uint8_t reserved;
+    };
+
     bool mode(WiFiMode_t m);
 
     void checkConnection();
 	void setupStation();
+	void connectStation();
+	uint32_t getBackoff();
+	bool isServingClients();
+	bool loadStationCache();
+	void saveStationCache();
+	void invalidateStationCache();
 	void setupAccessPoint();
 	void setupNAT();
+	bool isConsumerReachable();
+	void preparePush(uint32_t now);
+	bool sendHttp(const char *payload);
+	bool sendUdp(const char *payload);
 
-    uint32_t lastConnectionAttempt;
+    uint32_t nextConnectionAttempt; // when the next connection attempt is due (in ms)
+    uint32_t connectStartTime; // when the current connection attempt was started (in ms)
+    StationState stationState;
     bool isConnected;
+    bool fastConnect; // true if the current attempt uses the cached BSSID and channel
+    bool deferred; // true if the due connection attempt is postponed because clients are served
+    StationCache stationCache;
+    uint32_t connectionAttempts;
+    uint32_t fastAttempts; // connection attempts using the cached BSSID and channel
+    uint32_t failedAttempts; // failed attempts since the last successful connection
+    uint32_t suppressedAttempts; // attempts postponed because clients were served
+    uint32_t blockedTime; // total time the loop spent reconnecting the station, incl. polling the state (in us)
+    uint32_t connectingTime; // total time the station was searching for the network (in ms)
+    Histogram connectDuration; // time until a connection was established (in ms)
+    TcpConnection pushConnection; // resolves pushHost and, for HTTP, holds the connection to it
+    WiFiUDP pushUdp;
+    char pushHost[CONFIG_URL_SIZE]; // the consumer host pushConnection belongs to
+    uint16_t pushPort; // the consumer port pushConnection belongs to
+    uint8_t pushMode; // the push mode pushConnection was started for
+    uint32_t pushes; // successful pushes
+    uint32_t pushFailures; // failed lookups, connection attempts and writes
+    uint32_t lastPushTime;
+    uint32_t pushRetryTime;
+    int32_t lastPushedPower;
+    bool lastPushedOverride;
 };
 
 extern WLAN wlan;
@@ -8,9 +8,26 @@
  */
 
 #include "WebServer.h"
+#include "WLAN.h"
+#include "Scheduler.h"
+#include "Profiler.h"
+#include "HeapMonitor.h"
+#include "Benchmark.h"
+#include "ChunkedWriter.h"
+
+static const char JSON_CONTENT_TYPE[] PROGMEM = "application/json";
+static const char HTML_CONTENT_TYPE[] PROGMEM = "text/html";
 
 WebServer::WebServer() {
 	uploadPath = "";
+	lastRequestTime = 0;
+	admissionChecked = false;
+	admissionRequest = Admission::REQUEST_DYNAMIC;
+	admissionResult = Admission::ADMITTED;
+	dataLength = 0;
+	dataSequence = 0;
+	bootId = 0;
+	uploadError = NULL;
 	server = new ESP8266WebServer(80);
 }
 
@@ -26,61 +43,193 @@ void WebServer::init() {
 	pinMode(PIN_POWER_OVERRIDE, INPUT);
 	digitalWrite(PIN_LED_CLIENT_CONNECTED, LOW);
 
+	const char *headers[] = { "If-None-Match" };
+	bootId = ESP.random();
+	server->collectHeaders(headers, 1);
     server->addHandler(this);
 	server->serveStatic("/", LittleFS, "/");
 	server->begin();
-	logger.info(F("started webserver"));
+	LOG_INFO("started webserver");
 }
 
 /**
- * The main processing logic.
+ * The main processing logic. The time spent on a generated response counts against the budget
+ * of the admission control, static files and uploads don't.
  */
 void WebServer::loop() {
+	PROFILE(WEB_SERVER_LOOP);
+	uint32_t start = micros();
+	admissionChecked = false;
 	server->handleClient();
+	if (admissionChecked && admissionRequest == Admission::REQUEST_DYNAMIC) {
+		admission.addBusyTime(micros() - start);
+	}
 	digitalWrite(PIN_LED_CLIENT_CONNECTED, server->client().connected() ? HIGH : LOW);
 }
 
 /**
- * Find out if we can handle the request.
+ * Return the time when the last request was received (in ms).
+ */
+uint32_t WebServer::getLastRequestTime() {
+	return lastRequestTime;
+}
+
+/**
+ * Find out if we can handle the request. As the first handler, this is called for every
+ * request, so the admission is checked here (once per request). Rejected requests are
+ * handled here too, including those for static files.
  */
 bool WebServer::canHandle(HTTPMethod method, const String& uri) {
-	if (logger.isDebug())
-		logger.debug(F("http request: %d, url: %s"), method, uri.c_str());
+	LOG_DEBUG("http request: %d, url: %s", method, uri.c_str());
+	lastRequestTime = millis();
 
-	if (method == HTTP_GET && (uri.equals(F("/data")) || uri.equals(F("/list")) || uri.equals(F("/maxCurrent")))) {
-		return true;
-	}
-	if (method == HTTP_POST && uri.equals(F("/upload"))) {
-		return true;
-	}
-	if (method == HTTP_POST && uri.equals(F("/grid"))) {
-		return true;
+	Route route = getRoute(method, uri);
+	if (!admissionChecked) {
+		admissionChecked = true;
+		if (route == ROUTE_MAX_CURRENT) {
+			admissionRequest = Admission::REQUEST_PRIORITY;
+		} else if (route == ROUTE_NONE || route == ROUTE_UPLOAD) {
+			admissionRequest = Admission::REQUEST_TRANSFER;
+		} else {
+			admissionRequest = Admission::REQUEST_DYNAMIC;
+		}
+		admissionResult = admission.admit(Admission::SERVER_WEB, server->client().remoteIP(), admissionRequest);
 	}
-	return false;
+	return route != ROUTE_NONE || admissionResult != Admission::ADMITTED;
 }
 
 bool WebServer::canUpload(const String& uri) {
-	return (canHandle(HTTP_POST, uri));
+	return (canHandle(HTTP_POST, uri) && admissionResult == Admission::ADMITTED);
+}
+
+/**
+ * Map the request to the handling function. The uri is compared against the flash strings
+ * directly, so no String temporaries are created.
+ */
+WebServer::Route WebServer::getRoute(HTTPMethod method, StringView uri) {
+	if (method == HTTP_GET) {
+		if (uri.equals(F("/data"))) {
+			return ROUTE_DATA;
+		}
+		if (uri.equals(F("/maxCurrent"))) {
+			return ROUTE_MAX_CURRENT;
+		}
+		if (uri.equals(F("/config"))) {
+			return ROUTE_CONFIG;
+		}
+		if (uri.equals(F("/list"))) {
+			return ROUTE_LIST;
+		}
+		if (uri.equals(F("/log"))) {
+			return ROUTE_LOG;
+		}
+		if (uri.startsWith(F("/debug/"))) {
+			if (uri.equals(F("/debug/latency"))) {
+				return ROUTE_DEBUG_LATENCY;
+			}
+			if (uri.equals(F("/debug/wifi"))) {
+				return ROUTE_DEBUG_WIFI;
+			}
+			if (uri.equals(F("/debug/tasks"))) {
+				return ROUTE_DEBUG_TASKS;
+			}
+			if (uri.equals(F("/debug/perf"))) {
+				return ROUTE_DEBUG_PERF;
+			}
+			if (uri.equals(F("/debug/heap"))) {
+				return ROUTE_DEBUG_HEAP;
+			}
+			if (uri.equals(F("/debug/bench"))) {
+				return ROUTE_DEBUG_BENCH;
+			}
+			if (uri.equals(F("/debug/http"))) {
+				return ROUTE_DEBUG_HTTP;
+			}
+		}
+	} else if (method == HTTP_PATCH) {
+		if (uri.equals(F("/config"))) {
+			return ROUTE_CONFIG;
+		}
+	} else if (method == HTTP_DELETE) {
+		if (uri.equals(F("/debug/perf"))) {
+			return ROUTE_DEBUG_PERF_RESET;
+		}
+	} else if (method == HTTP_POST) {
+		if (uri.equals(F("/upload"))) {
+			return ROUTE_UPLOAD;
+		}
+		if (uri.equals(F("/grid"))) {
+			return ROUTE_GRID;
+		}
+	}
+	return ROUTE_NONE;
 }
 
 /**
  * Handle a request and send the inverter data.
  */
 bool WebServer::handle(ESP8266WebServer& server, HTTPMethod requestMethod, const String& requestUri) {
-	if (requestUri.equals(F("/data"))) {
-		server.send(200, F("application/json"), inverter.toJSON());
-	} else if (requestUri.equals(F("/maxCurrent"))) {
-		uint16_t maxCurrent = digitalRead(PIN_POWER_OVERRIDE) == HIGH ? 0xffff : inverter.getMaximumSolarCurrent();
-		server.send(200, F("application/json"), String(F("{\"maxCurrent\": ")) + maxCurrent + "}");
-	} else if (requestUri.equals(F("/list"))) {
+	if (admissionResult != Admission::ADMITTED) {
+		replyRejected();
+		return true;
+	}
+
+	switch (getRoute(requestMethod, requestUri)) {
+	case ROUTE_DATA:
+		handleData();
+		break;
+	case ROUTE_MAX_CURRENT:
+		handleMaxCurrent();
+		break;
+	case ROUTE_CONFIG:
+		handleConfig(requestMethod);
+		break;
+	case ROUTE_LIST:
 		handleFileList();
-	} else if (requestUri.equals(F("/upload")) && requestMethod == HTTP_POST) {
+		break;
+	case ROUTE_LOG:
+		handleLog();
+		break;
+	case ROUTE_DEBUG_LATENCY:
+		server.send(200, F("application/json"), inverter.latencyToJSON());
+		break;
+	case ROUTE_DEBUG_WIFI:
+		server.send(200, F("application/json"), wlan.metricsToJSON());
+		break;
+	case ROUTE_DEBUG_TASKS:
+		server.send(200, F("application/json"), scheduler.toJSON());
+		break;
+	case ROUTE_DEBUG_PERF:
+		server.send(200, F("application/json"), profiler.toJSON());
+		break;
+	case ROUTE_DEBUG_PERF_RESET:
+		profiler.reset();
+		server.send(204);
+		break;
+	case ROUTE_DEBUG_HEAP:
+		server.send(200, F("application/json"), heapMonitor.toJSON());
+		break;
+	case ROUTE_DEBUG_BENCH:
+		server.send(200, F("application/json"), benchmark.run());
+		break;
+	case ROUTE_DEBUG_HTTP:
+		server.send(200, F("application/json"), admission.toJSON());
+		break;
+	case ROUTE_UPLOAD:
+		if (uploadError != NULL) {
+			replyServerError(uploadError);
+			break;
+		}
+		server.sendHeader(F("X-Upload-Size"), String(uploadFile.getSize()));
+		server.sendHeader(F("X-Upload-Duration"), String(uploadFile.getDuration()));
 		server.sendHeader(F("Location"), String(F("/list?dir=") + uploadPath), true);
 		server.send(302, F("text/plain"), "");
-	} else if (requestUri.equals(F("/grid"))) {
+		break;
+	case ROUTE_GRID:
 		inverter.switchToGrid();
 		server.send(200, F("text/plain"), F("Switched to grid mode"));
-	} else {
+		break;
+	case ROUTE_NONE:
 		return false;
 	}
 
@@ -88,7 +237,51 @@ bool WebServer::handle(ESP8266WebServer& server, HTTPMethod requestMethod, const
 }
 
 /**
- * Receive a file.
+ * Get the inverter data as JSON and its ETag (DATA_ETAG_SIZE). The JSON is only generated
+ * once per inverter response and cached, all clients (e.g. several dashboards or the API
+ * server) polling in between get the same copy. The ETag identifies the response (and the
+ * boot, as the numbering starts over).
+ */
+StringView WebServer::getData(char *etag) {
+	uint32_t sequence = inverter.getSequence();
+	if (dataLength == 0 || sequence != dataSequence) {
+		dataLength = inverter.toJSON(dataCache, sizeof(dataCache));
+		dataSequence = sequence;
+	}
+
+	snprintf_P(etag, DATA_ETAG_SIZE, PSTR("\"%08lx-%lu\""), bootId, dataSequence);
+	return StringView(dataCache, dataLength);
+}
+
+/**
+ * Send the inverter data, a client which already has the current data gets a 304 without content.
+ */
+void WebServer::handleData() {
+	char etag[DATA_ETAG_SIZE];
+	StringView data = getData(etag);
+
+	server->sendHeader(F("ETag"), etag);
+	server->sendHeader(F("Cache-Control"), F("no-cache"));
+	if (server->header(F("If-None-Match")).equals(etag)) {
+		server->send(304);
+		return;
+	}
+	server->send(200, JSON_CONTENT_TYPE, data.data(), data.size());
+}
+
+/**
+ * Send the maximum solar current (0xffff if the override is active).
+ */
+void WebServer::handleMaxCurrent() {
+	char response[24];
+	uint16_t maxCurrent = inverter.isPowerOverride() ? 0xffff : inverter.getMaximumSolarCurrent();
+	size_t length = snprintf_P(response, sizeof(response), PSTR("{\"maxCurrent\": %u}"), maxCurrent);
+	server->send(200, JSON_CONTENT_TYPE, response, length);
+}
+
+/**
+ * Receive a file. It's written to a temporary file and only replaces the existing one once
+ * the upload is complete. An uploaded config.json is validated and applied before it's stored.
  */
 void WebServer::upload(ESP8266WebServer& server, const String& requestUri, HTTPUpload& upload) {
 	if (upload.status == UPLOAD_FILE_START) {
@@ -96,76 +289,223 @@ void WebServer::upload(ESP8266WebServer& server, const String& requestUri, HTTPU
 		if (!filename.startsWith("/")) { // Make sure paths always start with "/"
 			filename = "/" + filename;
 		}
-		fsUploadFile = LittleFS.open(filename, "w");
-		if (!fsUploadFile) {
-			return replyServerError(F("CREATE FAILED"));
+		filename.replace(F("//"), F("/"));
+		uploadError = NULL;
+		if (!uploadFile.open(filename)) {
+			uploadError = F("CREATE FAILED");
 		}
-		logger.debug(F("Upload: START, filename: %s"), filename);
+		LOG_DEBUG("Upload: START, filename: %s", filename.c_str());
 	} else if (upload.status == UPLOAD_FILE_WRITE) {
-		if (fsUploadFile) {
-			size_t bytesWritten = fsUploadFile.write(upload.buf, upload.currentSize);
-			if (bytesWritten != upload.currentSize) {
-				return replyServerError(F("WRITE FAILED"));
-			}
+		if (uploadError == NULL && !uploadFile.write(upload.buf, upload.currentSize)) {
+			uploadFile.abort();
+			uploadError = F("WRITE FAILED");
 		}
-		logger.debug(F("Upload: WRITE, Bytes: %d"), upload.currentSize);
+		LOG_DEBUG("Upload: WRITE, Bytes: %d", upload.currentSize);
 	} else if (upload.status == UPLOAD_FILE_END) {
-		if (fsUploadFile) {
-			fsUploadFile.close();
+		if (uploadError == NULL) {
+			finishUpload();
 		}
-		logger.debug(F("Upload: END, Size: %d"), upload.totalSize);
+		LOG_DEBUG("Upload: END, Size: %d", upload.totalSize);
+	} else if (upload.status == UPLOAD_FILE_ABORTED) {
+		uploadFile.abort();
+		uploadError = F("UPLOAD ABORTED");
+	}
+}
 
-		config.load(); // re-load the config from new file
+/**
+ * Store the completely received file. An uploaded config.json is validated once it's
+ * completely written and only activated after it replaced the existing file, if it's invalid
+ * or can't be stored the existing file and configuration are kept.
+ */
+void WebServer::finishUpload() {
+	bool isConfig = uploadFile.getPath().equals(Config::CONFIG_FILE);
+
+	if (!uploadFile.close()) {
+		uploadError = F("WRITE FAILED");
+		return;
+	}
+	if (isConfig && !config.prepare(UPLOAD_TEMP_FILE)) {
+		uploadFile.abort();
+		uploadError = F("INVALID CONFIG");
+		return;
+	}
+	if (!uploadFile.commit()) {
+		uploadError = F("STORE FAILED");
+		return;
+	}
+	if (isConfig) {
+		config.activate();
 	}
+	uint32_t duration = max(uploadFile.getDuration(), (uint32_t) 1);
+	LOG_INFO("uploaded %s: %u bytes in %lums (%lu bytes/s)", uploadFile.getPath().c_str(), uploadFile.getSize(), duration,
+			(uint32_t) ((uint64_t) uploadFile.getSize() * 1000 / duration));
 }
 
 /**
- * Create file list and send as response.
+ * List the files of a directory (?dir=), either as HTML page with an upload form or as JSON
+ * (?format=json). The list is paginated with ?offset= and ?limit= (at most
+ * FILE_LIST_MAX_LIMIT entries) and streamed in chunks, so the memory used doesn't depend on
+ * the size of the directory. The usage of the file system is included.
  */
 void WebServer::handleFileList() {
 	String path = server->hasArg(F("dir")) ? server->arg(F("dir")) : "/";
+	uint32_t offset = server->hasArg(F("offset")) ? strtoul(server->arg(F("offset")).c_str(), NULL, 10) : 0;
+	uint32_t limit = server->hasArg(F("limit")) ? strtoul(server->arg(F("limit")).c_str(), NULL, 10) : FILE_LIST_DEFAULT_LIMIT;
+	bool json = server->arg(F("format")).equals(F("json"));
+	limit = constrain(limit, 1, FILE_LIST_MAX_LIMIT);
 	uploadPath = path;
 
-	Dir dir = LittleFS.openDir(path);
-	String output = F("<html><body>");
-	output += F("<h3>") + path + F("</h3><table>");
+	ChunkedWriter writer(*server);
+	if (!writer.begin(200, json ? JSON_CONTENT_TYPE : HTML_CONTENT_TYPE)) {
+		server->send(503, F("text/plain"), F("no buffer available"));
+		return;
+	}
 
-	if (path.length() > 1) {
-		String parent = path.substring(0, path.lastIndexOf('/'));
-		if (parent.length() == 0) {
-			parent = "/";
+	FSInfo info;
+	LittleFS.info(info);
+	if (json) {
+		writer.printf(PSTR("{\"path\":\""));
+		writer.print(path.c_str(), ChunkedWriter::ESCAPE_JSON);
+		writer.printf(PSTR("\",\"totalBytes\":%u,\"usedBytes\":%u,\"offset\":%lu,\"files\":["), info.totalBytes,
+				info.usedBytes, offset);
+	} else {
+		writer.printf(PSTR("<html><body><h3>"));
+		writer.print(path.c_str(), ChunkedWriter::ESCAPE_HTML);
+		writer.printf(PSTR("</h3><p>%u of %u kB used</p><table>"), info.usedBytes / 1024, info.totalBytes / 1024);
+		if (path.length() > 1) {
+			String parent = path.substring(0, max(path.lastIndexOf('/'), 1));
+			writer.printf(PSTR("<tr><td colspan='3'><a href='/list?dir="));
+			writer.print(parent.c_str(), ChunkedWriter::ESCAPE_HTML);
+			writer.printf(PSTR("'>..</a></td></tr>"));
 		}
-		output += F("<tr><td colspan='4'><a href='/list?dir=") + parent + F("'>..</a></td></tr>");
 	}
 	if (!path.endsWith("/")) {
-		path += "/";
+		path += '/';
 	}
 
+	Dir dir = LittleFS.openDir(path);
+	uint32_t count = 0;
 	while (dir.next()) {
-		File file = dir.openFile("r");
-		time_t time = file.getLastWrite();
-		String prefix = (file.isDirectory() ? F("/list?dir=") : F(""));
-		output += F("<tr>");
-		output += F("<td><a href='") + prefix + path + file.name() + F("'>") + file.name() + F("</a></td>");
-		output += F("<td style='text-align: right;'>") + (file.isDirectory() ? F("(dir)") : String(file.size()))
-				+ F("</td>");
-		output += F("<td style='text-align: right;'>") + String(ctime(&time)) + F("</td>");
-		output += F("</tr>");
-		file.close();
-	}
-	output += F("</table>");
-	output += F("<form action='/upload' method='POST' enctype='multipart/form-data'>");
-	output += F("Upload File: <input type='file' id='uploadFile' name='filename'>");
-	output += F("<input type='submit' value='Upload'>");
-	output += F("</form>");
-	output += F("</body></html>");
-
-	server->send(200, F("text/html"), output);
+		if (count++ < offset || count > offset + limit) {
+			continue; // only count the entries outside of the requested page
+		}
+		String name = dir.fileName();
+		time_t time = dir.fileTime();
+		char timeText[20];
+		strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", localtime(&time));
+
+		if (json) {
+			writer.printf(count > offset + 1 ? PSTR(",{\"name\":\"") : PSTR("{\"name\":\""));
+			writer.print(name.c_str(), ChunkedWriter::ESCAPE_JSON);
+			writer.printf(PSTR("\",\"dir\":%S,\"size\":%u,\"time\":%lu}"),
+					dir.isDirectory() ? PSTR("true") : PSTR("false"), dir.fileSize(), (uint32_t) time);
+		} else {
+			writer.printf(PSTR("<tr><td><a href='%S"), dir.isDirectory() ? PSTR("/list?dir=") : PSTR(""));
+			writer.print(path.c_str(), ChunkedWriter::ESCAPE_HTML);
+			writer.print(name.c_str(), ChunkedWriter::ESCAPE_HTML);
+			writer.printf(PSTR("'>"));
+			writer.print(name.c_str(), ChunkedWriter::ESCAPE_HTML);
+			if (dir.isDirectory()) {
+				writer.printf(PSTR("</a></td><td style='text-align: right;'>(dir)</td>"));
+			} else {
+				writer.printf(PSTR("</a></td><td style='text-align: right;'>%u</td>"), dir.fileSize());
+			}
+			writer.printf(PSTR("<td style='text-align: right;'>%s</td></tr>"), timeText);
+		}
+	}
+
+	if (json) {
+		writer.printf(PSTR("],\"total\":%lu}"), count);
+	} else {
+		writer.printf(PSTR("</table><p>"));
+		if (offset > 0) {
+			printPageLink(writer, path, offset > limit ? offset - limit : 0, limit, PSTR("previous"));
+		}
+		writer.printf(PSTR(" %lu-%lu of %lu "), min(offset + 1, count), min(offset + limit, count), count);
+		if (offset + limit < count) {
+			printPageLink(writer, path, offset + limit, limit, PSTR("next"));
+		}
+		writer.printf(PSTR("</p><form action='/upload' method='POST' enctype='multipart/form-data'>"
+				"Upload File: <input type='file' id='uploadFile' name='filename'>"
+				"<input type='submit' value='Upload'></form></body></html>"));
+	}
+	writer.end();
+}
+
+/**
+ * Add a link to another page of the file list.
+ */
+void WebServer::printPageLink(ChunkedWriter &writer, const String &path, uint32_t offset, uint32_t limit,
+		const char *text) {
+	writer.printf(PSTR("<a href='/list?dir="));
+	writer.print(path.c_str(), ChunkedWriter::ESCAPE_HTML);
+	writer.printf(PSTR("&offset=%lu&limit=%lu'>%S</a>"), offset, limit, text);
+}
+
+/**
+ * Send the buffered log output, starting at the position given by the parameter "since"
+ * (or the oldest available data). The header X-Log-Position contains the position to
+ * request the next part of the log, X-Log-Dropped the amount of bytes the serial port missed.
+ */
+void WebServer::handleLog() {
+	uint32_t position = server->hasArg(F("since")) ? strtoul(server->arg(F("since")).c_str(), NULL, 10) : 0;
+	uint32_t end = logger.getPosition();
+	char buffer[256];
+
+	server->sendHeader(F("X-Log-Position"), String(end));
+	server->sendHeader(F("X-Log-Dropped"), String(logger.getDropped()));
+	server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+#ifdef LOG_BINARY
+	server->send(200, F("application/octet-stream"), "");
+#else
+	server->send(200, F("text/plain"), "");
+#endif
+
+	size_t length;
+	while ((length = logger.read(position, end, buffer, sizeof(buffer))) > 0) {
+		server->sendContent(buffer, length);
+	}
+	server->sendContent("");
+}
+
+/**
+ * Send the effective configuration (GET) or change some of its values (PATCH). A PATCH request
+ * contains a json document with the same structure as config.json but only the values to change,
+ * e.g. {"inverter": {"pv": {"voltage": {"min": 215}}}}. All values are validated and applied
+ * at once, the response contains the new configuration.
+ */
+void WebServer::handleConfig(HTTPMethod method) {
+	if (method == HTTP_PATCH) {
+		JsonDocument doc;
+		DeserializationError error = deserializeJson(doc, server->arg(F("plain")));
+		if (error) {
+			server->send(400, F("text/plain"), error.f_str());
+			return;
+		}
+		if (!config.update(doc.as<JsonVariantConst>())) {
+			server->send(400, F("text/plain"), config.getError());
+			return;
+		}
+	}
+	server->send(200, F("application/json"), config.toJSON());
 }
 
 void WebServer::replyServerError(String msg) {
-	logger.error(msg);
+	LOG_ERROR("%s", msg.c_str());
 	server->send(500, F("text/plain"), msg + F("\r\n"));
 }
 
+/**
+ * Answer a request which was rejected by the admission control with 429 (client too fast)
+ * or 503 (budget used up) and the time after which the client should try again.
+ */
+void WebServer::replyRejected() {
+	char retryAfter[12];
+	bool rateLimited = (admissionResult == Admission::RATE_LIMITED);
+
+	snprintf_P(retryAfter, sizeof(retryAfter), PSTR("%lu"), admission.getRetryAfter(admissionResult, server->client().remoteIP()));
+	server->sendHeader(F("Retry-After"), retryAfter);
+	server->send(rateLimited ? 429 : 503, F("text/plain"), rateLimited ? F("Too many requests\r\n") : F("Busy\r\n"));
+}
+
 WebServer webServer;
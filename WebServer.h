@@ -14,6 +14,15 @@
 #include "Logger.h"
 #include "Inverter.h"
 #include "Config.h"
+#include "StringView.h"
+#include "BufferPool.h"
+#include "ChunkedWriter.h"
+#include "UploadFile.h"
+#include "Admission.h"
+
+#define FILE_LIST_DEFAULT_LIMIT 50 // number of files per page of /list
+#define FILE_LIST_MAX_LIMIT 200
+#define DATA_ETAG_SIZE 24 // size of the ETag of /data incl. quotes + 1
 
 class WebServer : public RequestHandler {
 public:
@@ -21,17 +30,56 @@ public:
 	virtual ~WebServer();
 	void init();
 	void loop();
+	uint32_t getLastRequestTime();
+    StringView getData(char *etag);
     bool canHandle(HTTPMethod method, const String& uri) override;
     bool canUpload(const String& uri) override;
     bool handle(ESP8266WebServer& server, HTTPMethod requestMethod, const String& requestUri) override;
     void upload(ESP8266WebServer& server, const String& requestUri, HTTPUpload& upload) override;
 
 private:
+    enum Route
+    {
+        ROUTE_NONE,
+        ROUTE_DATA,
+        ROUTE_MAX_CURRENT,
+        ROUTE_CONFIG,
+        ROUTE_LIST,
+        ROUTE_LOG,
+        ROUTE_UPLOAD,
+        ROUTE_GRID,
+        ROUTE_DEBUG_LATENCY,
+        ROUTE_DEBUG_WIFI,
+        ROUTE_DEBUG_TASKS,
+        ROUTE_DEBUG_PERF,
+        ROUTE_DEBUG_PERF_RESET,
+        ROUTE_DEBUG_HEAP,
+        ROUTE_DEBUG_BENCH,
+        ROUTE_DEBUG_HTTP
+    };
+
+    Route getRoute(HTTPMethod method, StringView uri);
+    void handleData();
+    void handleMaxCurrent();
+    void finishUpload();
     void replyServerError(String msg);
+    void replyRejected();
     void handleFileList();
+    void printPageLink(ChunkedWriter &writer, const String &path, uint32_t offset, uint32_t limit, const char *text);
+    void handleLog();
+    void handleConfig(HTTPMethod method);
 	ESP8266WebServer *server;
-	File fsUploadFile;
+	UploadFile uploadFile;
+    const __FlashStringHelper *uploadError; // why the last upload failed, NULL = success
     String uploadPath;
+    uint32_t lastRequestTime; // in ms
+    bool admissionChecked; // true if the admission of the current request was checked
+    Admission::Request admissionRequest; // type of the current request
+    Admission::Result admissionResult; // of the current request
+    char dataCache[TEXT_BUFFER_SIZE]; // the last response of /data
+    size_t dataLength; // length of the cached response, 0 = none
+    uint32_t dataSequence; // inverter sequence of the cached response
+    uint32_t bootId; // random number to make the ETag of /data unique across reboots
 };
 
 extern WebServer webServer;
@@ -0,0 +1,192 @@
+// Shared feed of the inverter data for freeboard.
+//
+// All datasources of the type "solar_feed" with the same URL share one request timer, so
+// the number of requests doesn't grow with the number of datasources or panes. Open tabs
+// exchange the received data via a BroadcastChannel: as long as one tab polls, the others
+// only listen. Tabs in the background (document.hidden) don't poll at all and update
+// immediately when they become visible again.
+//
+// The server caches the JSON per inverter response and answers with 304 (not modified) if
+// the data didn't change since the last request (see ETag of /data).
+
+(function () {
+	var feeds = {};
+	var channel = (typeof BroadcastChannel !== "undefined") ? new BroadcastChannel("solar_feed") : null;
+
+	var Feed = function (url) {
+		var self = this;
+		var subscribers = [];
+		var updateTimer = null;
+		var pending = false;
+		var etag = null;
+		var lastData = null;
+
+		// the shortest refresh time of all subscribers (in ms)
+		function getInterval() {
+			return _.min(_.map(subscribers, function (subscriber) {
+				return subscriber.refresh;
+			}));
+		}
+
+		function schedule(delay) {
+			clearTimeout(updateTimer);
+			updateTimer = null;
+			if (subscribers.length > 0 && !document.hidden) {
+				updateTimer = setTimeout(self.updateNow, delay);
+			}
+		}
+
+		function deliver(data) {
+			lastData = data;
+			_.each(subscribers, function (subscriber) {
+				subscriber.callback(data);
+			});
+		}
+
+		this.subscribe = function (subscriber) {
+			subscribers.push(subscriber);
+			if (lastData) {
+				subscriber.callback(lastData);
+			}
+			if (subscribers.length == 1) {
+				self.updateNow();
+			} else {
+				schedule(getInterval());
+			}
+		}
+
+		this.unsubscribe = function (subscriber) {
+			subscribers = _.without(subscribers, subscriber);
+			if (subscribers.length == 0) {
+				schedule(0); // stops the timer
+				delete feeds[url];
+			}
+		}
+
+		this.updateNow = function () {
+			if (pending || subscribers.length == 0) {
+				return;
+			}
+			pending = true;
+
+			$.ajax({
+				url: url,
+				dataType: "JSON",
+				type: "GET",
+				beforeSend: function (xhr) {
+					if (etag) {
+						xhr.setRequestHeader("If-None-Match", etag);
+					}
+				},
+				success: function (data, status, xhr) {
+					if (xhr.status == 200 && data) {
+						etag = xhr.getResponseHeader("ETag");
+						deliver(data);
+						if (channel) {
+							channel.postMessage({url: url, etag: etag, data: data});
+						}
+					}
+				},
+				complete: function () {
+					pending = false;
+					schedule(getInterval());
+				}
+			});
+		}
+
+		// another tab received the data, use it and postpone our own request, so only one tab polls
+		this.receive = function (message) {
+			if (message.etag != etag) {
+				etag = message.etag;
+				deliver(message.data);
+			}
+			schedule(getInterval() * 1.5);
+		}
+
+		this.visibilityChanged = function () {
+			if (document.hidden) {
+				schedule(0);
+			} else {
+				self.updateNow();
+			}
+		}
+	};
+
+	function getFeed(url) {
+		if (!feeds[url]) {
+			feeds[url] = new Feed(url);
+		}
+		return feeds[url];
+	}
+
+	if (channel) {
+		channel.onmessage = function (event) {
+			if (feeds[event.data.url]) {
+				feeds[event.data.url].receive(event.data);
+			}
+		};
+	}
+
+	document.addEventListener("visibilitychange", function () {
+		_.each(feeds, function (feed) {
+			feed.visibilityChanged();
+		});
+	});
+
+	var solarFeedDatasource = function (settings, updateCallback) {
+		var currentSettings = settings;
+		var subscriber = null;
+
+		function subscribe() {
+			subscriber = {
+				refresh: Math.max(currentSettings.refresh, 0.5) * 1000,
+				callback: updateCallback
+			};
+			getFeed(currentSettings.url).subscribe(subscriber);
+		}
+
+		function unsubscribe() {
+			getFeed(currentSettings.url).unsubscribe(subscriber);
+		}
+
+		subscribe();
+
+		this.updateNow = function () {
+			getFeed(currentSettings.url).updateNow();
+		}
+
+		this.onDispose = function () {
+			unsubscribe();
+		}
+
+		this.onSettingsChanged = function (newSettings) {
+			unsubscribe();
+			currentSettings = newSettings;
+			subscribe();
+		}
+	};
+
+	freeboard.loadDatasourcePlugin({
+		type_name: "solar_feed",
+		display_name: "Solar Inverter Feed",
+		description: "The data of the inverter, shared by all datasources with the same URL and all open tabs.",
+		settings: [
+			{
+				name: "url",
+				display_name: "URL",
+				type: "text",
+				default_value: "/data"
+			},
+			{
+				name: "refresh",
+				display_name: "Refresh Every",
+				type: "number",
+				suffix: "seconds",
+				default_value: 2
+			}
+		],
+		newInstance: function (settings, newInstanceCallback, updateCallback) {
+			newInstanceCallback(new solarFeedDatasource(settings, updateCallback));
+		}
+	});
+}());
@@ -0,0 +1,85 @@
+/*
+ * Arduino.h
+ *
+ * Host replacement of the Arduino core, only what Logger.h, Config.h and ArenaAllocator.h
+ * need. Flash strings are ordinary strings. Nothing here allocates heap memory, so it
+ * doesn't distort the allocation count.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef const char *PGM_P;
+
+class __FlashStringHelper;
+#define F(text) (reinterpret_cast<const __FlashStringHelper *>(text))
+#define PSTR(text) (text)
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strncpy_P strncpy
+
+/**
+ * The Arduino printf functions accept %S for flash strings, which is %s on the host.
+ */
+inline int vsnprintf_P(char *buffer, size_t size, const char *format, va_list args) {
+	char hostFormat[256];
+	size_t i = 0;
+	for (; format[i] != 0 && i < sizeof(hostFormat) - 1; i++) {
+		hostFormat[i] = (format[i] == 'S' && i > 0 && format[i - 1] == '%' ? 's' : format[i]);
+	}
+	hostFormat[i] = 0;
+	return vsnprintf(buffer, size, hostFormat, args);
+}
+
+inline int snprintf_P(char *buffer, size_t size, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf_P(buffer, size, format, args);
+	va_end(args);
+	return length;
+}
+
+unsigned long millis();
+
+class String
+{
+};
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long) {
+    }
+
+    size_t availableForWrite() {
+        return 128;
+    }
+
+    size_t write(const uint8_t *, size_t size) {
+        written += size;
+        return size;
+    }
+
+    size_t written = 0;
+};
+
+extern HardwareSerial Serial1;
+
+#endif /* ARDUINO_H_ */
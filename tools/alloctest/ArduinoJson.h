@@ -0,0 +1,41 @@
+/*
+ * ArduinoJson.h
+ *
+ * Host replacement of ArduinoJson, only the allocator interface implemented by
+ * ArenaAllocator and the types named in Config.h.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef ARDUINOJSON_H_
+#define ARDUINOJSON_H_
+
+#include <stddef.h>
+
+namespace ArduinoJson {
+class Allocator
+{
+public:
+    virtual void *allocate(size_t size) = 0;
+    virtual void deallocate(void *pointer) = 0;
+    virtual void *reallocate(void *pointer, size_t size) = 0;
+
+protected:
+    ~Allocator() = default;
+};
+}
+
+class JsonVariantConst
+{
+};
+
+class JsonObject
+{
+};
+
+class JsonObjectConst
+{
+};
+
+#endif /* ARDUINOJSON_H_ */
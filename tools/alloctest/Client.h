@@ -0,0 +1,40 @@
+/*
+ * Client.h
+ *
+ * Host replacement of the Arduino Client interface, only the methods used by MqttClient,
+ * implemented with in-memory buffers instead of a socket.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef CLIENT_H_
+#define CLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CLIENT_BUFFER_SIZE 512
+
+class Client
+{
+public:
+    Client();
+    virtual ~Client();
+    int connect(const char *host, uint16_t port);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available();
+    int read(uint8_t *buffer, size_t size);
+    uint8_t connected();
+    void stop();
+    void receive(const uint8_t *data, size_t size);
+    size_t getSent();
+
+private:
+    uint8_t input[CLIENT_BUFFER_SIZE]; // data to be read by MqttClient
+    size_t inputLength;
+    size_t inputPosition;
+    size_t sent; // number of bytes written by MqttClient
+};
+
+#endif /* CLIENT_H_ */
@@ -0,0 +1,94 @@
+/*
+ * DataDocument.h
+ *
+ * Builds a JSON document with the structure and the value types of Inverter::toJSON() (the
+ * /data response) on the host, so the arena and the allocation pattern of a real JsonDocument
+ * can be checked without the Arduino core. Keep it in sync with Inverter::toJSON().
+ *
+ * Only available if the real ArduinoJson (v7) is on the include path, see alloctest.cpp.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef DATADOCUMENT_H_
+#define DATADOCUMENT_H_
+
+#include <stdio.h>
+#include <ArduinoJson.h>
+
+// keys and texts are passed as const char * so ArduinoJson copies them like the F() strings on the device
+#define TEXT(text) ((const char *) (text))
+
+static const char *dataWarnings[] = { "Inverter fault", "Bus over-voltage", "Bus under-voltage", "Grid fail",
+		"Over temperature", "Fan locked", "Battery over-voltage", "Battery under-voltage", "Battery shutdown",
+		"Over load", "Power limit", "PV voltage high", "MPPT overload warning", "Battery too low to charge" };
+
+/**
+ * Fill the document like Inverter::toJSON() does, serialize it to the buffer and clear it.
+ * The variant (e.g. a cycle counter) changes the values and the number of warnings.
+ */
+static size_t writeDataDocument(JsonDocument &doc, char *buffer, size_t size, uint32_t variant) {
+	char time[16];
+	doc.clear();
+
+	JsonObject grid = doc[TEXT("grid")].to<JsonObject>();
+	grid[TEXT("voltage")] = 230.0 + variant % 10 / 10.0;
+	grid[TEXT("frequency")] = 49.9;
+
+	JsonObject out = doc[TEXT("out")].to<JsonObject>();
+	out[TEXT("voltage")] = 229.9;
+	out[TEXT("frequency")] = 50.0;
+	out[TEXT("powerApparent")] = (uint16_t) (1800 + variant % 100);
+	out[TEXT("powerActive")] = (uint16_t) (1750 + variant % 100);
+	out[TEXT("load")] = (uint8_t) 35;
+	out[TEXT("source")] = TEXT("Battery");
+	out[TEXT("mode")] = TEXT("Solar-Battery-Utility");
+
+	JsonObject battery = doc[TEXT("battery")].to<JsonObject>();
+	battery[TEXT("voltage")] = 26.8;
+	battery[TEXT("current")] = (int16_t) -12;
+	battery[TEXT("power")] = (int32_t) -321;
+	battery[TEXT("soc")] = 85.3;
+	battery[TEXT("ampereHours")] = 136.5;
+	battery[TEXT("socUncertainty")] = 2.1;
+	battery[TEXT("resistance")] = (uint16_t) 25;
+	battery[TEXT("source")] = TEXT("Solar and Grid");
+	battery[TEXT("floatCharge")] = TEXT("off");
+	battery[TEXT("floatVoltage")] = 27.0;
+	battery[TEXT("overdischargeProtection")] = false;
+	battery[TEXT("floatOverride")] = (variant & 1) != 0;
+
+	JsonObject pv = doc[TEXT("pv")].to<JsonObject>();
+	pv[TEXT("voltage")] = 226.4;
+	pv[TEXT("current")] = 8.1;
+	pv[TEXT("power")] = (uint16_t) 1834;
+	pv[TEXT("maxPower")] = (uint16_t) 1990;
+	pv[TEXT("maxCurrent")] = (uint16_t) 86;
+	pv[TEXT("controllerError")] = -1.5;
+
+	JsonObject system = doc[TEXT("system")].to<JsonObject>();
+	system[TEXT("version")] = (uint8_t) 0;
+	system[TEXT("mode")] = TEXT("Battery");
+	system[TEXT("switch")] = TEXT("on");
+	system[TEXT("voltage")] = (uint16_t) 380;
+	system[TEXT("temperature")] = 42.0;
+	system[TEXT("fanCurrent")] = (uint16_t) 120;
+	system[TEXT("faultCode")] = (uint8_t) 0;
+	JsonArray warning = system[TEXT("warning")].to<JsonArray>();
+	for (uint32_t i = 0; i < variant % (sizeof(dataWarnings) / sizeof(dataWarnings[0]) + 1); i++) {
+		warning.add(TEXT(dataWarnings[i]));
+	}
+	snprintf(time, sizeof(time), "%.3u:%.2u:%.2u:%.2u", variant / 86400, (variant / 3600) % 24, (variant / 60) % 60, variant % 60);
+	system[TEXT("time")] = TEXT(time);
+	JsonObject memory = system[TEXT("memory")].to<JsonObject>();
+	memory[TEXT("freeHeap")] = (uint32_t) 23456;
+	memory[TEXT("fragmentation")] = (uint8_t) 12;
+	memory[TEXT("freeBlockMax")] = (uint32_t) 18432;
+
+	size_t length = serializeJson(doc, buffer, size);
+	doc.clear(); // releases the arena for the next call
+	return length;
+}
+
+#endif /* DATADOCUMENT_H_ */
@@ -0,0 +1,8 @@
+/*
+ * FS.h
+ *
+ * Host replacement, nothing of the file system is used by the tested code.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
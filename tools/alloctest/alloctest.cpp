@@ -0,0 +1,330 @@
+/*
+ * alloctest.cpp
+ *
+ * Checks that the code on the polling and request hot paths doesn't allocate heap memory once
+ * it's running: CRC check of inverter responses, building commands, the buffer pool, the power
+ * controller, Modbus request processing, publishing via MQTT, logging and the arena of the
+ * JSON documents. All calls to malloc and free are counted (same linker wrapping as the
+ * DEBUG_ALLOC option of HeapMonitor):
+ *
+ *   g++ -O2 -I. -I../.. -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -o alloctest \
+ *       alloctest.cpp ../../CRCUtil.cpp ../../BufferPool.cpp ../../PowerController.cpp \
+ *       ../../ModbusHandler.cpp ../../MqttClient.cpp ../../Logger.cpp
+ *   ./alloctest [cycles]
+ *
+ * Every section runs one warm-up cycle (which may allocate), then the given number of cycles
+ * (default 10000) which must not allocate at all. The exit code is 1 if any section allocates
+ * or the arena falls back to the heap.
+ *
+ * ArduinoJson.h in this directory only declares the types the headers need. With the real
+ * ArduinoJson (v7, header-only, e.g. a clone of github.com/bblanchon/ArduinoJson) in front of it
+ * on the include path, the "JSON document" section builds the /data document (see
+ * DataDocument.h) with a real JsonDocument in an ArenaAllocator<ARENA_SIZE>:
+ *
+ *   g++ -O2 -I<ArduinoJson>/src -I. -I../.. ...
+ *
+ * The code which needs the Arduino core (parsing the inverter responses, Inverter::toJSON()
+ * itself, the /data handler) is checked on the device: with DEBUG_BENCH and DEBUG_ALLOC,
+ * /debug/bench reports the allocations and arena fallbacks per benchmark and
+ * tools/bench/benchcompare.py fails if there are any.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CRCUtil.h"
+#include "BufferPool.h"
+#include "PowerController.h"
+#include "ModbusHandler.h"
+#include "MqttClient.h"
+#include "Logger.h"
+#include "ArenaAllocator.h"
+#ifdef ARDUINOJSON_VERSION
+#include "DataDocument.h"
+#endif
+
+#define ARENA_SIZE 3072 // same as JSON_ARENA_SIZE in Inverter.h
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static volatile uint32_t allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+	allocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+	allocations++;
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	allocations++;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr != NULL) {
+		allocations++;
+	}
+	__real_free(ptr);
+}
+}
+
+HardwareSerial Serial1;
+
+unsigned long millis() {
+	static unsigned long time = 0;
+	return time++;
+}
+
+Client::Client() {
+	stop();
+}
+
+Client::~Client() {
+}
+
+int Client::connect(const char *, uint16_t) {
+	return 1;
+}
+
+size_t Client::write(const uint8_t *, size_t size) {
+	sent += size;
+	return size;
+}
+
+int Client::available() {
+	return inputLength - inputPosition;
+}
+
+int Client::read(uint8_t *buffer, size_t size) {
+	size_t length = inputLength - inputPosition;
+	length = (size < length ? size : length);
+	memcpy(buffer, input + inputPosition, length);
+	inputPosition += length;
+	return length;
+}
+
+uint8_t Client::connected() {
+	return 1;
+}
+
+void Client::stop() {
+	inputLength = 0;
+	inputPosition = 0;
+	sent = 0;
+}
+
+/**
+ * Make data available to be read (as if received from the broker).
+ */
+void Client::receive(const uint8_t *data, size_t size) {
+	memcpy(input, data, size);
+	inputLength = size;
+	inputPosition = 0;
+}
+
+size_t Client::getSent() {
+	return sent;
+}
+
+typedef void (*Section)(uint32_t cycle);
+
+// captured QPIGS response (without CRC and CR)
+static const char *STATUS_RESPONSE = "(228.5 50.0 229.9 50.0 1760 1720 035 380 26.80 003 085 0039 07.8 228.5 00.00 00000 "
+		"00010110 00 00 02050 010";
+
+static void testCRC(uint32_t cycle) {
+	char frame[128];
+	size_t length = strlen(STATUS_RESPONSE);
+	memcpy(frame, STATUS_RESPONSE, length);
+	frame[0] = (char) ('(' + (cycle & 1)); // vary the input a bit
+	length = CRCUtil::appendCRC(frame, length);
+	if (!CRCUtil::checkCRC(frame, length)) {
+		printf("CRC check failed\n");
+		exit(1);
+	}
+}
+
+static void testBufferPool(uint32_t cycle) {
+	PooledBuffer first;
+	PooledBuffer second;
+	PooledBuffer third; // the pool is exhausted, must not fall back to the heap
+	if (!first || !second || third) {
+		printf("unexpected buffer pool state\n");
+		exit(1);
+	}
+	snprintf(first.data(), first.size(), "{\"sequence\":%u}", cycle);
+}
+
+static void testPowerController(uint32_t cycle) {
+	static PowerController controller;
+	PowerController::Settings settings = { PowerController::PI, 300, 100, 2000, 50, 25, -5, 350, 200.0f, 240.0f, 300,
+			50, 40.0f, 20.0f, 0.5f, 200 };
+	PowerController::Sample sample = { 228.5f + (cycle % 20), 2050, 1760, 3, 380, 853 };
+
+	if (cycle == 0) {
+		controller.init(settings, 0);
+	}
+	controller.update(settings, sample, cycle * 1000);
+}
+
+static uint16_t inputRegisters[16] = { 78, 1800, 0, 3, 0x0001, 0x0400, 2285, 2050, 1760, 380, 2680, 3, 853,
+		(uint16_t) -125, 1, 4464 };
+static uint16_t holdingRegisters[1];
+
+static bool writeRegister(uint16_t address, uint16_t value) {
+	return address == 0 && value <= 1;
+}
+
+static void testModbus(uint32_t cycle) {
+	static ModbusHandler handler(inputRegisters, 16, holdingRegisters, 1, writeRegister);
+	const uint8_t read[] = { 0, (uint8_t) cycle, 0, 0, 0, 6, 1, 4, 0, 0, 0, 16 };
+	const uint8_t write[] = { 0, (uint8_t) cycle, 0, 0, 0, 6, 1, 6, 0, 0, 0, (uint8_t) (cycle & 1) };
+	uint8_t response[MODBUS_FRAME_SIZE];
+
+	if (handler.process(read, sizeof(read), response) != 9 + 32 || handler.process(write, sizeof(write), response) != 12) {
+		printf("unexpected Modbus response\n");
+		exit(1);
+	}
+}
+
+static uint32_t commands = 0;
+
+static void processMessage(const char *, const uint8_t *payload, size_t length) {
+	if (length == 12 && memcmp(payload, "switchToGrid", length) == 0) {
+		commands++;
+	}
+}
+
+static void testMqtt(uint32_t cycle) {
+	static Client client;
+	static MqttClient mqttClient(client);
+	const uint8_t connack[] = { 0x20, 2, 0, 0 };
+	const uint8_t command[] = { 0x30, 19, 0, 5, 's', 'o', 'l', 'a', 'r', 's', 'w', 'i', 't', 'c', 'h', 'T', 'o', 'G', 'r', 'i',
+			'd' };
+	char value[12];
+
+	if (cycle == 0) {
+		mqttClient.setCallback(processMessage);
+		mqttClient.connect("solar-test", "", "", "solar/online", "false", 30, 0);
+		client.receive(connack, sizeof(connack));
+		mqttClient.loop(0);
+	}
+	snprintf(value, sizeof(value), "%u", cycle);
+	mqttClient.publish("solar/pvPower", value, false);
+	client.receive(command, sizeof(command));
+	if (!mqttClient.loop(cycle) || !mqttClient.isConnected() || commands != cycle + 1) {
+		printf("MQTT connection lost\n");
+		exit(1);
+	}
+}
+
+static void testLogger(uint32_t cycle) {
+	if (cycle == 0) {
+		logger.init(); // allocates the buffers
+	}
+	LOG_INFO("battery: %.2fV, %dA, soc %d%% (%S)", 26.8f, 3, cycle % 1000, F("bulk"));
+	LOG_DEBUG("sending command: %s", "QPIGS");
+	logger.loop();
+	if (Serial1.written == 0) {
+		printf("no log output\n");
+		exit(1);
+	}
+}
+
+/**
+ * Use the arena like a JsonDocument does: a pool of slots, strings which grow while they're
+ * built and are shrunk afterwards, everything is released when the document is cleared.
+ */
+static void testArena(uint32_t cycle) {
+	static ArenaAllocator<ARENA_SIZE> arena;
+
+	if (cycle == 0) { // make sure a fallback is detected at all
+		ArenaAllocator<64> small;
+		void *block = small.allocate(128);
+		small.deallocate(block);
+		if (small.getFallbacks() != 1) {
+			printf("arena fallback not detected\n");
+			exit(1);
+		}
+	}
+
+	void *pool = arena.allocate(1024);
+	void *text = arena.allocate(32);
+	text = arena.reallocate(text, 64 + cycle % 64); // the last block grows in place
+	void *other = arena.allocate(256);
+	other = arena.reallocate(other, 512);
+	pool = arena.reallocate(pool, 768);
+	arena.deallocate(text);
+	arena.deallocate(other);
+	arena.deallocate(pool);
+	if (arena.getFallbacks() != 0) {
+		printf("arena fell back to the heap\n");
+		exit(1);
+	}
+}
+
+#ifdef ARDUINOJSON_VERSION
+/**
+ * Build the /data document with a real JsonDocument in the arena, the arena must be large
+ * enough for it (no fallback) and the output must fit into the response buffer.
+ */
+static void testJsonDocument(uint32_t cycle) {
+	static ArenaAllocator<ARENA_SIZE> arena;
+	static JsonDocument doc(&arena);
+	static char buffer[TEXT_BUFFER_SIZE];
+
+	size_t length = writeDataDocument(doc, buffer, sizeof(buffer), cycle);
+	if (length == 0 || length >= sizeof(buffer) || doc.overflowed()) {
+		printf("JSON document doesn't fit (%u bytes)\n", (unsigned) length);
+		exit(1);
+	}
+	if (arena.getFallbacks() != 0) {
+		printf("JSON document doesn't fit into the arena of %u bytes\n", ARENA_SIZE);
+		exit(1);
+	}
+}
+#endif
+
+/**
+ * Run a section and report the allocations after the warm-up cycle.
+ */
+static bool run(const char *name, Section section, uint32_t cycles) {
+	section(0);
+	uint32_t start = allocations;
+	for (uint32_t cycle = 1; cycle <= cycles; cycle++) {
+		section(cycle);
+	}
+	uint32_t count = allocations - start;
+	printf("%-18s %8u allocations in %u cycles%s\n", name, count, cycles, count > 0 ? "  FAILED" : "");
+	return count == 0;
+}
+
+int main(int argc, char **argv) {
+	uint32_t cycles = (argc > 1 ? strtoul(argv[1], NULL, 10) : 10000);
+	bool success = true;
+
+	success &= run("CRC", testCRC, cycles);
+	success &= run("buffer pool", testBufferPool, cycles);
+	success &= run("power controller", testPowerController, cycles);
+	success &= run("Modbus", testModbus, cycles);
+	success &= run("MQTT", testMqtt, cycles);
+	success &= run("logger", testLogger, cycles);
+	success &= run("JSON arena", testArena, cycles);
+#ifdef ARDUINOJSON_VERSION
+	success &= run("JSON document", testJsonDocument, cycles);
+#else
+	printf("%-18s skipped, ArduinoJson is not on the include path\n", "JSON document");
+#endif
+	return success ? 0 : 1;
+}
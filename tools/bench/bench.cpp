@@ -0,0 +1,223 @@
+/*
+ * bench.cpp
+ *
+ * Host build of the micro-benchmarks of the sample processing, with the same captured
+ * frames (see CapturedFrames.h) and output format as /debug/bench on the device (see
+ * Benchmark.cpp). Only the Arduino independent parts are covered: the CRC and the power
+ * controller which does the work of Inverter::calculateMaximumSolarPower.
+ *
+ *   g++ -O2 -I../.. -o bench bench.cpp ../../CRCUtil.cpp ../../PowerController.cpp
+ *
+ * With the header-only ArduinoJson (v7) and the Arduino stubs of tools/alloctest on the include
+ * path, building the /data document in the JSON arena (see DataDocument.h) is measured as well:
+ *
+ *   g++ -O2 -I<ArduinoJson>/src -I../alloctest -I../.. -o bench bench.cpp ../../CRCUtil.cpp \
+ *       ../../PowerController.cpp
+ *
+ *   ./bench --out baseline.json
+ *   ... change the code, build again ...
+ *   ./bench --out current.json
+ *   ./benchcompare.py baseline.json current.json --threshold 30
+ *
+ * Each benchmark is repeated with doubling iterations until it runs for at least the
+ * minimum time (--min-time, default 200ms). Then the measurement is repeated (--repetitions,
+ * default 5) and the fastest average time per iteration is taken, as it's the least
+ * disturbed by other processes. On a desktop the results still vary by 10-30% from run to run
+ * (cpu frequency, scheduling), so the whole set of benchmarks is run several times (--runs,
+ * default 5) and the median of the runs is reported. Even then the benchmarks of a few ns vary
+ * by up to 30%, compare host results with a threshold above that.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "CRCUtil.h"
+#include "PowerController.h"
+#include "CapturedFrames.h"
+#if __has_include(<ArduinoJson.h>) && __has_include(<Arduino.h>)
+#include <ArduinoJson.h>
+#endif
+#ifdef ARDUINOJSON_VERSION
+#include "ArenaAllocator.h"
+#include "BufferPool.h"
+#include "DataDocument.h"
+
+#define ARENA_SIZE 3072 // same as JSON_ARENA_SIZE in Inverter.h
+#endif
+
+#define MAX_ITERATIONS (1UL << 30)
+#define MAX_RUNS 31
+
+typedef void (*Function)();
+
+struct Benchmark
+{
+	const char *name;
+	Function setup; // called before every measurement, may be NULL
+	Function function;
+	uint64_t iterations; // determined in the first run
+	double times[MAX_RUNS]; // average time per iteration of each run (in ns)
+};
+
+static volatile uint32_t sink; // keeps the compiler from removing the calls
+static uint32_t now; // simulated time of the power controller (in ms)
+static PowerController controller;
+static PowerController::Settings settings = { PowerController::PI, 300, 100, 2000, 50, 25, -5, 350, 200.0f, 240.0f,
+		300, 50, 40.0f, 20.0f, 0.5f, 200 };
+// the values of FRAME_STATUS
+static const PowerController::Sample sample = { 228.5f, 2050, 1720, 3, 380, 850 };
+
+static uint64_t getTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static void calcCRC() {
+	sink += CRCUtil::calcCRC(FRAME_STATUS, sizeof(FRAME_STATUS) - 3);
+}
+
+static void checkCRC() {
+	sink += CRCUtil::checkCRC(FRAME_STATUS, sizeof(FRAME_STATUS) - 1);
+}
+
+static void updateController() {
+	now += 300; // the polling interval of the status
+	sink += controller.update(settings, sample, now);
+}
+
+static void initStep() {
+	settings.mode = PowerController::Step;
+	controller.init(settings, now);
+}
+
+static void initPI() {
+	settings.mode = PowerController::PI;
+	controller.init(settings, now);
+}
+
+#ifdef ARDUINOJSON_VERSION
+static ArenaAllocator<ARENA_SIZE> arena;
+static JsonDocument doc(&arena);
+static char output[TEXT_BUFFER_SIZE];
+
+static void writeData() {
+	sink += writeDataDocument(doc, output, sizeof(output), 5); // 5 warnings
+}
+#endif
+
+static Benchmark benchmarks[] = {
+	{ "CRCUtil::calcCRC", NULL, calcCRC, 0, { } },
+	{ "CRCUtil::checkCRC", NULL, checkCRC, 0, { } },
+	{ "PowerController::update/Step", initStep, updateController, 0, { } },
+	{ "PowerController::update/PI", initPI, updateController, 0, { } },
+#ifdef ARDUINOJSON_VERSION
+	{ "DataDocument/toJSON", NULL, writeData, 0, { } },
+#endif
+};
+
+static uint64_t run(Function function, uint64_t iterations) {
+	uint64_t start = getTime();
+	for (uint64_t i = 0; i < iterations; i++) {
+		function();
+	}
+	return getTime() - start;
+}
+
+/**
+ * In the first run, call the function with doubling iterations until it takes at least minTime
+ * (in ms). Repeat it with these iterations and store the fastest average time per iteration.
+ */
+static void measure(Benchmark &benchmark, uint32_t run, uint32_t minTime, uint32_t repetitions) {
+	uint64_t duration = UINT64_MAX;
+
+	if (benchmark.setup != NULL) {
+		benchmark.setup();
+	}
+	if (benchmark.iterations == 0) {
+		benchmark.iterations = 1;
+		while ((duration = ::run(benchmark.function, benchmark.iterations)) < minTime * 1000000ULL
+				&& benchmark.iterations < MAX_ITERATIONS) {
+			benchmark.iterations *= 2;
+		}
+	}
+	for (uint32_t i = 0; i < repetitions; i++) {
+		uint64_t repeated = ::run(benchmark.function, benchmark.iterations);
+		duration = (repeated < duration ? repeated : duration);
+	}
+	benchmark.times[run] = (double) duration / benchmark.iterations;
+}
+
+/**
+ * Print the median of the runs as JSON.
+ */
+static void report(FILE *file, bool first, Benchmark &benchmark, uint32_t runs) {
+	std::sort(benchmark.times, benchmark.times + runs);
+	double time = (runs % 2 ? benchmark.times[runs / 2] : (benchmark.times[runs / 2 - 1] + benchmark.times[runs / 2]) / 2);
+
+	fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"real_time\": %.1f, \"time_unit\": \"ns\"}",
+			first ? "" : ",", benchmark.name, (unsigned long long) benchmark.iterations, time);
+	fprintf(stderr, "%-40s %12llu %12.1f ns (%.1f - %.1f)\n", benchmark.name, (unsigned long long) benchmark.iterations,
+			time, benchmark.times[0], benchmark.times[runs - 1]);
+}
+
+int main(int argc, char **argv) {
+	uint32_t minTime = 200;
+	uint32_t repetitions = 5;
+	uint32_t runs = 5;
+	const char *fileName = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+			minTime = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+			repetitions = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			fileName = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [--min-time <ms>] [--repetitions <n>] [--runs <n>] [--out <file>]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (runs < 1 || runs > MAX_RUNS || repetitions < 1) {
+		fprintf(stderr, "--runs must be 1 to %d, --repetitions at least 1\n", MAX_RUNS);
+		return 1;
+	}
+	FILE *file = (fileName != NULL ? fopen(fileName, "w") : stdout);
+	if (file == NULL) {
+		perror(fileName);
+		return 1;
+	}
+
+	char host[64] = "";
+	gethostname(host, sizeof(host) - 1);
+	time_t date = time(NULL);
+	char dateText[32];
+	strftime(dateText, sizeof(dateText), "%Y-%m-%dT%H:%M:%S", localtime(&date));
+
+	fprintf(file, "{\n  \"context\": {\"target\": \"host\", \"host_name\": \"%s\", \"date\": \"%s\"},\n  \"benchmarks\": [",
+			host, dateText);
+	size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	for (uint32_t run = 0; run < runs; run++) { // interleaved, so a slow phase of the host affects all benchmarks alike
+		for (size_t i = 0; i < count; i++) {
+			measure(benchmarks[i], run, minTime, repetitions);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		report(file, i == 0, benchmarks[i], runs);
+	}
+	fprintf(file, "\n  ]\n}\n");
+
+	if (file != stdout) {
+		fclose(file);
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Compare two results of the micro-benchmarks, either of the host build (see bench.cpp) or
+of a device (curl http://192.168.4.1/debug/bench > result.json):
+
+    ./benchcompare.py baseline.json current.json [--threshold 10]
+
+Benchmarks are matched by name. The exit code is 1 if any benchmark got slower by more
+than the threshold (in percent), so it can be used in scripts. If the current result contains
+allocation counts (device built with DEBUG_ALLOC), it also fails if a benchmark allocated
+heap memory or the JSON arena fell back to the heap.
+"""
+
+import argparse
+import json
+import sys
+
+UNITS = {'ns': 1, 'us': 1000, 'ms': 1000000, 's': 1000000000}
+
+
+def load(file_name):
+    with open(file_name) as file:
+        result = json.load(file)
+    if not result.get('enabled', True):
+        sys.exit('%s: benchmarks not enabled (define DEBUG_BENCH in Config.h)' % file_name)
+    return {benchmark['name']: benchmark['real_time'] * UNITS[benchmark.get('time_unit', 'ns')]
+            for benchmark in result['benchmarks']}, result.get('context', {})
+
+
+def check_allocations(file_name):
+    with open(file_name) as file:
+        result = json.load(file)
+    failures = 0
+    for benchmark in result['benchmarks']:
+        if benchmark.get('allocations', 0) > 0:
+            print('%s: %d heap allocation(s) per call' % (benchmark['name'], benchmark['allocations']))
+            failures += 1
+    if result.get('context', {}).get('jsonFallbacks', 0) > 0:
+        print('JSON arena fell back to the heap %d time(s), increase JSON_ARENA_SIZE'
+              % result['context']['jsonFallbacks'])
+        failures += 1
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two benchmark results')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--threshold', type=float, default=10, help='allowed slowdown in percent (default 10)')
+    arguments = parser.parse_args()
+
+    baseline, baseline_context = load(arguments.baseline)
+    current, current_context = load(arguments.current)
+    if baseline_context.get('target') != current_context.get('target'):
+        print('warning: comparing results of different targets (%s, %s)'
+              % (baseline_context.get('target'), current_context.get('target')))
+
+    regressions = 0
+    print('%-40s %12s %12s %8s' % ('benchmark', 'baseline ns', 'current ns', 'change'))
+    for name in list(baseline) + [name for name in current if name not in baseline]:
+        if name not in baseline or name not in current:
+            print('%-40s %12s %12s' % (name, '%.1f' % baseline[name] if name in baseline else '-',
+                                       '%.1f' % current[name] if name in current else '-'))
+            continue
+        change = (current[name] - baseline[name]) / baseline[name] * 100 if baseline[name] > 0 else 0
+        regression = change > arguments.threshold
+        regressions += regression
+        print('%-40s %12.1f %12.1f %+7.1f%%%s' % (name, baseline[name], current[name], change,
+                                                 '  REGRESSION' if regression else ''))
+
+    print('%d regression(s)' % regressions)
+    failures = check_allocations(arguments.current)
+    sys.exit(1 if regressions or failures else 0)
+
+
+if __name__ == '__main__':
+    main()
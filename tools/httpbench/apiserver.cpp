@@ -0,0 +1,237 @@
+/*
+ * apiserver.cpp
+ *
+ * Serves /data and /maxCurrent with the request handling of the API server (HttpParser,
+ * persistent and pipelined connections) on the host, so it can be tested and measured with
+ * httpbench.py without a device:
+ *
+ *   g++ -O2 -I../.. -o apiserver apiserver.cpp ../../HttpParser.cpp
+ *   ./apiserver [port] [maxConnections] [idleTimeout] &
+ *   ./httpbench.py localhost 8080
+ *
+ * The defaults match the ones of config.json (8080, 3 connections, 10 seconds). Like on the
+ * device, a new connection replaces the one which is idle the longest if all are in use.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "HttpParser.h"
+
+#define MAX_CONNECTIONS 4
+#define REQUEST_SIZE 512
+
+static const char DATA[] = "{\"maxCurrent\":78,\"maxPower\":1800,\"override\":false,\"mode\":3,\"pv\":{\"voltage\":228.5,"
+		"\"power\":2050},\"out\":{\"power\":1760},\"battery\":{\"voltage\":26.8,\"current\":3,\"soc\":85.3}}";
+static const char ETAG[] = "\"1a2b3c4d-70000\"";
+
+struct Connection
+{
+	int socket;
+	char buffer[REQUEST_SIZE];
+	size_t length;
+	time_t lastActivity;
+};
+
+static Connection connections[MAX_CONNECTIONS];
+static int maxConnections = 3;
+static int idleTimeout = 10;
+
+static const char *getStatusText(int code) {
+	switch (code) {
+	case 200:
+		return "OK";
+	case 304:
+		return "Not Modified";
+	case 400:
+		return "Bad Request";
+	case 404:
+		return "Not Found";
+	case 405:
+		return "Method Not Allowed";
+	case 431:
+		return "Request Header Fields Too Large";
+	}
+	return "Error";
+}
+
+static void closeConnection(Connection &connection) {
+	close(connection.socket);
+	connection.socket = -1;
+	connection.length = 0;
+}
+
+static void sendResponse(Connection &connection, int code, bool keepAlive, const char *etag, const char *body, size_t length) {
+	char response[REQUEST_SIZE + sizeof(DATA)];
+	size_t headerLength = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+			"Content-Length: %zu\r\nCache-Control: no-cache\r\n", code, getStatusText(code), length);
+	if (etag != NULL) {
+		headerLength += snprintf(response + headerLength, sizeof(response) - headerLength, "ETag: %s\r\n", etag);
+	}
+	if (keepAlive) {
+		headerLength += snprintf(response + headerLength, sizeof(response) - headerLength,
+				"Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n\r\n", idleTimeout);
+	} else {
+		headerLength += snprintf(response + headerLength, sizeof(response) - headerLength, "Connection: close\r\n\r\n");
+	}
+	if (length > 0) {
+		memcpy(response + headerLength, body, length);
+	}
+	send(connection.socket, response, headerLength + length, MSG_NOSIGNAL);
+}
+
+/**
+ * Answer a request, returns false if the connection should be closed afterwards.
+ */
+static bool process(Connection &connection, const HttpParser::Request &request) {
+	if (!HttpParser::equals(request.method, request.methodLength, "GET")) {
+		sendResponse(connection, 405, request.keepAlive, NULL, NULL, 0);
+	} else if (HttpParser::equals(request.path, request.pathLength, "/data")) {
+		if (request.ifNoneMatch != NULL && HttpParser::equals(request.ifNoneMatch, request.ifNoneMatchLength, ETAG)) {
+			sendResponse(connection, 304, request.keepAlive, ETAG, NULL, 0);
+		} else {
+			sendResponse(connection, 200, request.keepAlive, ETAG, DATA, sizeof(DATA) - 1);
+		}
+	} else if (HttpParser::equals(request.path, request.pathLength, "/maxCurrent")) {
+		const char response[] = "{\"maxCurrent\": 78}";
+		sendResponse(connection, 200, request.keepAlive, NULL, response, sizeof(response) - 1);
+	} else {
+		sendResponse(connection, 404, request.keepAlive, NULL, NULL, 0);
+	}
+	return request.keepAlive;
+}
+
+/**
+ * Read the available data of a connection and answer all complete requests.
+ */
+static void service(Connection &connection) {
+	ssize_t received = recv(connection.socket, connection.buffer + connection.length, REQUEST_SIZE - connection.length, 0);
+	if (received <= 0) {
+		closeConnection(connection);
+		return;
+	}
+	connection.length += received;
+	connection.lastActivity = time(NULL);
+
+	while (connection.length > 0) {
+		size_t requestLength = HttpParser::getRequestLength(connection.buffer, connection.length);
+		if (requestLength > REQUEST_SIZE || (requestLength == 0 && connection.length == REQUEST_SIZE)) {
+			sendResponse(connection, 431, false, NULL, NULL, 0);
+			closeConnection(connection);
+			return;
+		}
+		if (requestLength == 0 || requestLength > connection.length) {
+			return;
+		}
+
+		HttpParser::Request request;
+		bool valid = HttpParser::parse(connection.buffer, requestLength, request);
+		if (!valid) {
+			sendResponse(connection, 400, false, NULL, NULL, 0);
+		}
+		if (!valid || !process(connection, request)) {
+			closeConnection(connection);
+			return;
+		}
+		connection.length -= requestLength;
+		memmove(connection.buffer, connection.buffer + requestLength, connection.length);
+	}
+}
+
+/**
+ * Take over a new connection, replacing the one which is idle the longest if all are in use.
+ */
+static void acceptConnection(int server) {
+	int socket = accept(server, NULL, NULL);
+	if (socket < 0) {
+		return;
+	}
+
+	Connection *slot = NULL;
+	for (int i = 0; i < maxConnections; i++) {
+		if (connections[i].socket < 0) {
+			slot = &connections[i];
+			break;
+		}
+		if (connections[i].length == 0 && (slot == NULL || connections[i].lastActivity < slot->lastActivity)) {
+			slot = &connections[i];
+		}
+	}
+	if (slot == NULL) {
+		close(socket);
+		return;
+	}
+	if (slot->socket >= 0) {
+		closeConnection(*slot);
+	}
+
+	int enable = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	slot->socket = socket;
+	slot->length = 0;
+	slot->lastActivity = time(NULL);
+}
+
+int main(int argc, char **argv) {
+	uint16_t port = (argc > 1 ? atoi(argv[1]) : 8080);
+	maxConnections = (argc > 2 ? atoi(argv[2]) : 3);
+	idleTimeout = (argc > 3 ? atoi(argv[3]) : 10);
+	if (maxConnections < 1 || maxConnections > MAX_CONNECTIONS) {
+		fprintf(stderr, "maxConnections must be 1..%d\n", MAX_CONNECTIONS);
+		return 1;
+	}
+	for (int i = 0; i < MAX_CONNECTIONS; i++) {
+		connections[i].socket = -1;
+		connections[i].length = 0;
+	}
+
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+	int enable = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(server, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(server, 5) != 0) {
+		perror("unable to listen");
+		return 1;
+	}
+	printf("listening on port %d\n", port);
+	fflush(stdout);
+
+	while (true) {
+		struct pollfd fds[MAX_CONNECTIONS + 1];
+		fds[0].fd = server;
+		fds[0].events = POLLIN;
+		for (int i = 0; i < maxConnections; i++) {
+			fds[i + 1].fd = connections[i].socket;
+			fds[i + 1].events = POLLIN;
+		}
+		poll(fds, maxConnections + 1, 1000);
+
+		time_t now = time(NULL);
+		for (int i = 0; i < maxConnections; i++) {
+			if (connections[i].socket < 0) {
+				continue;
+			}
+			if (fds[i + 1].revents != 0) {
+				service(connections[i]);
+			} else if (now - connections[i].lastActivity > idleTimeout) {
+				closeConnection(connections[i]);
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			acceptConnection(server);
+		}
+	}
+}
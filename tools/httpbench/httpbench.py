@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Measures the request rate and the latency per request of the API server of SolarInverterToWeb
+with a new connection per request (Connection: close, like the web server on port 80), with a
+persistent connection (keep-alive) and with pipelined requests on a persistent connection.
+Before the measurement, it checks that pipelined requests are answered in order and that
+ETags, Connection: close and unknown paths are handled.
+
+Against the host build of the request handling (see apiserver.cpp):
+
+    ./apiserver &
+    ./httpbench.py localhost 8080
+
+Against a device (api.port in config.json):
+
+    ./httpbench.py 192.168.4.1 8080 --requests 200
+"""
+
+import argparse
+import socket
+import statistics
+import sys
+import time
+
+failures = 0
+
+
+def check(condition, description):
+    global failures
+    print('%s: %s' % ('ok' if condition else 'FAILED', description))
+    if not condition:
+        failures += 1
+
+
+def request(host, path, keep_alive=True, headers=''):
+    return ('GET %s HTTP/1.1\r\nHost: %s\r\n%s%s\r\n'
+            % (path, host, '' if keep_alive else 'Connection: close\r\n', headers)).encode()
+
+
+class Reader:
+    """Reads HTTP responses from a socket, one after the other."""
+
+    def __init__(self, connection):
+        self.connection = connection
+        self.data = b''
+
+    def receive(self):
+        chunk = self.connection.recv(4096)
+        if not chunk:
+            raise ConnectionError('connection closed')
+        self.data += chunk
+
+    def response(self):
+        while b'\r\n\r\n' not in self.data:
+            self.receive()
+        header, self.data = self.data.split(b'\r\n\r\n', 1)
+        lines = header.decode().split('\r\n')
+        status = int(lines[0].split(' ')[1])
+        fields = {name.strip().lower(): value.strip() for name, value in (line.split(':', 1) for line in lines[1:])}
+        length = int(fields.get('content-length', 0))
+        while len(self.data) < length:
+            self.receive()
+        body, self.data = self.data[:length], self.data[length:]
+        return status, fields, body
+
+    def closed(self):
+        try:
+            return self.connection.recv(1) == b''
+        except (ConnectionError, socket.timeout):
+            return True
+
+
+def connect(host, port):
+    connection = socket.create_connection((host, port), timeout=5)
+    connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return connection
+
+
+def test(host, port):
+    with connect(host, port) as connection:
+        reader = Reader(connection)
+        paths = ['/data', '/maxCurrent', '/unknown', '/maxCurrent', '/data']
+        connection.sendall(b''.join(request(host, path) for path in paths))
+        responses = [reader.response() for _ in paths]
+        check([status for status, _, _ in responses] == [200, 200, 404, 200, 200], 'pipelined requests answered')
+        check(b'maxCurrent' in responses[1][2] and responses[0][2] == responses[4][2]
+              and responses[0][2] != responses[1][2], 'pipelined responses in order')
+        check(all(fields.get('connection') == 'keep-alive' for _, fields, _ in responses), 'connection kept alive')
+
+        etag = responses[0][1].get('etag')
+        connection.sendall(request(host, '/data', headers='If-None-Match: %s\r\n' % etag))
+        status, _, body = reader.response()
+        check(status == 304 and body == b'', 'unchanged data answered with 304')
+
+        connection.sendall(b'POST /data HTTP/1.1\r\nContent-Length: 4\r\n\r\ntest' + request(host, '/maxCurrent'))
+        check(reader.response()[0] == 405 and reader.response()[0] == 200, 'request with a body skipped')
+
+        connection.sendall(request(host, '/maxCurrent', keep_alive=False))
+        status, fields, _ = reader.response()
+        check(status == 200 and fields.get('connection') == 'close' and reader.closed(), 'Connection: close honoured')
+
+    with connect(host, port) as connection:
+        connection.sendall(b'GET /data HTTP/1.0\r\n\r\n')
+        reader = Reader(connection)
+        status, fields, _ = reader.response()
+        check(status == 200 and reader.closed(), 'HTTP/1.0 connection closed')
+
+
+def measure(host, port, mode, count, depth):
+    """Returns the latency of every request (in ms) and the total duration (in s)."""
+    latencies = []
+    start = time.perf_counter()
+    if mode == 'close':
+        for _ in range(count):
+            sent = time.perf_counter()
+            with connect(host, port) as connection:
+                connection.sendall(request(host, '/data', keep_alive=False))
+                Reader(connection).response()
+            latencies.append((time.perf_counter() - sent) * 1000)
+    else:
+        with connect(host, port) as connection:
+            reader = Reader(connection)
+            window = 1 if mode == 'keep-alive' else depth
+            sent = []
+            remaining = count
+            while remaining > 0 or sent:
+                while remaining > 0 and len(sent) < window:
+                    connection.sendall(request(host, '/data'))
+                    sent.append(time.perf_counter())
+                    remaining -= 1
+                reader.response()
+                latencies.append((time.perf_counter() - sent.pop(0)) * 1000)
+    return latencies, time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the API server of SolarInverterToWeb')
+    parser.add_argument('host', nargs='?', default='localhost')
+    parser.add_argument('port', nargs='?', type=int, default=8080)
+    parser.add_argument('--requests', type=int, default=2000, help='number of requests per mode')
+    parser.add_argument('--depth', type=int, default=8, help='number of pipelined requests in flight')
+    arguments = parser.parse_args()
+
+    test(arguments.host, arguments.port)
+
+    print('%-12s %10s %10s %10s %10s' % ('mode', 'req/s', 'p50 ms', 'p95 ms', 'max ms'))
+    for mode in ['close', 'keep-alive', 'pipelined']:
+        latencies, duration = measure(arguments.host, arguments.port, mode, arguments.requests, arguments.depth)
+        latencies.sort()
+        print('%-12s %10.0f %10.2f %10.2f %10.2f' % (mode, len(latencies) / duration, statistics.median(latencies),
+                                                     latencies[int(len(latencies) * 0.95) - 1], latencies[-1]))
+
+    print('%d failure(s)' % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
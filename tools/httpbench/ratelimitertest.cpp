@@ -0,0 +1,124 @@
+/*
+ * ratelimitertest.cpp
+ *
+ * Test of the token buckets of the admission control (RateLimiter) on the host: burst and
+ * refill, the Retry-After time of a rejected client, replacing the least recently seen client
+ * and the wrap-around of millis():
+ *
+ *   g++ -O2 -Wall -Wextra -I../.. -o ratelimitertest ratelimitertest.cpp ../../RateLimiter.cpp
+ *   ./ratelimitertest
+ *
+ * The exit code is 1 if any check fails.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include "RateLimiter.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *description) {
+	printf("%-60s %s\n", description, condition ? "ok" : "FAILED");
+	if (!condition) {
+		failures++;
+	}
+}
+
+/**
+ * Take tokens until the client is rejected, returns the number of admitted requests.
+ */
+static uint32_t drain(RateLimiter &limiter, const RateLimiter::Settings &settings, uint32_t address, uint32_t now) {
+	uint32_t admitted = 0;
+	while (admitted < 1000 && limiter.take(limiter.getClient(settings, address, now))) {
+		admitted++;
+	}
+	return admitted;
+}
+
+static void testBurstAndRefill() {
+	RateLimiter limiter;
+	RateLimiter::Settings settings = { 5, 10 }; // 5 requests per second, burst of 10
+	uint32_t address = 0x0100a8c0;
+
+	check(drain(limiter, settings, address, 1000) == 10, "a new client may send a burst");
+	check(limiter.getClient(settings, address, 1000).rejected == 1, "the rejected request is counted");
+	check(drain(limiter, settings, address, 1199) == 0, "no token after 199 ms");
+	check(drain(limiter, settings, address, 1200) == 1, "one token after 200 ms");
+	check(drain(limiter, settings, address, 2200) == 5, "rate tokens per second");
+	check(drain(limiter, settings, address, 60000) == 10, "refill stops at the burst");
+	check(limiter.getClient(settings, address, 60000).admitted == 26, "the admitted requests are counted");
+}
+
+static void testRetryAfter() {
+	RateLimiter limiter;
+	RateLimiter::Settings settings = { 1, 2 };
+	uint32_t address = 0x0200a8c0;
+
+	drain(limiter, settings, address, 0);
+	check(limiter.getRetryAfter(settings, limiter.getClient(settings, address, 0)) == 1, "retry after 1 sec with an empty bucket");
+	check(limiter.getRetryAfter(settings, limiter.getClient(settings, address, 999)) == 1, "retry after 1 sec with 1 ms missing");
+	check(drain(limiter, settings, address, 1000) == 1, "the token is there after Retry-After");
+
+	RateLimiter::Client client = { address, 0, 0, 0, 0 };
+	RateLimiter::Settings slow = { 1, 1 };
+	check(limiter.getRetryAfter(slow, client) == 1, "a whole token missing is exactly 1 sec");
+	client.tokens = RATE_LIMITER_TOKEN;
+	check(limiter.getRetryAfter(slow, client) == 1, "at least 1 sec with a token left");
+}
+
+static void testEviction() {
+	RateLimiter limiter;
+	RateLimiter::Settings settings = { 1, 3 };
+
+	for (uint32_t i = 0; i < RATE_LIMITER_CLIENTS; i++) {
+		limiter.take(limiter.getClient(settings, 100 + i, i * 10));
+	}
+	check(limiter.getEvictions() == 0, "no eviction until the table is full");
+
+	limiter.getClient(settings, 100, 500); // the oldest one is used again
+	limiter.take(limiter.getClient(settings, 200, 510));
+	check(limiter.getEvictions() == 1, "an unknown client evicts one bucket");
+
+	bool found100 = false, found101 = false, found200 = false;
+	for (uint8_t i = 0; i < RATE_LIMITER_CLIENTS; i++) {
+		const RateLimiter::Client &client = limiter.getClient(i);
+		found100 |= client.address == 100;
+		found101 |= client.address == 101;
+		found200 |= client.address == 200;
+	}
+	check(found100 && found200 && !found101, "the least recently seen client is evicted");
+	check(limiter.getClient(settings, 200, 510).tokens == 2 * RATE_LIMITER_TOKEN, "the new client starts with a full bucket");
+}
+
+static void testWrapAround() {
+	RateLimiter limiter;
+	RateLimiter::Settings settings = { 2, 4 };
+	uint32_t address = 0x0300a8c0;
+
+	drain(limiter, settings, address, 0xfffffe00);
+	check(drain(limiter, settings, address, 0x00000100) == 1, "refill across the wrap-around of millis()");
+
+	RateLimiter table;
+	table.getClient(settings, address, 0xffffff00);
+	for (uint32_t i = 0; i < RATE_LIMITER_CLIENTS - 1; i++) {
+		table.getClient(settings, 100 + i, 0x00000010 + i);
+	}
+	table.getClient(settings, 200, 0x00000100);
+	bool found = false;
+	for (uint8_t i = 0; i < RATE_LIMITER_CLIENTS; i++) {
+		found |= table.getClient(i).address == address;
+	}
+	check(!found, "the oldest client across the wrap-around is evicted");
+}
+
+int main() {
+	testBurstAndRefill();
+	testRetryAfter();
+	testEviction();
+	testWrapAround();
+
+	printf("%d failure(s)\n", failures);
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+Decoder for the binary log format of SolarInverterToWeb (see LOG_BINARY in Logger.h).
+
+The firmware writes only a hash of the format string, a timestamp and the raw arguments.
+The message table (hash -> format) is generated from the LOG_DEBUG/INFO/WARN/ERROR call
+sites of the sources the firmware was built from:
+
+    ./logdecode.py table ../.. > logtable.json
+
+Decode a capture of the serial port or of the /log web page:
+
+    curl -s http://192.168.4.1/log | ./logdecode.py decode logtable.json
+    ./logdecode.py decode logtable.json /dev/ttyUSB0
+
+Instead of a table file, the source directory can be given to "decode" directly.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+RECORD_SYNC = 0xF0
+RECORD_HEADER = 10
+RECORD_SIZE = 64
+LEVELS = ['DEBUG', 'INFO', 'WARNING', 'ERROR', 'CONSOLE']
+TEXT_MESSAGE = 0  # id of pre-formatted text (direct Logger calls)
+
+CALL_PATTERN = re.compile(r'LOG_(DEBUG|INFO|WARN|ERROR)\s*\(\s*"((?:[^"\\]|\\.)*)"')
+SPEC_PATTERN = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z)?([diuxXcfeEgGsSp%])')
+ESCAPES = {'n': '\n', 'r': '\r', 't': '\t', '"': '"', '\\': '\\', "'": "'", '0': '\0'}
+
+
+def message_id(text):
+    """FNV-1a hash of the format, same as logMessageId() in Logger.h"""
+    value = 2166136261
+    for byte in text.encode('latin-1'):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def unescape(literal):
+    return re.sub(r'\\(.)', lambda match: ESCAPES.get(match.group(1), match.group(1)), literal)
+
+
+def build_table(source_dir):
+    table = {}
+    for root, _, files in os.walk(source_dir):
+        if os.path.relpath(root, source_dir).startswith('tools'):
+            continue
+        for name in sorted(files):
+            if not name.endswith(('.cpp', '.h', '.ino')):
+                continue
+            path = os.path.join(root, name)
+            with open(path, encoding='latin-1') as file:
+                for number, line in enumerate(file, 1):
+                    for match in CALL_PATTERN.finditer(line):
+                        text = unescape(match.group(2))
+                        key = '%08x' % message_id(text)
+                        location = '%s:%d' % (os.path.relpath(path, source_dir), number)
+                        if key in table and table[key]['format'] != text:
+                            sys.exit('hash collision between %s and %s, change one of the messages'
+                                     % (table[key]['location'], location))
+                        table[key] = {'format': text, 'location': location}
+    return table
+
+
+def load_table(path):
+    if os.path.isdir(path):
+        return build_table(path)
+    with open(path) as file:
+        return json.load(file)
+
+
+def format_message(text, data):
+    """Convert the C format to a python one while consuming the arguments from data."""
+    values = []
+    offset = 0
+
+    def replace(match):
+        nonlocal offset
+        flags, conversion = match.group(1), match.group(3)
+        if conversion == '%':
+            return '%%'
+        if conversion in 'sS':
+            end = data.index(b'\0', offset)
+            values.append(data[offset:end].decode('latin-1'))
+            offset = end + 1
+            return '%' + flags + 's'
+        if conversion in 'feEgG':
+            values.append(struct.unpack_from('<f', data, offset)[0])
+        elif conversion in 'di':
+            values.append(struct.unpack_from('<i', data, offset)[0])
+        elif conversion == 'c':
+            values.append(chr(data[offset]))
+        else:
+            values.append(struct.unpack_from('<I', data, offset)[0])
+            if conversion == 'p':
+                conversion = 'x'
+        offset += 4
+        return '%' + flags + ('d' if conversion == 'u' else conversion)
+
+    python_format = SPEC_PATTERN.sub(replace, text)
+    return python_format % tuple(values)
+
+
+def decode(stream, table, output):
+    buffer = b''
+    unknown = 0
+    while True:
+        chunk = stream.read(4096)
+        if chunk:
+            buffer += chunk
+        position = 0
+        while len(buffer) - position >= RECORD_HEADER:
+            sync = buffer[position]
+            length = buffer[position + 1]
+            if sync & 0xF0 != RECORD_SYNC or (sync & 0x0F) >= len(LEVELS) \
+                    or RECORD_HEADER + length > RECORD_SIZE:
+                position += 1  # not at the start of a record (e.g. partially overwritten data)
+                continue
+            if len(buffer) - position < RECORD_HEADER + length:
+                break
+            message, timestamp = struct.unpack_from('<II', buffer, position + 2)
+            data = buffer[position + RECORD_HEADER:position + RECORD_HEADER + length]
+            if message == TEXT_MESSAGE:
+                text = '%s'
+            elif '%08x' % message in table:
+                text = table['%08x' % message]['format']
+            else:
+                unknown += 1
+                position += 1
+                continue
+            try:
+                line = format_message(text, data)
+            except (ValueError, struct.error, TypeError):
+                position += 1
+                continue
+            level = LEVELS[sync & 0x0F]
+            output.write(line + '\n' if level == 'CONSOLE' else '%d - %s: %s\n' % (timestamp, level, line))
+            output.flush()
+            position += RECORD_HEADER + length
+        buffer = buffer[position:]
+        if not chunk:
+            break
+    if unknown:
+        sys.stderr.write('%d records with unknown message id, was the table generated from the right sources?\n'
+                         % unknown)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode binary log records of SolarInverterToWeb')
+    commands = parser.add_subparsers(dest='command', required=True)
+    table_parser = commands.add_parser('table', help='generate the message table from the sources')
+    table_parser.add_argument('sources', help='directory containing the firmware sources')
+    decode_parser = commands.add_parser('decode', help='decode a binary log')
+    decode_parser.add_argument('table', help='message table (json) or directory containing the firmware sources')
+    decode_parser.add_argument('input', nargs='?', help='file or serial device to read, default: stdin')
+    arguments = parser.parse_args()
+
+    if arguments.command == 'table':
+        json.dump(build_table(arguments.sources), sys.stdout, indent=1, sort_keys=True)
+        sys.stdout.write('\n')
+        return
+
+    table = load_table(arguments.table)
+    if arguments.input:
+        with open(arguments.input, 'rb', buffering=0) as stream:
+            decode(stream, table, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, table, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
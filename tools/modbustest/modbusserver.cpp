@@ -0,0 +1,107 @@
+/*
+ * modbusserver.cpp
+ *
+ * Serves a register image with a captured sample through ModbusHandler on the host, so the
+ * request processing can be tested with a Modbus client library (see modbustest.py):
+ *
+ *   g++ -O2 -I../.. -o modbusserver modbusserver.cpp ../../ModbusHandler.cpp
+ *   ./modbusserver [port] &
+ *   ./modbustest.py [host] [port]
+ *
+ * The default port is 1502 as 502 requires root privileges. Only the holding register 0
+ * (remote override) accepts writes, values > 1 are rejected like on the device.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ModbusHandler.h"
+
+#define INPUT_REGISTER_COUNT 16
+#define HOLDING_REGISTER_COUNT 1
+
+// sample: 7.8A / 1800W, mode battery, warning bits 0x00010400, PV 228.5V / 2050W, out 1760W,
+// bus 380V, battery 26.80V / 3A, soc 85.3%, controller error -1.25V, sequence 70000
+static uint16_t inputRegisters[INPUT_REGISTER_COUNT] = { 78, 1800, 0, 3, 0x0001, 0x0400, 2285, 2050, 1760, 380, 2680,
+		3, 853, (uint16_t) -125, 1, 4464 };
+static uint16_t holdingRegisters[HOLDING_REGISTER_COUNT];
+
+static bool writeRegister(uint16_t address, uint16_t value) {
+	if (address != 0 || value > 1) {
+		return false;
+	}
+	inputRegisters[0] = (value ? 0xffff : 78);
+	inputRegisters[2] = value;
+	return true;
+}
+
+/**
+ * Answer the requests of a connection until it's closed, pipelined requests are answered in order.
+ */
+static void serve(int connection, ModbusHandler &handler) {
+	uint8_t buffer[MODBUS_FRAME_SIZE];
+	uint8_t response[MODBUS_FRAME_SIZE];
+	size_t length = 0;
+
+	while (true) {
+		ssize_t received = recv(connection, buffer + length, sizeof(buffer) - length, 0);
+		if (received <= 0) {
+			return;
+		}
+		length += received;
+
+		while (true) {
+			size_t frameLength = ModbusHandler::getFrameLength(buffer, length);
+			if (frameLength == 0 || (frameLength <= MODBUS_FRAME_SIZE && frameLength > length)) {
+				break;
+			}
+			size_t responseLength = handler.process(buffer, frameLength, response);
+			if (responseLength == 0) {
+				printf("invalid request, closing connection\n");
+				return;
+			}
+			if (send(connection, response, responseLength, 0) != (ssize_t) responseLength) {
+				return;
+			}
+			length -= frameLength;
+			memmove(buffer, buffer + frameLength, length);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	uint16_t port = (argc > 1 ? atoi(argv[1]) : 1502);
+	ModbusHandler handler(inputRegisters, INPUT_REGISTER_COUNT, holdingRegisters, HOLDING_REGISTER_COUNT, writeRegister);
+
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+	int enable = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(server, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(server, 1) != 0) {
+		perror("unable to listen");
+		return 1;
+	}
+	printf("listening on port %d\n", port);
+	fflush(stdout);
+
+	while (true) {
+		int connection = accept(server, NULL, NULL);
+		if (connection < 0) {
+			continue;
+		}
+		setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		serve(connection, handler);
+		close(connection);
+	}
+}
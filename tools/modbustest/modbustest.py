@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Test of the Modbus TCP server of SolarInverterToWeb with the pymodbus client library
+(pip install pymodbus).
+
+Against the host build of the request handler (see modbusserver.cpp):
+
+    ./modbusserver &
+    ./modbustest.py localhost 1502
+
+Against a device (with modbus.enabled and modbus.write in config.json), the register values
+are only printed, as they depend on the current sample:
+
+    ./modbustest.py --device 192.168.4.1
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+from pymodbus.client import ModbusTcpClient
+
+INPUT_REGISTERS = ['maxCurrent', 'maxPower', 'override', 'mode', 'warningHigh', 'warningLow', 'pvVoltage',
+                   'pvPower', 'outPower', 'busVoltage', 'batteryVoltage', 'batteryCurrent', 'soc',
+                   'controllerError', 'sequenceHigh', 'sequenceLow']
+SAMPLE = [78, 1800, 0, 3, 0x0001, 0x0400, 2285, 2050, 1760, 380, 2680, 3, 853, 0x10000 - 125, 1, 4464]
+ILLEGAL_FUNCTION = 1
+ILLEGAL_DATA_ADDRESS = 2
+ILLEGAL_DATA_VALUE = 3
+
+failures = 0
+
+
+def check(condition, description):
+    global failures
+    print('%s: %s' % ('ok' if condition else 'FAILED', description))
+    if not condition:
+        failures += 1
+
+
+def check_exception(response, code, description):
+    check(response.isError() and getattr(response, 'exception_code', None) == code, description)
+
+
+def test_pipelining(host, port):
+    """pymodbus waits for every response, so send several requests at once on a raw socket."""
+    requests = b''.join(struct.pack('>HHHBBHH', transaction, 0, 6, 1, 4, transaction, 1) for transaction in range(3))
+    with socket.create_connection((host, port), timeout=5) as connection:
+        connection.sendall(requests)
+        data = b''
+        while len(data) < 3 * 11:
+            chunk = connection.recv(256)
+            if not chunk:
+                break
+            data += chunk
+    transactions = [struct.unpack_from('>H', data, offset)[0] for offset in range(0, len(data), 11)]
+    check(transactions == [0, 1, 2], 'pipelined requests answered in order')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Test the Modbus TCP server of SolarInverterToWeb')
+    parser.add_argument('host', nargs='?', default='localhost')
+    parser.add_argument('port', nargs='?', type=int, default=1502)
+    parser.add_argument('--device', action='store_true', help='test a device, the values are not checked')
+    arguments = parser.parse_args()
+    port = 502 if arguments.device and arguments.port == 1502 else arguments.port
+
+    client = ModbusTcpClient(arguments.host, port=port)
+    if not client.connect():
+        sys.exit('unable to connect to %s:%d' % (arguments.host, port))
+
+    response = client.read_input_registers(0, count=len(INPUT_REGISTERS))
+    check(not response.isError() and len(response.registers) == len(INPUT_REGISTERS), 'read all input registers')
+    if not response.isError():
+        for name, value in zip(INPUT_REGISTERS, response.registers):
+            print('  %-16s %5d' % (name, value))
+        if not arguments.device:
+            check(response.registers == SAMPLE, 'input registers match the sample')
+
+    response = client.read_input_registers(6, count=2)
+    check(not response.isError() and response.registers[0] > 0, 'read a range of input registers')
+    check_exception(client.read_input_registers(15, count=2), ILLEGAL_DATA_ADDRESS, 'read beyond the last register')
+    check_exception(client.read_input_registers(0, count=126), ILLEGAL_DATA_VALUE, 'read too many registers')
+
+    check(not client.write_register(0, 1).isError(), 'activate the remote override')
+    response = client.read_holding_registers(0, count=1)
+    check(not response.isError() and response.registers == [1], 'holding register reflects the override')
+    if not arguments.device:
+        response = client.read_input_registers(0, count=3)
+        check(response.registers == [0xffff, 1800, 1], 'max current is 65535 while the override is active')
+    check(not client.write_registers(0, [0]).isError(), 'deactivate the remote override (write multiple)')
+    check_exception(client.write_register(0, 2), ILLEGAL_DATA_VALUE, 'reject invalid override value')
+    check_exception(client.write_register(1, 1), ILLEGAL_DATA_ADDRESS, 'reject write to unknown register')
+    check_exception(client.read_coils(0, count=1), ILLEGAL_FUNCTION, 'reject unsupported function')
+    client.close()
+
+    test_pipelining(arguments.host, port)
+
+    print('%d failure(s)' % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
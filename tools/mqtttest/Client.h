@@ -0,0 +1,33 @@
+/*
+ * Client.h
+ *
+ * Host replacement of the Arduino Client interface, only the methods used by MqttClient,
+ * implemented with a POSIX socket.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#ifndef CLIENT_H_
+#define CLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Client
+{
+public:
+    Client();
+    virtual ~Client();
+    int connect(const char *host, uint16_t port);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available();
+    int read(uint8_t *buffer, size_t size);
+    uint8_t connected();
+    void stop();
+
+private:
+    int socket;
+};
+
+#endif /* CLIENT_H_ */
@@ -0,0 +1,183 @@
+/*
+ * mqtttest.cpp
+ *
+ * Test of MqttClient against a broker running on the host, e.g. mosquitto:
+ *
+ *   mosquitto -v &
+ *   g++ -O2 -I. -I../.. -o mqtttest mqtttest.cpp ../../MqttClient.cpp
+ *   ./mqtttest [host] [port]
+ *
+ * It connects with a last will, subscribes to a command topic, publishes a retained message
+ * and expects to receive its own message on the command topic. Then it checks that the
+ * retained message is delivered to a second connection and that the keep-alive works.
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "MqttClient.h"
+
+Client::Client() {
+	socket = -1;
+}
+
+Client::~Client() {
+	stop();
+}
+
+int Client::connect(const char *host, uint16_t port) {
+	char service[8];
+	struct addrinfo hints = { }, *result;
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%u", port);
+	if (getaddrinfo(host, service, &hints, &result) != 0) {
+		return 0;
+	}
+	socket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (socket < 0 || ::connect(socket, result->ai_addr, result->ai_addrlen) != 0) {
+		freeaddrinfo(result);
+		stop();
+		return 0;
+	}
+	freeaddrinfo(result);
+	fcntl(socket, F_SETFL, O_NONBLOCK);
+	return 1;
+}
+
+size_t Client::write(const uint8_t *buffer, size_t size) {
+	ssize_t length = send(socket, buffer, size, MSG_NOSIGNAL);
+	return length < 0 ? 0 : length;
+}
+
+int Client::available() {
+	int length = 0;
+	if (socket < 0 || ioctl(socket, FIONREAD, &length) != 0) {
+		return 0;
+	}
+	return length;
+}
+
+int Client::read(uint8_t *buffer, size_t size) {
+	ssize_t length = recv(socket, buffer, size, 0);
+	return length < 0 ? -1 : length;
+}
+
+uint8_t Client::connected() {
+	if (socket < 0) {
+		return 0;
+	}
+	char data;
+	ssize_t length = recv(socket, &data, 1, MSG_PEEK | MSG_DONTWAIT);
+	return length != 0;
+}
+
+void Client::stop() {
+	if (socket >= 0) {
+		close(socket);
+		socket = -1;
+	}
+}
+
+static uint32_t millis() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static char receivedTopic[64];
+static char receivedPayload[64];
+
+static void onMessage(const char *topic, const uint8_t *payload, size_t length) {
+	snprintf(receivedTopic, sizeof(receivedTopic), "%s", topic);
+	snprintf(receivedPayload, sizeof(receivedPayload), "%.*s", (int) length, (const char *) payload);
+	printf("received %s: %s\n", receivedTopic, receivedPayload);
+}
+
+/**
+ * Call loop() until the condition is met or the timeout elapsed.
+ */
+static bool waitFor(MqttClient &mqtt, bool (*condition)(MqttClient &), uint32_t timeout) {
+	uint32_t start = millis();
+	while (millis() - start < timeout) {
+		if (!mqtt.loop(millis())) {
+			return false;
+		}
+		if (condition(mqtt)) {
+			return true;
+		}
+		usleep(1000);
+	}
+	return false;
+}
+
+static bool isConnected(MqttClient &mqtt) {
+	return mqtt.isConnected();
+}
+
+static bool hasMessage(MqttClient &) {
+	return receivedTopic[0] != 0;
+}
+
+static void check(bool condition, const char *description) {
+	printf("%s: %s\n", condition ? "OK  " : "FAIL", description);
+	if (!condition) {
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *host = argc > 1 ? argv[1] : "localhost";
+	uint16_t port = argc > 2 ? atoi(argv[2]) : 1883;
+
+	Client client;
+	MqttClient mqtt(client);
+	mqtt.setCallback(onMessage);
+	check(client.connect(host, port), "TCP connection to broker");
+	check(mqtt.connect("mqtttest", NULL, NULL, "mqtttest/online", "false", 2, millis()), "send CONNECT");
+	check(waitFor(mqtt, isConnected, 2000), "CONNACK received");
+
+	check(mqtt.subscribe("mqtttest/command"), "send SUBSCRIBE");
+	check(mqtt.publish("mqtttest/maxCurrent", "123", true), "publish retained");
+	usleep(100000);
+	check(mqtt.publish("mqtttest/command", "switchToGrid", false), "publish command");
+	check(waitFor(mqtt, hasMessage, 2000), "command received");
+	check(strcmp(receivedTopic, "mqtttest/command") == 0 && strcmp(receivedPayload, "switchToGrid") == 0,
+			"command topic and payload");
+
+	Client client2;
+	MqttClient mqtt2(client2);
+	receivedTopic[0] = 0;
+	mqtt2.setCallback(onMessage);
+	check(client2.connect(host, port), "second TCP connection");
+	check(mqtt2.connect("mqtttest2", NULL, NULL, NULL, NULL, 0, millis()), "second CONNECT");
+	check(waitFor(mqtt2, isConnected, 2000), "second CONNACK received");
+	check(mqtt2.subscribe("mqtttest/maxCurrent"), "subscribe retained topic");
+	check(waitFor(mqtt2, hasMessage, 2000), "retained message received");
+	check(strcmp(receivedPayload, "123") == 0, "retained payload");
+	mqtt2.publish("mqtttest/maxCurrent", "", true); // delete the retained message
+	mqtt2.disconnect();
+
+	uint32_t start = millis();
+	bool alive = true;
+	while (alive && millis() - start < 5000) { // more than twice the keep-alive
+		alive = mqtt.loop(millis());
+		usleep(10000);
+	}
+	check(alive && mqtt.isConnected(), "connection kept alive with PINGREQ");
+	mqtt.disconnect();
+
+	printf("all tests passed\n");
+	return 0;
+}
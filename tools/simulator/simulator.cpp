@@ -0,0 +1,405 @@
+/*
+ * simulator.cpp
+ *
+ * Host-side closed-loop simulation of the solar power controller (PowerController, used by
+ * Inverter::calculateMaximumSolarPower) against a simple plant model:
+ *
+ * - PV array: single diode I-V curve scaled by irradiance, the MPPT of the inverter only draws
+ *   what is demanded, so the PV voltage rises above the MPP voltage when power is left unused.
+ * - Inverter: covers the output power with PV first, the rest from the battery (SBU mode), the bus
+ *   voltage sags when the battery can't deliver the deficit.
+ * - Battery: open circuit voltage + internal resistance, charged with surplus PV power up to a limit.
+ * - Consumer: e.g. an EV charger, polls the published maximum current, rounds it down to whole
+ *   Amperes (with a minimum current) and follows it with a first order lag.
+ *
+ * It reports the settling time after changes of the available power, the overshoot, the energy drawn
+ * from the battery and the PV energy left unused, so controller variants and config.json tunings
+ * can be compared offline.
+ *
+ * Build and run (from this directory):
+ *   g++ -O2 -I../.. -o simulator simulator.cpp ../../PowerController.cpp
+ *   ./simulator --profile all --mode 1 --kp 40 --ki 75
+ *
+ * Options use the names of the corresponding config.json fields, see printUsage().
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Michael Neuweiler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "PowerController.h"
+
+#define TIME_STEP 100 // resolution of the plant simulation (in ms)
+#define SETTLING_BAND 0.05 // the output is settled when within 5% (or SETTLING_BAND_MIN) of the ideal power
+#define SETTLING_BAND_MIN 50.0 // in W
+#define SETTLING_HOLD 5000 // time the output has to stay within the band to be considered settled (in ms)
+#define EVENT_THRESHOLD 0.10 // a change of the ideal power by 10% (or EVENT_THRESHOLD_MIN) starts a new settling period
+#define EVENT_THRESHOLD_MIN 100.0 // in W
+
+struct Plant
+{
+	// PV array
+	double pvShortCircuitCurrent; // at 1000W/m2 (in A)
+	double pvOpenCircuitVoltage; // at 1000W/m2 (in V)
+	double pvThermalVoltage; // diode voltage factor of the whole string (in V)
+	// inverter
+	double efficiency; // DC to AC
+	double busNominalVoltage; // in V
+	double outVoltage; // in V
+	double baseLoad; // other loads on the output (in W)
+	// battery
+	double batteryCapacity; // in Ah
+	double batterySoc; // 0..1
+	double batteryVoltageEmpty; // OCV at 0% (in V)
+	double batteryVoltageFull; // OCV at 100% (in V)
+	double batteryResistance; // in Ohm
+	double batteryMaxCharge; // in A
+	double batteryMaxDischarge; // in A
+	// consumer
+	double consumerLag; // time constant (in sec)
+	double consumerMinCurrent; // below this the consumer switches off (in A)
+	double consumerMaxCurrent; // in A
+	uint32_t consumerPollInterval; // how often the consumer fetches the max current (in ms, 0 = immediately)
+};
+
+struct Result
+{
+	double settlingTimeSum; // in sec
+	double settlingTimeMax; // in sec
+	uint16_t events;
+	uint16_t settledEvents;
+	double overshoot; // maximum power above ideal (in W)
+	double batteryEnergy; // energy drawn from battery/grid (in Wh)
+	double unusedPvEnergy; // in Wh
+	double consumerEnergy; // in Wh
+	double idealConsumerEnergy; // in Wh
+};
+
+enum Profile
+{
+	CLEAR,
+	CLOUDY,
+	EDGES
+};
+static const char *profileNames[] = { "clear", "cloudy", "edges" };
+
+static uint32_t randomState = 42;
+
+/**
+ * Deterministic pseudo random number 0..1 so runs are comparable.
+ */
+static double nextRandom() {
+	randomState = randomState * 1664525 + 1013904223;
+	return (randomState >> 8) / 16777216.0;
+}
+
+/**
+ * Irradiance (0..1 of 1000W/m2) at time t (in ms) for the given profile.
+ */
+static double getIrradiance(Profile profile, uint32_t t) {
+	static double cloud = 1.0;
+	static double cloudTarget = 1.0;
+	double sun = 0.9 + 0.1 * sin(t / 600000.0); // slow drift of the sun
+
+	switch (profile) {
+	case CLOUDY: // randomly passing clouds, smoothed
+		if (t % 20000 == 0) {
+			cloudTarget = 0.25 + 0.75 * nextRandom();
+		}
+		cloud += (cloudTarget - cloud) * TIME_STEP / 8000.0;
+		return sun * cloud;
+	case EDGES: { // sharp cloud edges: 60s sun, 60s shadow (-50%) with 2s transition
+		uint32_t phase = t % 120000;
+		double shadow = (phase < 60000 ? 0.0 : (phase < 62000 ? (phase - 60000) / 2000.0 : 1.0));
+		if (phase < 2000 && t >= 120000) {
+			shadow = 1.0 - phase / 2000.0;
+		}
+		return sun * (1.0 - 0.5 * shadow);
+	}
+	default:
+		return sun;
+	}
+}
+
+static double getPvCurrent(const Plant &plant, double irradiance, double voltage) {
+	double saturationCurrent = plant.pvShortCircuitCurrent
+			/ (exp(plant.pvOpenCircuitVoltage / plant.pvThermalVoltage) - 1.0);
+	double current = irradiance * plant.pvShortCircuitCurrent
+			- saturationCurrent * (exp(voltage / plant.pvThermalVoltage) - 1.0);
+	return current > 0 ? current : 0;
+}
+
+static double getPvPower(const Plant &plant, double irradiance, double voltage) {
+	return voltage * getPvCurrent(plant, irradiance, voltage);
+}
+
+/**
+ * Find the maximum power point (voltage) by golden section search.
+ */
+static double getMppVoltage(const Plant &plant, double irradiance) {
+	double low = 0, high = plant.pvOpenCircuitVoltage * 1.1;
+	for (int i = 0; i < 60; i++) {
+		double a = high - (high - low) * 0.618;
+		double b = low + (high - low) * 0.618;
+		if (getPvPower(plant, irradiance, a) < getPvPower(plant, irradiance, b)) {
+			low = a;
+		} else {
+			high = b;
+		}
+	}
+	return (low + high) / 2;
+}
+
+/**
+ * Find the PV voltage right of the MPP where the array delivers the demanded power.
+ */
+static double getOperatingVoltage(const Plant &plant, double irradiance, double demand, double mppVoltage) {
+	double low = mppVoltage, high = plant.pvOpenCircuitVoltage * 1.1;
+	for (int i = 0; i < 60; i++) {
+		double middle = (low + high) / 2;
+		if (getPvPower(plant, irradiance, middle) > demand) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+static Result simulate(const Plant &initialPlant, const PowerController::Settings &settings, Profile profile,
+		uint32_t sampleInterval, uint32_t duration, FILE *csv) {
+	Plant plant = initialPlant;
+	PowerController controller;
+	Result result = { };
+	double consumerPower = 0, consumerTarget = 0;
+	double reference = -1, eventTime = 0, inBandSince = -1;
+	bool settled = true;
+	uint32_t lastSample = 0, lastPoll = 0;
+	PowerController::Sample sample = { };
+
+	randomState = 42;
+	controller.init(settings, 0);
+
+	for (uint32_t t = 0; t < duration; t += TIME_STEP) {
+		double irradiance = getIrradiance(profile, t);
+		double mppVoltage = getMppVoltage(plant, irradiance);
+		double mppPower = getPvPower(plant, irradiance, mppVoltage);
+
+		// battery charge demand tapers off towards full charge
+		double batteryOcv = plant.batteryVoltageEmpty
+				+ (plant.batteryVoltageFull - plant.batteryVoltageEmpty) * plant.batterySoc;
+		double chargeDemand = plant.batteryMaxCharge * batteryOcv * (plant.batterySoc > 0.9 ? (1.0 - plant.batterySoc) * 10 : 1.0);
+
+		double outPower = consumerPower + plant.baseLoad;
+		double demand = outPower / plant.efficiency + chargeDemand;
+		double pvPower = (demand >= mppPower ? mppPower : demand);
+		double pvVoltage = (demand >= mppPower ? mppVoltage : getOperatingVoltage(plant, irradiance, demand, mppVoltage));
+
+		double batteryPower = pvPower - outPower / plant.efficiency; // positive = charging
+		double batteryCurrent = batteryPower / batteryOcv;
+		double batteryVoltage = batteryOcv + batteryCurrent * plant.batteryResistance;
+		double deficit = -batteryCurrent - plant.batteryMaxDischarge;
+		double busVoltage = plant.busNominalVoltage - (deficit > 0 ? deficit * batteryVoltage * 0.05 : 0);
+
+		plant.batterySoc += batteryCurrent * TIME_STEP / 3600000.0 / plant.batteryCapacity;
+		plant.batterySoc = (plant.batterySoc < 0 ? 0 : (plant.batterySoc > 1 ? 1 : plant.batterySoc));
+
+		// the controller gets quantized values like the inverter reports them
+		if (t - lastSample >= sampleInterval) {
+			sample.pvVoltage = round(pvVoltage * 10) / 10;
+			sample.pvPower = pvPower;
+			sample.outPower = outPower;
+			sample.batteryCurrent = round(batteryCurrent);
+			sample.busVoltage = busVoltage;
+			sample.batterySoc = plant.batterySoc * 1000;
+			controller.update(settings, sample, t);
+			lastSample = t;
+		}
+
+		// consumer fetches max current, rounds it to whole Amperes and follows with a lag
+		if (plant.consumerPollInterval == 0 || t - lastPoll >= plant.consumerPollInterval) {
+			double current = floor(controller.getPower() / plant.outVoltage);
+			current = (current < plant.consumerMinCurrent ? 0 : (current > plant.consumerMaxCurrent ? plant.consumerMaxCurrent : current));
+			consumerTarget = current * plant.outVoltage;
+			lastPoll = t;
+		}
+		consumerPower += (consumerTarget - consumerPower) * TIME_STEP / (plant.consumerLag * 1000 + TIME_STEP);
+
+		// the ideal consumer power uses all PV power not needed by other loads and the battery charger
+		double ideal = (mppPower - chargeDemand) * plant.efficiency - plant.baseLoad;
+		ideal = (ideal < settings.minPower ? 0 : (ideal > settings.maxPower ? settings.maxPower : ideal));
+		double limit = controller.getPower();
+
+		if (fabs(ideal - reference) > fmax(EVENT_THRESHOLD_MIN, EVENT_THRESHOLD * reference)) {
+			if (settled || t - eventTime > SETTLING_HOLD) { // otherwise it's the continuation of a ramp
+				result.events++;
+				eventTime = t;
+			}
+			reference = ideal;
+			inBandSince = -1;
+			settled = false;
+		}
+		if (!settled) {
+			if (fabs(limit - ideal) <= fmax(SETTLING_BAND_MIN, SETTLING_BAND * ideal)) {
+				inBandSince = (inBandSince < 0 ? t : inBandSince);
+				if (t - inBandSince >= SETTLING_HOLD) {
+					double settlingTime = (inBandSince - eventTime) / 1000.0;
+					result.settlingTimeSum += settlingTime;
+					result.settlingTimeMax = fmax(result.settlingTimeMax, settlingTime);
+					result.settledEvents++;
+					settled = true;
+				}
+			} else {
+				inBandSince = -1;
+			}
+		}
+
+		result.overshoot = fmax(result.overshoot, limit - ideal);
+		result.batteryEnergy += (batteryPower < 0 ? -batteryPower : 0) * TIME_STEP / 3600000.0;
+		result.unusedPvEnergy += (mppPower - pvPower) * TIME_STEP / 3600000.0;
+		result.consumerEnergy += consumerPower * TIME_STEP / 3600000.0;
+		result.idealConsumerEnergy += ideal * TIME_STEP / 3600000.0;
+
+		if (csv) {
+			fprintf(csv, "%s,%.1f,%.3f,%.1f,%.0f,%.0f,%.0f,%.0f,%.1f,%.0f\n", profileNames[profile], t / 1000.0,
+					irradiance, pvVoltage, mppPower, pvPower, ideal, limit, consumerPower, batteryPower);
+		}
+	}
+	return result;
+}
+
+static void printUsage() {
+	printf("usage: simulator [options]\n"
+			"  --profile clear|cloudy|edges|all  irradiance profile (default: all)\n"
+			"  --duration <s>                    simulated time per profile (default: 600)\n"
+			"  --interval <ms>                   time between two STATUS samples (default: 900)\n"
+			"  --poll <ms>                       consumer poll interval, 0 = push (default: 1000)\n"
+			"  --lag <s>                         consumer time constant (default: 2)\n"
+			"  --csv <file>                      write the time series to a CSV file\n"
+			"  --mode 0|1                        inverter.controller.mode (0 = step, 1 = PI, default: 0)\n"
+			"  --kp, --ki, --batteryWeight, --rateLimit   inverter.controller.*\n"
+			"  --initial, --tolerance, --min, --max, --adjustmentStep   inverter.pv.power.*\n"
+			"  --minPvVoltage, --maxPvVoltage    inverter.pv.voltage.min/max\n"
+			"  --maxDischarge <A>                inverter.battery.dischargeCurrent.max\n");
+}
+
+int main(int argc, char **argv) {
+	// defaults match data/config.json
+	PowerController::Settings settings = { };
+	settings.mode = PowerController::Step;
+	settings.initialPower = 1840;
+	settings.minPower = 500;
+	settings.maxPower = 3000;
+	settings.outPowerTolerance = 150;
+	settings.adjustment = 25;
+	settings.maxBatteryDischargeCurrent = -9;
+	settings.minBusVoltage = 320;
+	settings.minPvVoltage = 220.0f;
+	settings.maxPvVoltage = 230.0f;
+	settings.cutoffRetryTime = 300;
+	settings.cutoffRetryMinSoc = 50;
+	settings.kp = 40.0f;
+	settings.ki = 75.0f;
+	settings.batteryCurrentWeight = 2.0f;
+	settings.rateLimit = 100;
+
+	Plant plant = { };
+	plant.pvShortCircuitCurrent = 14.0;
+	plant.pvOpenCircuitVoltage = 250.0;
+	plant.pvThermalVoltage = 11.0;
+	plant.efficiency = 0.93;
+	plant.busNominalVoltage = 380.0;
+	plant.outVoltage = 230.0;
+	plant.baseLoad = 150.0;
+	plant.batteryCapacity = 160.0;
+	plant.batterySoc = 0.95;
+	plant.batteryVoltageEmpty = 24.0;
+	plant.batteryVoltageFull = 26.8;
+	plant.batteryResistance = 0.02;
+	plant.batteryMaxCharge = 30.0;
+	plant.batteryMaxDischarge = 100.0;
+	plant.consumerLag = 2.0;
+	plant.consumerMinCurrent = 6.0;
+	plant.consumerMaxCurrent = 16.0;
+	plant.consumerPollInterval = 1000;
+
+	const char *profile = "all";
+	const char *csvFile = NULL;
+	uint32_t duration = 600000, interval = 900;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc ? argv[i + 1] : NULL);
+		if (!value || strncmp(arg, "--", 2) != 0) {
+			printUsage();
+			return 1;
+		}
+		arg += 2;
+		i++;
+
+		if (!strcmp(arg, "profile")) profile = value;
+		else if (!strcmp(arg, "duration")) duration = atof(value) * 1000;
+		else if (!strcmp(arg, "interval")) interval = atoi(value);
+		else if (!strcmp(arg, "poll")) plant.consumerPollInterval = atoi(value);
+		else if (!strcmp(arg, "lag")) plant.consumerLag = atof(value);
+		else if (!strcmp(arg, "csv")) csvFile = value;
+		else if (!strcmp(arg, "mode")) settings.mode = (atoi(value) == 1 ? PowerController::PI : PowerController::Step);
+		else if (!strcmp(arg, "kp")) settings.kp = atof(value);
+		else if (!strcmp(arg, "ki")) settings.ki = atof(value);
+		else if (!strcmp(arg, "batteryWeight")) settings.batteryCurrentWeight = atof(value);
+		else if (!strcmp(arg, "rateLimit")) settings.rateLimit = atoi(value);
+		else if (!strcmp(arg, "initial")) settings.initialPower = atoi(value);
+		else if (!strcmp(arg, "tolerance")) settings.outPowerTolerance = atoi(value);
+		else if (!strcmp(arg, "min")) settings.minPower = atoi(value);
+		else if (!strcmp(arg, "max")) settings.maxPower = atoi(value);
+		else if (!strcmp(arg, "adjustmentStep")) settings.adjustment = atoi(value);
+		else if (!strcmp(arg, "minPvVoltage")) settings.minPvVoltage = atof(value);
+		else if (!strcmp(arg, "maxPvVoltage")) settings.maxPvVoltage = atof(value);
+		else if (!strcmp(arg, "maxDischarge")) settings.maxBatteryDischargeCurrent = -atoi(value);
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	FILE *csv = NULL;
+	if (csvFile) {
+		csv = fopen(csvFile, "w");
+		if (!csv) {
+			perror(csvFile);
+			return 1;
+		}
+		fprintf(csv, "profile,time,irradiance,pvVoltage,mppPower,pvPower,idealPower,maxSolarPower,consumerPower,batteryPower\n");
+	}
+
+	printf("controller: %s, interval: %ums, consumer poll: %ums, lag: %.1fs\n",
+			settings.mode == PowerController::PI ? "PI" : "step", interval, plant.consumerPollInterval, plant.consumerLag);
+	printf("%-8s %8s %12s %12s %10s %12s %12s %10s\n", "profile", "events", "settle avg", "settle max", "overshoot",
+			"battery", "unused PV", "consumer");
+
+	for (int p = CLEAR; p <= EDGES; p++) {
+		if (strcmp(profile, "all") && strcmp(profile, profileNames[p])) {
+			continue;
+		}
+		Result result = simulate(plant, settings, (Profile) p, interval, duration, csv);
+		char settlingAverage[16], settlingMax[16];
+		if (result.settledEvents > 0) {
+			snprintf(settlingAverage, sizeof(settlingAverage), "%.1fs", result.settlingTimeSum / result.settledEvents);
+			snprintf(settlingMax, sizeof(settlingMax), "%.1fs", result.settlingTimeMax);
+		} else {
+			strcpy(settlingAverage, "-");
+			strcpy(settlingMax, "-");
+		}
+		printf("%-8s %4u/%-3u %12s %12s %8.0fW %10.1fWh %10.1fWh %9.0f%%\n", profileNames[p], result.settledEvents,
+				result.events, settlingAverage, settlingMax, result.overshoot, result.batteryEnergy,
+				result.unusedPvEnergy, result.idealConsumerEnergy > 0 ? result.consumerEnergy * 100 / result.idealConsumerEnergy : 0);
+	}
+
+	if (csv) {
+		fclose(csv);
+	}
+	return 0;
+}